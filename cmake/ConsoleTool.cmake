@@ -41,3 +41,21 @@ function(add_console_tool target_name)
 
   _vms_set_common_warnings(${target_name})
 endfunction()
+
+function(add_console_library target_name)
+  cmake_parse_arguments(CL "" "" "SOURCES;DEPS" ${ARGN})
+
+  if(NOT CL_SOURCES)
+    message(FATAL_ERROR "add_console_library(${target_name}) requires SOURCES")
+  endif()
+
+  add_library(${target_name} STATIC ${CL_SOURCES})
+  target_compile_features(${target_name} PUBLIC cxx_std_20)
+  target_include_directories(${target_name} PUBLIC "${PROJECT_SOURCE_DIR}/include")
+
+  if(CL_DEPS)
+    target_link_libraries(${target_name} PUBLIC ${CL_DEPS})
+  endif()
+
+  _vms_set_common_warnings(${target_name})
+endfunction()
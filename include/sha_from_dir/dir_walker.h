@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sha_from_dir/hash_cache.h>
+
+// A regular file found by the walker (or a symbolic link to one, described
+// by its target like stat() would).
+struct ScannedFile
+{
+  // `prefix` followed by the path below the root, NUL-terminated; only
+  // valid during the call.
+  std::string_view name;
+  // The part of `name` below the root, to be opened relative to fd().
+  const char* path = nullptr;
+  // Position of the file in a depth-first walk that visits the entries of
+  // each directory in the order the filesystem lists them (the order of
+  // recursive_directory_iterator): keys compare as bytes in that order.
+  // Only valid during the call.
+  std::string_view order;
+  // key.size is the file size.
+  CacheKey key;
+  // Hard links to the file.
+  std::uint32_t links = 1;
+};
+
+// Parallel crawler of a directory tree built on openat/getdents64/statx:
+// subdirectories are listed by several threads at once and every file is
+// described by a single statx() call. Like recursive_directory_iterator,
+// symbolic links to directories are not followed.
+class DirWalker
+{
+public:
+  // Called concurrently from the crawling threads for every file; false
+  // ends the walk.
+  using FileSink = std::function<bool(const ScannedFile& file)>;
+
+  DirWalker(std::filesystem::path root, std::string prefix, unsigned threads);
+  ~DirWalker();
+
+  DirWalker(const DirWalker&) = delete;
+  DirWalker& operator=(const DirWalker&) = delete;
+
+  // Opens the root; on failure the error is printed.
+  bool open();
+  // The root directory, for openat() on ScannedFile::path.
+  int fd() const { return rootFd_; }
+
+  // Crawls the whole tree, feeding `sink` as files are found. False when a
+  // directory could not be read (the error is printed) or the sink stopped
+  // the walk.
+  bool walk(const FileSink& sink);
+
+private:
+  struct DirNode
+  {
+    // prefix + path below the root + '/'; just prefix for the root.
+    std::string name;
+    // ScannedFile::order of the directory; empty for the root.
+    std::string order;
+  };
+
+  void crawl(const FileSink& sink);
+  bool list(const DirNode& node, const FileSink& sink, std::vector<char>& buffer, std::string& name,
+            std::string& order);
+  bool fail(const std::string& what);
+
+  std::filesystem::path root_;
+  std::string prefix_;
+  unsigned threads_;
+  int rootFd_ = -1;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  // Directories waiting to be listed, and the count of those being listed.
+  std::vector<DirNode> pending_;
+  std::size_t busy_ = 0;
+  bool stopped_ = false;
+  bool failed_ = false;
+};
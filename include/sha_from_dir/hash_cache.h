@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+#include <vms_common/digest.h>
+
+struct CacheKey
+{
+  std::uint64_t dev = 0;
+  std::uint64_t ino = 0;
+  std::uint64_t size = 0;
+  std::int64_t mtimeNs = 0;
+  std::int64_t ctimeNs = 0;
+};
+
+using CachedDigest = DigestBytes;
+
+// On-disk map (dev, inode, size, mtime, ctime) -> digest used to skip the
+// files that did not change since the previous run. A cache holds the
+// digests of a single algorithm, recorded in its header; only the first
+// digest_size() bytes of a CachedDigest are meaningful.
+//
+// The file is a small header followed by records sorted by (dev, inode),
+// each the key and digest_size() bytes of digest: it is mapped read-only
+// and searched in place. It is never
+// modified in place: save() writes a temporary file and renames it over the
+// old one while holding an exclusive flock() on the cache's directory, so readers
+// that still map the previous version are unaffected and concurrent writers
+// are serialised. The records of the next version are streamed in by add():
+// they are sorted in batches of bounded size, spilled beside the cache, and
+// merged by save().
+class HashCache
+{
+public:
+  HashCache(std::filesystem::path path, DigestAlgorithm algorithm);
+  ~HashCache();
+
+  HashCache(const HashCache&) = delete;
+  HashCache& operator=(const HashCache&) = delete;
+
+  // A missing cache is not an error; an unreadable or foreign one is
+  // ignored with a warning.
+  void load();
+
+  // Returns the digest (digest_size() bytes) stored for `key` when all the
+  // metadata still match.
+  const std::uint8_t* lookup(const CacheKey& key) const;
+
+  // Records `digest` (digest_size() bytes) for `key` in the next version of
+  // the cache. May be called from any thread; false once a batch could not
+  // be spilled (the error is printed once).
+  bool add(const CacheKey& key, const std::uint8_t* digest);
+
+  // Replaces the cache with the records added, and syncs the file and its
+  // directory. With `merge` the records already present on disk for other
+  // inodes are kept (shared cache files). On failure the error is printed.
+  bool save(bool merge);
+
+private:
+  const std::uint8_t* record(std::uint64_t i) const;
+  std::vector<std::uint8_t> take_batch();
+  bool spill();
+  void remove_spilled();
+
+  std::filesystem::path path_;
+  DigestAlgorithm algorithm_;
+  void* map_ = nullptr;
+  std::size_t mapSize_ = 0;
+  std::uint64_t count_ = 0;
+
+  // Records added since the last spill, and the spilled batches.
+  std::mutex mutex_;
+  std::vector<std::pair<CacheKey, CachedDigest>> batch_;
+  std::vector<std::filesystem::path> spilled_;
+  bool failed_ = false;
+};
@@ -11,6 +11,35 @@
 #include <iosfwd>
 #include <optional>
 #include <string_view>
+#include <vector>
+
+#include <vms_common/digest.h>
+
+// How file contents are read (--read-mode).
+enum class ReadMode
+{
+  // read() through the page cache.
+  buffered,
+  // read() with sequential readahead, dropping the pages behind the reads
+  // from the page cache.
+  fadvise,
+  // Mapped in windows with MADV_SEQUENTIAL: no copy into user space.
+  mmap,
+  // O_DIRECT into aligned buffers, bypassing the page cache.
+  direct
+};
+
+// Order in which the files are read (--order); the logs keep the walk
+// order regardless.
+enum class ReadOrder
+{
+  // Largest first, so no huge file is left for the end of the run.
+  size,
+  // By inode number, which roughly follows the disk layout.
+  inode,
+  // By physical offset of the first extent (FIEMAP).
+  extent
+};
 
 struct Options
 {
@@ -18,6 +47,35 @@ struct Options
   std::optional<std::filesystem::path> logPath;
   bool singleDir = false;
   bool sortEntries = false;
+  unsigned sortMemoryMiB = 256;
+  unsigned jobs = 1;
+  unsigned parallelItems = 1;
+  unsigned perDevice = 1;
+  bool showProgress = true;
+  std::optional<std::filesystem::path> verifyManifest;
+  bool failFast = false;
+  bool incremental = false;
+  std::optional<std::filesystem::path> cachePath;
+  // Filled with sha256 when --algo is not given.
+  std::vector<DigestAlgorithm> algorithms;
+  bool combinedLog = false;
+  std::optional<std::filesystem::path> statsPath;
+  // Asynchronous reads through io_uring, falling back to read() when the
+  // kernel does not allow it.
+  bool ioUring = false;
+  ReadMode readMode = ReadMode::buffered;
+  ReadOrder readOrder = ReadOrder::size;
+  // Also hash reflinked copies once, recognised by their shared extents.
+  bool dedupExtents = false;
+  unsigned ioDepth = 32;
+  unsigned ioBufferKiB = 256;
+  // Log the roots of chunk digests instead of plain digests.
+  bool treeHash = false;
+  unsigned treeChunkMiB = 64;
+  // With --tree-hash, also write the chunk digests.
+  bool treeSidecar = false;
+  // Take the files journaled by an interrupted run instead of hashing them.
+  bool resume = false;
 };
 
 class OptionsParser
@@ -5,11 +5,22 @@
  * See the LICENSE file in the project root for full license information.
  */
 
+#pragma once
+
 #include <filesystem>
 
+#include <sha_from_dir/options.h>
+#include <vms_common/run_stats.h>
+
 class DirProcessor
 {
 public:
-  bool process(const std::filesystem::path& scanDir, const std::filesystem::path& logPath,
-               bool sortEntries) const;
-};
\ No newline at end of file
+  // With a report, the statistics of every processed item are added to it.
+  explicit DirProcessor(const Options& options, StatsReport* stats = nullptr);
+
+  bool process(const std::filesystem::path& scanDir, const std::filesystem::path& logPath) const;
+
+private:
+  Options options_;
+  StatsReport* stats_;
+};
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <vms_common/digest.h>
+
+/*
+Tree-hash mode (--tree-hash): a file is cut into chunks of a fixed size,
+the last one shorter, which are digested independently (in parallel), and
+its digest is the root
+
+  H(le64(chunk size) || le64(file size) || H(chunk 0) || H(chunk 1) || ...)
+
+computed separately for every algorithm H. An empty file has no chunk.
+Roots differ from plain digests: the logs carry the label returned by
+tree_label(), e.g. <stem>.sha256-tree64m with the tag SHA256-TREE64M.
+*/
+
+// Number of chunks of a file.
+std::uint64_t tree_chunk_count(std::uint64_t size, std::uint64_t chunkSize);
+
+// "-tree<MiB>m", appended to the algorithm names in log names and tags.
+std::string tree_label(std::uint64_t chunkSize);
+
+// Computes the roots of every algorithm into `out`, laid out as by
+// MultiDigest::final, from the chunk digests, `chunks` of them laid out the
+// same way one after the other. False when a digest failed.
+bool tree_root(const std::vector<DigestAlgorithm>& algorithms, std::uint64_t chunkSize, std::uint64_t size,
+               const std::uint8_t* chunkDigests, std::uint64_t chunks, std::uint8_t* out);
+
+// Sidecar with the chunk digests of every file, for verifying or hashing
+// again only part of a file later. A text file: the header
+//
+//   # tree-hash chunk <bytes> <algo>[,<algo>...]
+//
+// then one "<chunk index> <hex>[ <hex>...]  <name>" line per chunk, one
+// digest per algorithm, the chunks of a file in order. Written to a .part
+// file renamed into place by close().
+class ChunkSidecar
+{
+public:
+  ChunkSidecar(std::vector<DigestAlgorithm> algorithms, std::uint64_t chunkSize);
+
+  // <logPath>/<stem><label>.chunks; on failure the error is printed.
+  bool open(const std::filesystem::path& logPath, const std::string& stem);
+  const std::filesystem::path& path() const { return path_; }
+
+  void add(std::string_view name, const std::uint8_t* chunkDigests, std::uint64_t chunks);
+
+  // False, and nothing renamed, when a write failed.
+  bool close();
+
+private:
+  std::vector<DigestAlgorithm> algorithms_;
+  std::uint64_t chunkSize_;
+  std::filesystem::path path_;
+  std::filesystem::path partPath_;
+  std::ofstream out_;
+  std::string buffer_;
+};
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+// Minimal io_uring built on the raw system calls (no liburing): one
+// submission and one completion ring, for the open/read/close operations
+// of the asynchronous read path. Not thread safe: one ring per worker.
+class IoUring
+{
+public:
+  struct Completion
+  {
+    std::uint64_t user_data;
+    // Result of the operation, -errno on failure.
+    std::int32_t res;
+  };
+
+  IoUring() = default;
+  ~IoUring();
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  // Creates a ring of at least `entries` submissions. False, with errno
+  // set, when the kernel has no io_uring, it is disabled (seccomp,
+  // kernel.io_uring_disabled) or it lacks one of the operations used here.
+  bool init(unsigned entries);
+
+  // Registers the buffers used by read_fixed(); false with errno set (the
+  // locked memory limit may be too low) and plain reads must be used.
+  bool register_buffers(const struct iovec* buffers, unsigned count);
+
+  // Queued until submit(). At most `entries` operations may wait to be
+  // submitted or completed at once.
+  void openat(int dir_fd, const char* path, int flags, std::uint64_t user_data);
+  void read(int fd, void* buffer, std::size_t length, std::uint64_t offset, std::uint64_t user_data);
+  void read_fixed(int fd, void* buffer, std::size_t length, std::uint64_t offset, unsigned buffer_index,
+                  std::uint64_t user_data);
+  void close(int fd, std::uint64_t user_data);
+
+  // Submits the queued operations and waits until at least `wait` have
+  // completed; false with errno set on failure.
+  bool submit(unsigned wait);
+
+  // Takes the next completion, false when none is ready.
+  bool pop(Completion& out);
+
+private:
+  struct io_uring_sqe* next_sqe(std::uint8_t opcode, int fd, std::uint64_t user_data);
+
+  int fd_ = -1;
+  void* sqRing_ = nullptr;
+  std::size_t sqRingSize_ = 0;
+  void* cqRing_ = nullptr;
+  std::size_t cqRingSize_ = 0;
+  struct io_uring_sqe* sqes_ = nullptr;
+  std::size_t sqesSize_ = 0;
+
+  unsigned* sqHead_ = nullptr;
+  unsigned* sqTail_ = nullptr;
+  unsigned sqMask_ = 0;
+  unsigned* cqHead_ = nullptr;
+  unsigned* cqTail_ = nullptr;
+  unsigned cqMask_ = 0;
+  struct io_uring_cqe* cqes_ = nullptr;
+  // Submissions written but not yet published to the kernel end at tail_.
+  unsigned tail_ = 0;
+};
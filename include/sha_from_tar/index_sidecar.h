@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <vms_common/digest.h>
+
+/*
+Binary index of an archive, <stem>.tarindex beside its logs (--index):
+where every regular file entry sits in the tar stream, with its digests,
+so that a later check, extraction or diff of a few entries can seek
+straight to them instead of reading the whole archive.
+
+Integers are little-endian.
+- Header: "VMSTIDX1", u64 archive size, i64 archive mtime (ns since the
+  epoch), u32 algorithm count, then for each algorithm a u32 name length
+  and its name ("sha256"...).
+- Records, in archive order: u64 header offset (first header of the
+  entry, pax/GNU extension headers included), u64 data offset, u64 size,
+  u32 name length, name, then the digests of the algorithms one after the
+  other.
+- Lookup table: a u64 64-bit FNV-1a of the name and the u64 offset of the
+  record for every entry, sorted, for a binary search by name.
+- Footer (28 bytes): u64 table offset, u64 entry count, u32 flags, then
+  "VMSTIDX1" again. Flag 1: the archive is compressed, offsets are in the
+  decompressed tar stream.
+*/
+class TarIndexSidecar
+{
+public:
+  static constexpr std::uint32_t compressed_flag = 1;
+
+  explicit TarIndexSidecar(std::vector<DigestAlgorithm> algorithms);
+  // Drops the .part file unless close() succeeded.
+  ~TarIndexSidecar();
+
+  TarIndexSidecar(const TarIndexSidecar&) = delete;
+  TarIndexSidecar& operator=(const TarIndexSidecar&) = delete;
+
+  // <logPath>/<stem>.tarindex, written to a .part file until close(); on
+  // failure the error is printed.
+  bool open(const std::filesystem::path& logPath, const std::string& stem, std::uint64_t archiveSize,
+            std::int64_t archiveMtimeNs);
+  const std::filesystem::path& path() const { return path_; }
+
+  void set_compressed(bool compressed) { flags_ = compressed ? compressed_flag : 0; }
+
+  // Entry `index` (0, 1, 2... each exactly once, as DigestLogWriter::add);
+  // records are written in index order. May be called from any thread;
+  // false once writing failed (the error is printed once).
+  bool add(std::size_t index, std::string_view name, std::uint64_t headerOffset, std::uint64_t dataOffset,
+           std::uint64_t size, const std::uint8_t* digests);
+
+  // Appends the lookup table and the footer, then renames the index into
+  // place; false, and nothing renamed, when a write failed.
+  bool close();
+
+private:
+  void write_record(const std::string& record);
+  bool flush(bool force);
+
+  std::vector<DigestAlgorithm> algorithms_;
+  std::size_t digestBytes_;
+  std::filesystem::path path_;
+  std::filesystem::path partPath_;
+  std::ofstream out_;
+  std::string buffer_;
+  std::uint64_t written_ = 0;
+  std::uint32_t flags_ = 0;
+
+  std::mutex mutex_;
+  bool failed_ = false;
+  bool closed_ = false;
+  // Records waiting for a lower index.
+  std::size_t nextIndex_ = 0;
+  std::map<std::size_t, std::string> waiting_;
+  // Name hash and record offset of every record written.
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> table_;
+};
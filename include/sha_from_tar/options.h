@@ -11,6 +11,9 @@
 #include <iosfwd>
 #include <optional>
 #include <string_view>
+#include <vector>
+
+#include <vms_common/digest.h>
 
 struct Options
 {
@@ -18,6 +21,24 @@ struct Options
   std::optional<std::filesystem::path> archiveFile;
   std::optional<std::filesystem::path> logPath;
   bool sortEntries = false;
+  unsigned sortMemoryMiB = 256;
+  unsigned jobs = 1;
+  // Threads decompressing .tar.gz/.tar.zst/.tar.xz archives, 0 for as many
+  // as `jobs`; 1 leaves it to libarchive.
+  unsigned decompressThreads = 0;
+  unsigned parallelItems = 1;
+  unsigned perDevice = 1;
+  bool showProgress = true;
+  std::optional<std::filesystem::path> verifyManifest;
+  bool failFast = false;
+  // Filled with sha256 when --algo is not given.
+  std::vector<DigestAlgorithm> algorithms;
+  bool combinedLog = false;
+  std::optional<std::filesystem::path> statsPath;
+  // Skip the entries journaled by an interrupted run.
+  bool resume = false;
+  // Also write <name>.tarindex beside the logs.
+  bool writeIndex = false;
 };
 
 class OptionsParser
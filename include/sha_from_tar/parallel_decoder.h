@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <vms_common/mapped_range.h>
+
+/*
+Decompresses a .tar.gz, .tar.zst or .tar.xz on several threads and hands
+the tar stream out in order, as libarchive's read callback would.
+
+The mapped archive is cut into units decoded independently:
+- gzip: runs of whole members (concatenated gzip files, BGZF). Member
+  boundaries are not recorded anywhere, so units start at the next likely
+  gzip header past a few MiB and end where their last member does. A unit
+  that started on a false header, inside a member, is dropped once the
+  unit before it ends elsewhere, and the range is decoded again from
+  there. An ordinary single-member gzip is decoded by one thread, but
+  away from the thread parsing the tar.
+- zstd: runs of whole frames, found from the frame headers.
+- xz: a single unit, liblzma decoding its blocks on several threads.
+
+Units are decoded ahead of the reader, a bounded amount each.
+*/
+class ParallelDecoder
+{
+public:
+  // nullptr when `path` is not in a format decoded here, or the library is
+  // not built in: libarchive reads it instead.
+  static std::unique_ptr<ParallelDecoder> open(const std::filesystem::path& path, unsigned threads);
+
+  ~ParallelDecoder();
+
+  ParallelDecoder(const ParallelDecoder&) = delete;
+  ParallelDecoder& operator=(const ParallelDecoder&) = delete;
+
+  // Next block of the tar stream, valid until the next call; 0 at the end,
+  // -1 on error (printed), the archive having been truncated included.
+  ssize_t read(const void** data);
+
+  // Compressed bytes behind the data read so far.
+  std::uint64_t compressed_done() const { return done_.load(std::memory_order_relaxed); }
+
+  enum class Format
+  {
+    gzip,
+    zstd,
+    xz
+  };
+
+private:
+  using Block = std::vector<std::uint8_t>;
+
+  struct Output
+  {
+    Block block;
+    // Compressed offset reached when the block was handed over.
+    std::uint64_t position;
+  };
+
+  struct Unit
+  {
+    Unit(std::uint64_t unitStart, std::uint64_t unitEnd) : start(unitStart), end(unitEnd) {}
+
+    std::uint64_t start;
+    // Where the next unit is expected to start.
+    std::uint64_t end;
+    // Where decoding actually stopped, once finished.
+    std::uint64_t stopped = 0;
+    bool started = false;
+    bool finished = false;
+    bool failed = false;
+    // Stopped by the reader: dropped, or decoded again when `restart`.
+    std::atomic<bool> cancelled{false};
+    bool restart = false;
+    std::string error;
+    std::deque<Output> output;
+    std::size_t buffered = 0;
+  };
+
+  ParallelDecoder(Format format, const std::uint8_t* data, std::uint64_t size, unsigned threads, std::string name,
+                  std::unique_ptr<MappedRangeGuard> guard);
+
+  // Where a unit starting at `start` is planned to end.
+  std::uint64_t plan(std::uint64_t start) const;
+  // The following members take mutex_ held.
+  void fill_window();
+  void preempt();
+  void drop_front();
+  void recycle(Unit& unit);
+  Block take_block();
+
+  void worker();
+  bool decode(Unit& unit);
+  bool decode_gzip(Unit& unit);
+  bool decode_zstd(Unit& unit);
+  bool decode_xz(Unit& unit);
+
+  // Hands a block over and replaces it with an empty one, waiting while
+  // the unit holds too much; false once the unit is cancelled.
+  bool emit(Unit& unit, Block& block, std::size_t filled, std::uint64_t position);
+  Block first_block();
+
+  Format format_;
+  const std::uint8_t* data_;
+  std::uint64_t size_;
+  unsigned threads_;
+  std::string name_;
+  // Covers the mapping: an archive truncated while it is decoded fails
+  // read() instead of ending the process.
+  std::unique_ptr<MappedRangeGuard> guard_;
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  // In stream order; the front one is being read.
+  std::list<Unit> units_;
+  // Cancelled while running, until their worker notices.
+  std::list<Unit> dropped_;
+  std::uint64_t planned_ = 0;
+  unsigned running_ = 0;
+  bool stopping_ = false;
+  std::vector<Block> spare_;
+  Block current_;
+  std::atomic<std::uint64_t> done_{0};
+  std::vector<std::thread> workers_;
+};
@@ -8,10 +8,28 @@
 #pragma once
 
 #include <filesystem>
+#include <string>
+
+#include <sha_from_tar/options.h>
+#include <vms_common/run_stats.h>
+
+// Archives picked up by -C: .tar, and .tar.gz/.tgz, .tar.zst/.tzst,
+// .tar.xz/.txz and .tar.bz2/.tbz2.
+bool is_tar_archive(const std::filesystem::path& path);
+
+// Name of the logs of an archive: the file name without its archive
+// extension ("backup" for backup.tar.zst), the usual stem otherwise.
+std::string archive_stem(const std::filesystem::path& path);
 
 class TarProcessor
 {
 public:
-  bool process(const std::filesystem::path& tarPath, const std::filesystem::path& logPath,
-               bool sortEntries) const;
+  // With a report, the statistics of every processed item are added to it.
+  explicit TarProcessor(const Options& options, StatsReport* stats = nullptr);
+
+  bool process(const std::filesystem::path& tarPath, const std::filesystem::path& logPath) const;
+
+private:
+  Options options_;
+  StatsReport* stats_;
 };
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct TarMember
+{
+  std::string name;
+  std::uint64_t headerOffset = 0;  // first header of the entry, pax/GNU extension headers included
+  std::uint64_t dataOffset = 0;
+  std::uint64_t size = 0;
+};
+
+// Lists the regular files of an uncompressed ustar, pax or GNU tar archive
+// held in memory, in archive order. Entries are reported the way libarchive
+// reports them (hard links and directories are skipped). Returns false when
+// the data is not a plain tar archive or uses features this parser does not
+// handle (sparse files, multi-volume archives, vendor extensions...): the
+// caller is expected to fall back to libarchive.
+bool index_tar(const std::uint8_t* data, std::uint64_t size, std::vector<TarMember>& members);
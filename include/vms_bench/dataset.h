@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <vms_bench/options.h>
+
+struct DatasetFile
+{
+  // Relative to Dataset::root, '/' separated; also the name in the archives.
+  std::string name;
+  std::uint64_t size = 0;
+};
+
+struct Dataset
+{
+  // Parent of the generated tree, which is root / "tree".
+  std::filesystem::path root;
+  std::vector<DatasetFile> files;
+  std::uint64_t bytes = 0;
+};
+
+// Creates options.files files under root / "tree", 100 per subdirectory,
+// with sizes drawn from options.distribution and pseudo-random contents.
+// Everything derives from options.seed, so a seed always yields the same
+// bytes on every platform.
+bool generate_dataset(const Options& options, const std::filesystem::path& root, Dataset& out);
+
+// Writes the dataset files into a pax tar archive, gzip compressed if
+// requested, with fixed metadata so that equal datasets give equal archives.
+bool write_archive(const Dataset& dataset, const std::filesystem::path& archive, bool gzip);
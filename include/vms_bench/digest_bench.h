@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <vms_bench/options.h>
+
+struct BenchResult
+{
+  std::string name;
+  std::uint64_t bytes = 0;
+  std::uint64_t messages = 0;
+  // Fastest of the rounds.
+  double seconds = 0.0;
+};
+
+// Hashes an in-memory buffer (one message, fed in the same chunks as the
+// tools) and then many small messages with every selected algorithm. The
+// data is random and generated up front, so only the digests are timed.
+bool run_digest_bench(const Options& options, std::vector<BenchResult>& results);
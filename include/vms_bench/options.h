@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include <vms_common/digest.h>
+
+// One bucket of a file-size distribution: sizes are uniform in
+// (previous bucket's maxSize, maxSize] and picked with the given weight.
+struct SizeBucket
+{
+  std::uint64_t maxSize = 0;
+  unsigned weight = 0;
+};
+
+struct Options
+{
+  unsigned bufferMiB = 256;
+  unsigned rounds = 3;
+  unsigned smallMessages = 100000;
+  // Empty: every algorithm available in this build.
+  std::vector<DigestAlgorithm> algorithms;
+
+  // Suites to run.
+  bool benchDigests = true;
+  bool benchDir = true;
+  bool benchTar = true;
+  bool benchTarGz = true;
+
+  // Synthetic dataset.
+  unsigned files = 2000;
+  unsigned seed = 1;
+  std::string distName = "mixed";
+  std::vector<SizeBucket> distribution;
+  std::filesystem::path workDir;
+  bool keep = false;
+
+  // Passed through to sha_from_dir / sha_from_tar.
+  unsigned jobs = 1;
+  // One dir run per sha_from_dir --read-mode; empty: a single default run.
+  std::vector<std::string> readModes;
+  // Evict the inputs from the page cache before each tool run.
+  bool cold = false;
+  std::filesystem::path toolsDir;
+
+  // Empty: the report goes to stdout.
+  std::filesystem::path jsonPath;
+};
+
+class OptionsParser
+{
+public:
+  bool parse(int argc, char* argv[], Options& out) const;
+  void print_usage(std::ostream& os) const;
+};
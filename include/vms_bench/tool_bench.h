@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct ToolRun
+{
+  // "dir", "tar" or "targz"; "dir:<mode>" for each --read-modes entry.
+  std::string suite;
+  std::vector<std::string> command;
+  std::filesystem::path logDir;
+  // Files the tool reads, for the page cache figures.
+  std::vector<std::filesystem::path> inputs;
+  int exitStatus = -1;
+  double seconds = 0.0;
+  double userSeconds = 0.0;
+  double systemSeconds = 0.0;
+  // Peak resident set size of the tool process.
+  std::uint64_t peakRssKiB = 0;
+  // Share of the inputs left in the page cache by the run, in percent.
+  double cachedPercent = 0.0;
+};
+
+// Runs command[0] with the other elements as arguments, its output
+// discarded, and fills the timings of `run` from the wall clock and the
+// resource usage of the child. Returns false if no process could be
+// created; a failing tool, or one that cannot be executed (127), is
+// reported through run.exitStatus.
+bool run_tool(ToolRun& run);
+
+// Writes back and evicts the files from the page cache; pages mapped or
+// dirtied by other processes may stay.
+void drop_cached(const std::vector<std::filesystem::path>& files);
+
+// Bytes of the files resident in the page cache, and their total size.
+void cached_bytes(const std::vector<std::filesystem::path>& files, std::uint64_t& cached, std::uint64_t& total);
+
+// Reads a digest log and returns its lines sorted, so the logs of the same
+// files reached through different tools can be compared.
+bool read_sorted_log(const std::filesystem::path& log, std::vector<std::string>& lines);
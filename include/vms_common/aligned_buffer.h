@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+// Page-aligned buffer that is not value-initialised: unlike a vector, no
+// page is touched before the first read() into it. Meant to be allocated
+// once per worker and reused for every file.
+class AlignedBuffer
+{
+public:
+  static constexpr std::size_t alignment = 4096;
+
+  explicit AlignedBuffer(std::size_t size)
+      : size_((size + alignment - 1) / alignment * alignment),
+        data_(static_cast<std::uint8_t*>(std::aligned_alloc(alignment, size_)))
+  {
+    if (!data_)
+    {
+      throw std::bad_alloc();
+    }
+  }
+
+  std::uint8_t* data() { return data_.get(); }
+  const std::uint8_t* data() const { return data_.get(); }
+  // The requested size rounded up to the alignment.
+  std::size_t size() const { return size_; }
+
+private:
+  struct Free
+  {
+    void operator()(std::uint8_t* p) const { std::free(p); }
+  };
+
+  std::size_t size_;
+  std::unique_ptr<std::uint8_t, Free> data_;
+};
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Fixed set of reusable buffers moving between one producer and a number of
+// consumers. The producer acquires a free buffer, fills it and publishes it to
+// a consumer; the consumer pops it, uses it and releases it back to the free
+// list. The number of buffers bounds the memory in flight: when every buffer
+// is queued the producer waits for a consumer to catch up.
+class BufferRing
+{
+public:
+  static constexpr std::size_t no_buffer = static_cast<std::size_t>(-1);
+
+  struct Block
+  {
+    std::size_t tag = 0;             // producer defined, e.g. the entry index
+    std::size_t buffer = no_buffer;  // no_buffer for data-less markers
+    std::size_t length = 0;
+    bool last = false;               // last block of `tag`
+  };
+
+  BufferRing(std::size_t buffers, std::size_t bufferSize, std::size_t consumers);
+
+  std::size_t buffer_size() const { return bufferSize_; }
+  std::uint8_t* data(std::size_t buffer) { return storage_[buffer].get(); }
+
+  // Producer side. acquire() returns no_buffer once the ring was aborted.
+  std::size_t acquire();
+  void publish(std::size_t consumer, const Block& block);
+  void close();
+
+  // Consumer side. pop() returns false when the ring is closed and drained,
+  // or aborted.
+  bool pop(std::size_t consumer, Block& out);
+  void release(std::size_t buffer);
+
+  // Either side: stop everything, pending blocks are dropped.
+  void abort();
+  bool aborted() const;
+
+private:
+  std::size_t bufferSize_;
+  std::vector<std::unique_ptr<std::uint8_t[]>> storage_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable freeCv_;
+  std::condition_variable readyCv_;
+  std::vector<std::size_t> free_;
+  std::vector<std::deque<Block>> queues_;
+  bool closed_ = false;
+  bool aborted_ = false;
+};
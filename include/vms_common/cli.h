@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <string_view>
+
+// Parses the numeric value of a command line flag. On failure an error
+// mentioning the flag is printed on std::cerr and false is returned.
+bool parse_unsigned(std::string_view flag, std::string_view value, unsigned& out);
+
+// Same as parse_unsigned, but 0 is replaced by the number of available CPUs.
+bool parse_thread_count(std::string_view flag, std::string_view value, unsigned& out);
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Digest algorithms selectable with --algo. md5, sha1, sha256 and sha512
+// come from OpenSSL and are always available; blake3 and xxh3-128 need the
+// system libraries to be found at configure time.
+enum class DigestAlgorithm
+{
+  md5,
+  sha1,
+  sha256,
+  sha512,
+  blake3,
+  xxh3_128,
+};
+
+constexpr std::size_t max_digest_size = 64;
+using DigestBytes = std::array<std::uint8_t, max_digest_size>;
+
+// Accepts the names printed by digest_name() ("xxh128" too). On failure an
+// error mentioning the flag is printed on std::cerr and false is returned;
+// an algorithm missing from this build is reported the same way.
+bool parse_digest_algorithm(std::string_view flag, std::string_view value, DigestAlgorithm& out);
+
+// Comma separated list of algorithms ("md5,sha1,sha256"), appended to `out`;
+// an algorithm already in `out` is an error.
+bool parse_digest_algorithms(std::string_view flag, std::string_view value, std::vector<DigestAlgorithm>& out);
+
+// Name of the algorithm, also used as the log extension (".sha256", ...).
+const char* digest_name(DigestAlgorithm algorithm);
+
+// Digest length in bytes, at most max_digest_size.
+std::size_t digest_size(DigestAlgorithm algorithm);
+
+// Length of the digests of `algorithms` stored one after the other, the
+// layout used for the results of several algorithms.
+std::size_t digest_size(const std::vector<DigestAlgorithm>& algorithms);
+
+bool digest_available(DigestAlgorithm algorithm);
+
+// Comma separated list of the algorithms available in this build.
+std::string available_digests();
+
+// Lowercase hex, as written in the logs.
+std::string digest_to_hex(const std::uint8_t* digest, std::size_t size);
+
+// Writes the 2 * size lowercase hex digits of `digest` to `out`, one table
+// lookup per byte; the digests are only converted when a log is written.
+void hex_encode(const std::uint8_t* digest, std::size_t size, char* out);
+
+// Appends the lowercase hex digits of `digest` to `out`.
+void append_hex(std::string& out, const std::uint8_t* digest, std::size_t size);
+
+// Inverse of digest_to_hex; false unless `hex` is exactly 2 * size lowercase
+// hex digits.
+bool hex_to_digest(std::string_view hex, std::uint8_t* digest, std::size_t size);
+
+// Streaming digest context. One context hashes one message at a time and
+// can be reused: init() restarts it without reallocating anything.
+class DigestContext
+{
+public:
+  virtual ~DigestContext() = default;
+
+  virtual DigestAlgorithm algorithm() const = 0;
+  virtual bool init() = 0;
+  virtual bool update(const void* data, std::size_t size) = 0;
+  // Writes digest_size(algorithm()) bytes to `out`.
+  virtual bool final(std::uint8_t* out) = 0;
+
+  // nullptr when the algorithm is not available or the allocation failed.
+  static std::unique_ptr<DigestContext> create(DigestAlgorithm algorithm);
+};
+
+// Feeds the same data to one context per algorithm, so that several
+// digests come out of a single read of the data. With `parallel`, large
+// updates are spread over one helper thread per extra algorithm, started
+// with the MultiDigest and signalled for each block; it only pays off when
+// the caller does not already keep every CPU busy.
+class MultiDigest
+{
+public:
+  MultiDigest(std::vector<DigestAlgorithm> algorithms, bool parallel);
+  MultiDigest(MultiDigest&&) noexcept;
+  MultiDigest& operator=(MultiDigest&&) noexcept;
+  ~MultiDigest();
+
+  // False when a context could not be allocated.
+  bool valid() const;
+  const std::vector<DigestAlgorithm>& algorithms() const { return algorithms_; }
+
+  bool init();
+  bool update(const void* data, std::size_t size);
+  // Writes the digests one after the other, in the order given:
+  // digest_size(algorithms()) bytes.
+  bool final(std::uint8_t* out);
+
+private:
+  class Helpers;
+
+  std::vector<DigestAlgorithm> algorithms_;
+  std::vector<std::unique_ptr<DigestContext>> contexts_;
+  // Started with the first large update.
+  std::unique_ptr<Helpers> helpers_;
+  bool parallel_;
+};
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <vms_common/digest.h>
+#include <vms_common/entry_arena.h>
+
+// Writes the digests of one directory/archive: either one "<hex>  <name>"
+// log per algorithm (<stem>.<algo>), or with `combined` a single
+// <stem>.digests log in the BSD tag format of "sha256sum --tag", one
+// "<ALGO> (<name>) = <hex>" line per entry and algorithm. A `label`
+// (e.g. "-tree64m") is appended to the algorithm names, in the log names and
+// the tags, when the digests are not plain ones: <stem>.<algo><label>, or
+// <stem><label>.digests with "<ALGO><LABEL>" tags.
+//
+// Entries are streamed to <log>.part files through large buffers while
+// the hashing is still running, and renamed into place by close(). They
+// are written in index order, the entries that arrive early waiting for
+// the missing ones; with `sorted` they are sorted by name instead: sorted
+// runs of at most `sortMemory` bytes are spilled beside the logs and
+// merged at the end. `sortMemory` also bounds the entries waiting for a
+// lower index: past it they are spilled as runs sorted by index, as are
+// all the later ones, and the rest of the log is merged at the end.
+// Entries may also be given an order key instead of an index, for callers
+// that only learn the final order of the entries from their keys: they go
+// through the runs as well. Digests are kept in binary until the line
+// holding them is written.
+class DigestLogWriter
+{
+public:
+  static constexpr std::size_t default_sort_memory = std::size_t{256} * 1024 * 1024;
+
+  DigestLogWriter(std::vector<DigestAlgorithm> algorithms, bool combined, bool sorted = false,
+                  std::size_t sortMemory = default_sort_memory, std::string label = {});
+  ~DigestLogWriter();
+
+  DigestLogWriter(const DigestLogWriter&) = delete;
+  DigestLogWriter& operator=(const DigestLogWriter&) = delete;
+
+  // Log file names for `stem`, also the manifest names looked up by
+  // --verify in a directory.
+  static std::vector<std::filesystem::path> file_names(const std::vector<DigestAlgorithm>& algorithms,
+                                                       bool combined, const std::string& stem,
+                                                       const std::string& label = {});
+
+  // Creates the .part files; on failure the error is printed.
+  bool open(const std::filesystem::path& logPath, const std::string& stem);
+  const std::vector<std::filesystem::path>& paths() const { return paths_; }
+
+  // Entry `index` (0, 1, 2... each exactly once) with the digests of the
+  // algorithms, in the constructor order, one after the other (see
+  // MultiDigest::final). Both are copied. May be called from any thread;
+  // false once writing failed (the error is printed once).
+  bool add(std::size_t index, std::string_view name, const std::uint8_t* digests);
+  // Entry placed by `order`, a key unique to it that compares as bytes,
+  // instead of an index; not to be mixed with the index form.
+  bool add(std::string_view order, std::string_view name, const std::uint8_t* digests);
+
+  // Writes what is left, then renames the logs into place; false when a
+  // write failed, in which case nothing is renamed.
+  bool close();
+
+  // Drops the .part files and the spilled runs.
+  void abandon();
+
+private:
+  void emit(std::string_view name, const std::uint8_t* digests);
+  bool flush_log(std::size_t log, bool force);
+  bool add_run(std::string_view order, std::string_view name, const std::uint8_t* digests);
+  void append_run(std::string_view order, std::string_view name, const std::uint8_t* digests);
+  void sort_run();
+  bool spill();
+  bool spill_waiting();
+  bool merge();
+  bool fail(const std::string& what);
+
+  std::vector<DigestAlgorithm> algorithms_;
+  std::vector<std::string> tags_;
+  std::string label_;
+  std::size_t digestBytes_;
+  bool combined_;
+  bool sorted_;
+  std::size_t sortMemory_;
+
+  std::vector<std::filesystem::path> paths_;
+  std::vector<std::ofstream> logs_;
+  std::vector<std::string> buffers_;
+
+  std::mutex mutex_;
+  bool failed_ = false;
+  bool open_ = false;
+
+  // Unsorted: entries waiting for a lower index, index -> arena entry. The
+  // arena is emptied whenever nothing waits anymore.
+  std::size_t nextIndex_ = 0;
+  std::map<std::size_t, std::size_t> waiting_;
+  EntryArena waitingEntries_;
+  std::size_t waitingBytes_ = 0;
+  // Entries go through the runs: sorted, given order keys, or once the
+  // waiting entries outgrew sortMemory.
+  bool throughRuns_;
+
+  // Serialized records of the current run and their offsets.
+  std::string run_;
+  std::vector<std::size_t> offsets_;
+  std::vector<std::filesystem::path> spilled_;
+};
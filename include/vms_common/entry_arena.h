@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Append-only store of entries made of a name and a fixed number of raw
+// digest bytes. The bytes are packed into large blocks that never move, so
+// the views returned stay valid until clear(); an entry costs its bytes
+// plus a 16-byte slot instead of a string and a vector of strings.
+//
+// Not synchronised: concurrent readers must not race with add(), although
+// the views they already hold are not affected by it.
+class EntryArena
+{
+public:
+  explicit EntryArena(std::size_t digestBytes = 0);
+
+  EntryArena(const EntryArena&) = delete;
+  EntryArena& operator=(const EntryArena&) = delete;
+
+  // Copies `name` and, unless nullptr, digest_bytes() bytes from `digests`
+  // (left zeroed otherwise). Returns the index of the entry.
+  std::size_t add(std::string_view name, const std::uint8_t* digests = nullptr);
+
+  std::string_view name(std::size_t i) const
+  {
+    return {slots_[i].data + digestBytes_, slots_[i].nameLength};
+  }
+  const std::uint8_t* digests(std::size_t i) const
+  {
+    return reinterpret_cast<const std::uint8_t*>(slots_[i].data);
+  }
+  std::uint8_t* digests(std::size_t i) { return reinterpret_cast<std::uint8_t*>(slots_[i].data); }
+
+  std::size_t size() const { return slots_.size(); }
+  bool empty() const { return slots_.empty(); }
+  std::size_t digest_bytes() const { return digestBytes_; }
+
+  // Drops every entry; the first block is kept for reuse.
+  void clear();
+
+private:
+  struct Slot
+  {
+    char* data;
+    std::size_t nameLength;
+  };
+
+  char* allocate(std::size_t size);
+
+  std::size_t digestBytes_;
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  std::size_t blockSize_ = 0;  // of blocks_.back()
+  std::size_t used_ = 0;       // in blocks_.back()
+  std::size_t firstBlockSize_ = 0;
+  std::vector<Slot> slots_;
+};
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+// Append-only journal of the entries a run has completed, kept beside the
+// logs while they are written so that an interrupted run can be resumed
+// (--resume) without hashing those entries again.
+//
+// Records are buffered and appended in batches about once a second, and
+// the file is flushed to disk with fdatasync() every few seconds: a crash
+// loses at most the last few seconds of work. Every record carries a
+// checksum; a torn record at the end of the file, and anything after it,
+// is dropped when the journal is loaded.
+//
+// Layout: "VMSJRNL1", u32 identity length, identity, then the records:
+// u32 name length, u32 key length, name, key, digest bytes and a 64-bit
+// FNV-1a of all that, integers little-endian. The identity (algorithms,
+// archive...) must match for the records to be reused; the key is whatever
+// tells that an entry is unchanged (inode and times, archive position...).
+class Journal
+{
+public:
+  struct Record
+  {
+    std::string_view name;
+    std::string_view key;
+    // digest_bytes() bytes.
+    const std::uint8_t* digests;
+  };
+
+  Journal(std::filesystem::path path, std::string identity, std::size_t digestBytes);
+  // Writes what is buffered, unless remove() was called.
+  ~Journal();
+
+  Journal(const Journal&) = delete;
+  Journal& operator=(const Journal&) = delete;
+
+  const std::filesystem::path& path() const { return path_; }
+  std::size_t digest_bytes() const { return digestBytes_; }
+
+  // Reads the records left by an interrupted run, oldest first; the views
+  // stay valid as long as the journal. No journal is not an error, one of
+  // another identity is ignored with a warning. Returns the record count.
+  std::size_t load(const std::function<void(const Record&)>& visit);
+
+  // Opens the journal for appending, past the records kept by load(), or
+  // empty. On failure the error is printed.
+  bool open();
+
+  // May be called from any thread; false once writing failed (the error is
+  // printed once).
+  bool add(std::string_view name, std::string_view key, const std::uint8_t* digests);
+
+  // The run is complete: the journal is no longer needed.
+  void remove();
+
+private:
+  bool write_batch(std::string& batch, bool sync);
+
+  std::filesystem::path path_;
+  std::string identity_;
+  std::size_t digestBytes_;
+  std::string loaded_;
+  // End of the last valid record of `loaded_`, 0 to start over.
+  std::size_t keep_ = 0;
+
+  int fd_ = -1;
+  std::mutex mutex_;
+  std::string buffer_;
+  std::chrono::steady_clock::time_point lastWrite_;
+  std::chrono::steady_clock::time_point lastSync_;
+  // Serialises the writes, taken before mutex_ is released so that the
+  // batches stay in order.
+  std::mutex writeMutex_;
+  std::atomic<bool> failed_{false};
+};
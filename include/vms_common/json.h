@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string_view>
+#include <vector>
+
+// Minimal streaming JSON writer for the machine-readable reports: values
+// are written as they come, commas and indentation are handled here. Keys
+// must precede every value inside an object; nothing else is checked.
+class JsonWriter
+{
+public:
+  explicit JsonWriter(std::ostream& os);
+
+  JsonWriter& begin_object();
+  JsonWriter& end_object();
+  JsonWriter& begin_array();
+  JsonWriter& end_array();
+
+  JsonWriter& key(std::string_view name);
+
+  JsonWriter& value(std::string_view text);
+  JsonWriter& value(const char* text) { return value(std::string_view{text}); }
+  JsonWriter& value(bool flag);
+  JsonWriter& value(double number);
+  JsonWriter& value(std::uint64_t number);
+  JsonWriter& value(std::int64_t number);
+  JsonWriter& value(unsigned number) { return value(std::uint64_t{number}); }
+  JsonWriter& value(int number) { return value(std::int64_t{number}); }
+
+  // Shorthand for key(name).value(v).
+  template <typename T>
+  JsonWriter& field(std::string_view name, const T& v)
+  {
+    key(name);
+    return value(v);
+  }
+
+private:
+  void separate();
+  void newline();
+  void write_string(std::string_view text);
+
+  std::ostream& os_;
+  // One entry per open object/array: true once it holds an element.
+  std::vector<bool> nonEmpty_;
+  bool afterKey_ = false;
+};
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <vms_common/digest.h>
+#include <vms_common/entry_arena.h>
+
+// Checks freshly computed digests against "<hex>  <name>" manifests, the
+// format written by the tools (and by sha256sum, "<hex> *<name>" is
+// accepted too). Several manifests of the same entries, one per digest
+// algorithm, are checked together: each entry then carries one digest per
+// manifest, in the same order. The digests are decoded once at load time
+// and compared in binary. Once loaded, the index is read-only and
+// every method can be called concurrently from the hashing threads;
+// problems are printed on std::cout as soon as they are found.
+class ManifestVerifier
+{
+public:
+  ManifestVerifier(std::vector<DigestAlgorithm> algorithms, bool stopAtFirstFailure);
+
+  // One manifest per algorithm, in the constructor order; every manifest
+  // must list the same entries.
+  bool load(const std::vector<std::filesystem::path>& manifests);
+
+  // `name` exists in the tree/archive; its digest will be checked later.
+  // Returns false (and reports it) when the manifest does not list it.
+  bool expect(std::string_view name);
+
+  // Returns false when `name` is not listed or one of its digests differs;
+  // `digests` are laid out as by MultiDigest::final. Entries must have been
+  // passed to expect() first, which reports the extra ones.
+  bool check(std::string_view name, const std::uint8_t* digests);
+
+  // Reports the listed entries that were never expected nor checked. Only
+  // meaningful once every entry of the tree/archive has been seen.
+  bool report_missing();
+
+  // Prints the summary; true when everything matched.
+  bool finish();
+
+  // True when the caller should stop at the first failure and one occurred.
+  bool should_stop() const;
+
+private:
+  bool read(const std::filesystem::path& manifest, std::size_t column);
+
+  std::size_t find(std::string_view name) const;
+  void report(std::string_view name, std::string_view what);
+
+  std::vector<DigestAlgorithm> algorithms_;
+  bool stopAtFirstFailure_;
+  std::vector<std::filesystem::path> manifests_;
+  // Listed names with their digests, in the order of the first manifest.
+  EntryArena listed_;
+  // Manifests that listed each entry so far, while loading.
+  std::vector<std::size_t> columns_;
+  std::unordered_map<std::string_view, std::size_t> index_;
+  std::unique_ptr<std::atomic<bool>[]> seen_;
+
+  std::atomic<std::size_t> matched_{0};
+  std::atomic<std::size_t> mismatched_{0};
+  std::atomic<std::size_t> extra_{0};
+  std::atomic<std::size_t> missing_{0};
+  std::mutex outputMutex_;
+};
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+// Reading a mapping past the end of a file truncated in the meantime raises
+// SIGBUS, on whichever thread touches the pages, and would end the whole
+// run. While a guard is alive its range is registered with a SIGBUS handler
+// that maps zero pages over the rest of the range instead and flags it, so
+// the reader can fail just that file. Faults outside every registered range
+// still end the process.
+class MappedRangeGuard
+{
+public:
+  MappedRangeGuard(const void* data, std::size_t length);
+  ~MappedRangeGuard();
+  MappedRangeGuard(const MappedRangeGuard&) = delete;
+  MappedRangeGuard& operator=(const MappedRangeGuard&) = delete;
+
+  // False when the table of ranges is full: the range must not be read.
+  bool registered() const { return slot_ != nullptr; }
+  // The file was truncated while the range was read: part of what was read
+  // is zeros.
+  bool truncated() const;
+
+  struct Slot;
+
+private:
+  Slot* slot_ = nullptr;
+};
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <thread>
+
+// Redraws a progress display from its own thread at a fixed rate, so the
+// hashing threads only bump counters that `draw` reads. `draw` writes the
+// whole frame into a buffer that reaches std::cerr in one go. Disabled
+// (draw never called) when not requested or when stderr is not a terminal.
+class ProgressRenderer
+{
+public:
+  using Draw = std::function<void(std::ostream&)>;
+
+  ProgressRenderer(bool requested, Draw draw,
+                   std::chrono::milliseconds period = std::chrono::milliseconds{100});
+  ~ProgressRenderer();
+
+  ProgressRenderer(const ProgressRenderer&) = delete;
+  ProgressRenderer& operator=(const ProgressRenderer&) = delete;
+
+  bool enabled() const { return enabled_; }
+
+  void start();
+  // Stops the thread and draws the final frame; safe to call twice.
+  void stop();
+
+private:
+  void render();
+
+  bool enabled_;
+  Draw draw_;
+  std::chrono::milliseconds period_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_ = false;
+  std::thread thread_;
+};
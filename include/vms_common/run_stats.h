@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class JsonWriter;
+
+enum class StatPhase
+{
+  scan,        // directory walk or archive index
+  load,        // manifests and caches
+  open,        // opening files, summed over the threads
+  read,        // reading file data, summed over the threads
+  decompress,  // reading entries through libarchive, decompression included
+  digest,      // digest updates and finals, summed over the threads
+  hash,        // wall time of the hashing stage
+  sort,
+  write,       // logs and caches
+};
+
+enum class StatCounter
+{
+  cache_hits,
+  multi_buffer_files,
+  // Files sharing the contents of another one (hard links, reflinks) and
+  // given its digests without being read, and their bytes.
+  shared_files,
+  shared_bytes,
+  // Zeros of sparse file holes digested without being read.
+  hole_bytes,
+  // Entries taken from the journal of an interrupted run (--resume).
+  resumed_entries,
+};
+
+// Timers, counters, a histogram of read sizes and the slowest files of one
+// directory or archive. Every method can be called concurrently; the tools
+// pass a null RunStats* when --stats is off, so none of this runs then.
+class RunStats
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr std::size_t slowest_kept = 10;
+
+  explicit RunStats(std::string name);
+
+  void add_time(StatPhase phase, Clock::duration elapsed);
+  void add_count(StatCounter counter, std::uint64_t n = 1);
+  void add_read(std::uint64_t bytes);
+  // One file or entry done: counted in the totals and ranked by `elapsed`.
+  void add_file(std::string_view name, std::uint64_t bytes, Clock::duration elapsed);
+
+  // Stops the wall clock started by the constructor.
+  void finish();
+
+  void write_json(JsonWriter& json) const;
+
+private:
+  static constexpr std::size_t phase_count = static_cast<std::size_t>(StatPhase::write) + 1;
+  static constexpr std::size_t counter_count = static_cast<std::size_t>(StatCounter::resumed_entries) + 1;
+  // Bucket k > 0 holds the sizes in (2^(k-2), 2^(k-1)], bucket 0 empty reads.
+  static constexpr std::size_t histogram_buckets = 40;
+
+  struct SlowFile
+  {
+    std::string name;
+    std::uint64_t bytes = 0;
+    std::uint64_t ns = 0;
+  };
+
+  std::string name_;
+  Clock::time_point start_;
+  Clock::duration elapsed_{};
+
+  std::array<std::atomic<std::uint64_t>, phase_count> phaseNs_{};
+  std::array<std::atomic<std::uint64_t>, counter_count> counters_{};
+  std::array<std::atomic<std::uint64_t>, histogram_buckets> readSizes_{};
+  std::atomic<std::uint64_t> files_{0};
+  std::atomic<std::uint64_t> bytes_{0};
+
+  // Min-heap on ns; once full, files faster than the floor skip the lock.
+  std::mutex slowestMutex_;
+  std::vector<SlowFile> slowest_;
+  std::atomic<std::uint64_t> slowestFloorNs_{0};
+};
+
+// Adds the time until stop() or destruction to `phase`; does nothing when
+// `stats` is null.
+class StatTimer
+{
+public:
+  StatTimer(RunStats* stats, StatPhase phase)
+      : stats_(stats), phase_(phase)
+  {
+    if (stats_)
+    {
+      start_ = RunStats::Clock::now();
+    }
+  }
+
+  ~StatTimer() { stop(); }
+
+  StatTimer(const StatTimer&) = delete;
+  StatTimer& operator=(const StatTimer&) = delete;
+
+  void stop()
+  {
+    if (stats_)
+    {
+      stats_->add_time(phase_, RunStats::Clock::now() - start_);
+      stats_ = nullptr;
+    }
+  }
+
+private:
+  RunStats* stats_;
+  StatPhase phase_;
+  RunStats::Clock::time_point start_{};
+};
+
+// Stops the wall clock of `stats`, if any, on every way out of a scope.
+class StatsFinisher
+{
+public:
+  explicit StatsFinisher(RunStats* stats)
+      : stats_(stats)
+  {
+  }
+
+  ~StatsFinisher()
+  {
+    if (stats_)
+    {
+      stats_->finish();
+    }
+  }
+
+  StatsFinisher(const StatsFinisher&) = delete;
+  StatsFinisher& operator=(const StatsFinisher&) = delete;
+
+private:
+  RunStats* stats_;
+};
+
+// The --stats report of a whole run: one RunStats per directory/archive,
+// which may be processed concurrently.
+class StatsReport
+{
+public:
+  explicit StatsReport(std::string tool);
+
+  // The returned object stays valid as long as the report.
+  RunStats& add_item(std::string name);
+
+  bool write(const std::filesystem::path& path) const;
+
+private:
+  std::string tool_;
+  RunStats::Clock::time_point start_;
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<RunStats>> items_;
+};
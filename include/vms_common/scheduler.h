@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+// Runs one task per item (a directory or an archive) with at most
+// `maxItems` tasks in flight overall and at most `perDevice` in flight on
+// the same block device, so that items sitting on different disks proceed
+// together while a single disk is not thrashed by concurrent streams.
+// Items are started in the given order whenever their device has a free slot.
+class ItemScheduler
+{
+public:
+  using Task = std::function<bool(const std::filesystem::path&)>;
+
+  ItemScheduler(unsigned maxItems, unsigned perDevice);
+
+  // Returns true only if every task returned true.
+  bool run(const std::vector<std::filesystem::path>& items, const Task& task) const;
+
+private:
+  unsigned maxItems_;
+  unsigned perDevice_;
+};
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Multi-buffer SHA-256: hashes several independent messages side by side,
+// one per SIMD lane (4 with SSE2, 8 with AVX2, 16 with AVX-512). Meant for
+// many small messages, where setting up a digest context per message costs
+// more than the hashing itself; a single long message is faster through
+// OpenSSL.
+//
+// The backend is chosen at first use from the CPU features and is only
+// kept if its output matches OpenSSL on a set of test messages; otherwise
+// (or on non-x86 builds) every message is hashed with OpenSSL.
+class Sha256MultiBuffer
+{
+public:
+  using Digest = std::array<std::uint8_t, 32>;
+
+  // Messages up to this size are worth batching.
+  static constexpr std::size_t small_message_limit = 4096;
+
+  static const char* backend();
+  static std::size_t lanes();
+
+  static void hash(const std::uint8_t* const* data, const std::size_t* sizes, std::size_t count,
+                   Digest* digests);
+};
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_common/buffer_ring.h>
+
+BufferRing::BufferRing(std::size_t buffers, std::size_t bufferSize, std::size_t consumers)
+    : bufferSize_(bufferSize), queues_(consumers)
+{
+  storage_.reserve(buffers);
+  free_.reserve(buffers);
+  for (std::size_t i = 0; i < buffers; ++i)
+  {
+    // Not value-initialised: every byte handed out is written by the producer first.
+    storage_.emplace_back(new std::uint8_t[bufferSize]);
+    free_.push_back(i);
+  }
+}
+
+std::size_t BufferRing::acquire()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  freeCv_.wait(lock, [this] { return aborted_ || !free_.empty(); });
+  if (aborted_)
+  {
+    return no_buffer;
+  }
+  std::size_t buffer = free_.back();
+  free_.pop_back();
+  return buffer;
+}
+
+void BufferRing::publish(std::size_t consumer, const Block& block)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queues_[consumer].push_back(block);
+  }
+  readyCv_.notify_all();
+}
+
+void BufferRing::close()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+  }
+  readyCv_.notify_all();
+}
+
+bool BufferRing::pop(std::size_t consumer, Block& out)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto& queue = queues_[consumer];
+  readyCv_.wait(lock, [&] { return aborted_ || closed_ || !queue.empty(); });
+  if (aborted_ || queue.empty())
+  {
+    return false;
+  }
+  out = queue.front();
+  queue.pop_front();
+  return true;
+}
+
+void BufferRing::release(std::size_t buffer)
+{
+  if (buffer == no_buffer)
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(buffer);
+  }
+  freeCv_.notify_one();
+}
+
+void BufferRing::abort()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    aborted_ = true;
+  }
+  freeCv_.notify_all();
+  readyCv_.notify_all();
+}
+
+bool BufferRing::aborted() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return aborted_;
+}
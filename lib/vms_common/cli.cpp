@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_common/cli.h>
+
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+#include <thread>
+
+bool parse_unsigned(std::string_view flag, std::string_view value, unsigned& out)
+{
+  unsigned parsed = 0;
+  auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), parsed);
+  if (value.empty() || ec != std::errc{} || ptr != value.data() + value.size())
+  {
+    std::cerr << "Error: invalid value for " << flag << ": " << value << std::endl;
+    return false;
+  }
+  out = parsed;
+  return true;
+}
+
+bool parse_thread_count(std::string_view flag, std::string_view value, unsigned& out)
+{
+  if (!parse_unsigned(flag, value, out))
+  {
+    return false;
+  }
+  if (out == 0)
+  {
+    out = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return true;
+}
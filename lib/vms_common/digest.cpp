@@ -0,0 +1,487 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_common/digest.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include <openssl/evp.h>
+#include <openssl/opensslv.h>
+
+#ifdef VMS_TOOLS_HAVE_BLAKE3
+#include <blake3.h>
+#endif
+#ifdef VMS_TOOLS_HAVE_XXHASH
+#include <xxhash.h>
+#endif
+
+namespace
+{
+  struct AlgorithmInfo
+  {
+    DigestAlgorithm algorithm;
+    const char* name;
+    std::size_t size;
+    bool available;
+  };
+
+  constexpr AlgorithmInfo algorithms[] = {
+    {DigestAlgorithm::md5, "md5", 16, true},
+    {DigestAlgorithm::sha1, "sha1", 20, true},
+    {DigestAlgorithm::sha256, "sha256", 32, true},
+    {DigestAlgorithm::sha512, "sha512", 64, true},
+#ifdef VMS_TOOLS_HAVE_BLAKE3
+    {DigestAlgorithm::blake3, "blake3", 32, true},
+#else
+    {DigestAlgorithm::blake3, "blake3", 32, false},
+#endif
+#ifdef VMS_TOOLS_HAVE_XXHASH
+    {DigestAlgorithm::xxh3_128, "xxh3-128", 16, true},
+#else
+    {DigestAlgorithm::xxh3_128, "xxh3-128", 16, false},
+#endif
+  };
+
+  // Updates smaller than this are not worth a thread hand-off.
+  constexpr std::size_t parallelUpdateMin = 256 * 1024;
+
+  // The two hex digits of every byte value, "000102...feff".
+  constexpr std::array<char, 512> make_hex_pairs()
+  {
+    constexpr char digits[] = "0123456789abcdef";
+    std::array<char, 512> pairs{};
+    for (std::size_t i = 0; i < 256; ++i)
+    {
+      pairs[2 * i] = digits[i >> 4];
+      pairs[2 * i + 1] = digits[i & 0x0f];
+    }
+    return pairs;
+  }
+
+  constexpr std::array<char, 512> hexPairs = make_hex_pairs();
+
+  const AlgorithmInfo& info(DigestAlgorithm algorithm)
+  {
+    return algorithms[static_cast<std::size_t>(algorithm)];
+  }
+
+  // One class per OpenSSL digest. With OpenSSL 3 the EVP_MD is fetched once
+  // per context: the EVP_sha256()-style handles would repeat the provider
+  // lookup on every init(), that is for every file.
+  template <DigestAlgorithm Algorithm, const EVP_MD* (*Md)()>
+  class EvpDigest final : public DigestContext
+  {
+  public:
+    EvpDigest() : ctx_(EVP_MD_CTX_new(), &EVP_MD_CTX_free)
+    {
+#if OPENSSL_VERSION_MAJOR >= 3
+      md_ = EVP_MD_fetch(nullptr, EVP_MD_get0_name(Md()), nullptr);
+#else
+      md_ = Md();
+#endif
+    }
+    ~EvpDigest() override
+    {
+#if OPENSSL_VERSION_MAJOR >= 3
+      EVP_MD_free(md_);
+#endif
+    }
+    EvpDigest(const EvpDigest&) = delete;
+    EvpDigest& operator=(const EvpDigest&) = delete;
+
+    bool valid() const { return ctx_ != nullptr && md_ != nullptr; }
+
+    DigestAlgorithm algorithm() const override { return Algorithm; }
+    bool init() override { return EVP_DigestInit_ex(ctx_.get(), md_, nullptr) == 1; }
+    bool update(const void* data, std::size_t size) override
+    {
+      return EVP_DigestUpdate(ctx_.get(), data, size) == 1;
+    }
+    bool final(std::uint8_t* out) override
+    {
+      unsigned int len = 0;
+      return EVP_DigestFinal_ex(ctx_.get(), out, &len) == 1;
+    }
+
+  private:
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx_;
+#if OPENSSL_VERSION_MAJOR >= 3
+    EVP_MD* md_ = nullptr;
+#else
+    const EVP_MD* md_ = nullptr;
+#endif
+  };
+
+#ifdef VMS_TOOLS_HAVE_BLAKE3
+  // The library splits every update into 1 KiB chunks hashed side by side
+  // with the widest SIMD unit available.
+  class Blake3Digest final : public DigestContext
+  {
+  public:
+    bool valid() const { return true; }
+
+    DigestAlgorithm algorithm() const override { return DigestAlgorithm::blake3; }
+    bool init() override
+    {
+      blake3_hasher_init(&hasher_);
+      return true;
+    }
+    bool update(const void* data, std::size_t size) override
+    {
+      blake3_hasher_update(&hasher_, data, size);
+      return true;
+    }
+    bool final(std::uint8_t* out) override
+    {
+      blake3_hasher_finalize(&hasher_, out, BLAKE3_OUT_LEN);
+      return true;
+    }
+
+  private:
+    blake3_hasher hasher_;
+  };
+#endif
+
+#ifdef VMS_TOOLS_HAVE_XXHASH
+  // Non-cryptographic: only meant for change detection.
+  class Xxh3Digest final : public DigestContext
+  {
+  public:
+    Xxh3Digest() : state_(XXH3_createState(), &XXH3_freeState) {}
+
+    bool valid() const { return state_ != nullptr; }
+
+    DigestAlgorithm algorithm() const override { return DigestAlgorithm::xxh3_128; }
+    bool init() override { return XXH3_128bits_reset(state_.get()) == XXH_OK; }
+    bool update(const void* data, std::size_t size) override
+    {
+      return XXH3_128bits_update(state_.get(), data, size) == XXH_OK;
+    }
+    bool final(std::uint8_t* out) override
+    {
+      // Canonical (big endian) form, as printed by xxhsum.
+      XXH128_canonical_t canonical;
+      XXH128_canonicalFromHash(&canonical, XXH3_128bits_digest(state_.get()));
+      std::copy(std::begin(canonical.digest), std::end(canonical.digest), out);
+      return true;
+    }
+
+  private:
+    std::unique_ptr<XXH3_state_t, decltype(&XXH3_freeState)> state_;
+  };
+#endif
+
+  template <typename Context>
+  std::unique_ptr<DigestContext> make_context()
+  {
+    auto ctx = std::make_unique<Context>();
+    if (!ctx->valid())
+    {
+      return nullptr;
+    }
+    return ctx;
+  }
+}  // namespace
+
+bool parse_digest_algorithm(std::string_view flag, std::string_view value, DigestAlgorithm& out)
+{
+  for (const auto& a : algorithms)
+  {
+    if (value == a.name || (a.algorithm == DigestAlgorithm::xxh3_128 && value == "xxh128"))
+    {
+      if (!a.available)
+      {
+        std::cerr << "Error: " << a.name << " support was not built in (available: "
+                  << available_digests() << ")" << std::endl;
+        return false;
+      }
+      out = a.algorithm;
+      return true;
+    }
+  }
+  std::cerr << "Error: invalid value for " << flag << ": " << value << " (available: "
+            << available_digests() << ")" << std::endl;
+  return false;
+}
+
+bool parse_digest_algorithms(std::string_view flag, std::string_view value, std::vector<DigestAlgorithm>& out)
+{
+  while (true)
+  {
+    std::size_t comma = value.find(',');
+    DigestAlgorithm algorithm;
+    if (!parse_digest_algorithm(flag, value.substr(0, comma), algorithm))
+    {
+      return false;
+    }
+    if (std::find(out.begin(), out.end(), algorithm) != out.end())
+    {
+      std::cerr << "Error: " << digest_name(algorithm) << " given twice for " << flag << std::endl;
+      return false;
+    }
+    out.push_back(algorithm);
+    if (comma == std::string_view::npos)
+    {
+      return true;
+    }
+    value.remove_prefix(comma + 1);
+  }
+}
+
+const char* digest_name(DigestAlgorithm algorithm)
+{
+  return info(algorithm).name;
+}
+
+std::size_t digest_size(DigestAlgorithm algorithm)
+{
+  return info(algorithm).size;
+}
+
+bool digest_available(DigestAlgorithm algorithm)
+{
+  return info(algorithm).available;
+}
+
+std::string available_digests()
+{
+  std::string list;
+  for (const auto& a : algorithms)
+  {
+    if (a.available)
+    {
+      list.append(list.empty() ? "" : ", ").append(a.name);
+    }
+  }
+  return list;
+}
+
+std::size_t digest_size(const std::vector<DigestAlgorithm>& algorithms)
+{
+  std::size_t size = 0;
+  for (auto algorithm : algorithms)
+  {
+    size += digest_size(algorithm);
+  }
+  return size;
+}
+
+void hex_encode(const std::uint8_t* digest, std::size_t size, char* out)
+{
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    std::memcpy(out + 2 * i, hexPairs.data() + 2 * digest[i], 2);
+  }
+}
+
+void append_hex(std::string& out, const std::uint8_t* digest, std::size_t size)
+{
+  const std::size_t at = out.size();
+  out.resize(at + 2 * size);
+  hex_encode(digest, size, out.data() + at);
+}
+
+std::string digest_to_hex(const std::uint8_t* digest, std::size_t size)
+{
+  std::string hex;
+  append_hex(hex, digest, size);
+  return hex;
+}
+
+bool hex_to_digest(std::string_view hex, std::uint8_t* digest, std::size_t size)
+{
+  if (hex.size() != size * 2)
+  {
+    return false;
+  }
+  auto nibble = [](char c) -> int
+  {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+  };
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    int hi = nibble(hex[2 * i]);
+    int lo = nibble(hex[2 * i + 1]);
+    if (hi < 0 || lo < 0)
+    {
+      return false;
+    }
+    digest[i] = static_cast<std::uint8_t>((hi << 4) | lo);
+  }
+  return true;
+}
+
+std::unique_ptr<DigestContext> DigestContext::create(DigestAlgorithm algorithm)
+{
+  switch (algorithm)
+  {
+    case DigestAlgorithm::md5:
+      return make_context<EvpDigest<DigestAlgorithm::md5, EVP_md5>>();
+    case DigestAlgorithm::sha1:
+      return make_context<EvpDigest<DigestAlgorithm::sha1, EVP_sha1>>();
+    case DigestAlgorithm::sha256:
+      return make_context<EvpDigest<DigestAlgorithm::sha256, EVP_sha256>>();
+    case DigestAlgorithm::sha512:
+      return make_context<EvpDigest<DigestAlgorithm::sha512, EVP_sha512>>();
+#ifdef VMS_TOOLS_HAVE_BLAKE3
+    case DigestAlgorithm::blake3:
+      return make_context<Blake3Digest>();
+#endif
+#ifdef VMS_TOOLS_HAVE_XXHASH
+    case DigestAlgorithm::xxh3_128:
+      return make_context<Xxh3Digest>();
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+// One thread per context but the first, each waiting for the next block.
+class MultiDigest::Helpers
+{
+public:
+  explicit Helpers(const std::vector<std::unique_ptr<DigestContext>>& contexts)
+  {
+    for (std::size_t i = 1; i < contexts.size(); ++i)
+    {
+      threads_.emplace_back([this, ctx = contexts[i].get()]() { run(ctx); });
+    }
+  }
+  ~Helpers()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& t : threads_)
+    {
+      t.join();
+    }
+  }
+  Helpers(const Helpers&) = delete;
+  Helpers& operator=(const Helpers&) = delete;
+
+  // Hands the block to every helper; wait() collects their results.
+  void post(const void* data, std::size_t size)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      data_ = data;
+      size_ = size;
+      pending_ = threads_.size();
+      ok_ = true;
+      ++block_;
+    }
+    wake_.notify_all();
+  }
+
+  bool wait()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return pending_ == 0; });
+    return ok_;
+  }
+
+private:
+  void run(DigestContext* ctx)
+  {
+    std::uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+      wake_.wait(lock, [&]() { return stop_ || block_ != seen; });
+      if (stop_)
+      {
+        return;
+      }
+      seen = block_;
+      const void* data = data_;
+      const std::size_t size = size_;
+      lock.unlock();
+      const bool ok = ctx->update(data, size);
+      lock.lock();
+      ok_ = ok_ && ok;
+      if (--pending_ == 0)
+      {
+        done_.notify_one();
+      }
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  std::vector<std::thread> threads_;
+  const void* data_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t pending_ = 0;
+  std::uint64_t block_ = 0;
+  bool ok_ = true;
+  bool stop_ = false;
+};
+
+MultiDigest::MultiDigest(std::vector<DigestAlgorithm> algorithms, bool parallel)
+    : algorithms_(std::move(algorithms)), parallel_(parallel && algorithms_.size() > 1)
+{
+  for (auto algorithm : algorithms_)
+  {
+    contexts_.push_back(DigestContext::create(algorithm));
+  }
+}
+
+MultiDigest::MultiDigest(MultiDigest&&) noexcept = default;
+MultiDigest& MultiDigest::operator=(MultiDigest&&) noexcept = default;
+MultiDigest::~MultiDigest() = default;
+
+bool MultiDigest::valid() const
+{
+  return std::all_of(contexts_.begin(), contexts_.end(), [](const auto& ctx) { return ctx != nullptr; });
+}
+
+bool MultiDigest::init()
+{
+  return std::all_of(contexts_.begin(), contexts_.end(), [](const auto& ctx) { return ctx->init(); });
+}
+
+bool MultiDigest::update(const void* data, std::size_t size)
+{
+  if (!parallel_ || size < parallelUpdateMin)
+  {
+    return std::all_of(contexts_.begin(), contexts_.end(),
+                       [data, size](const auto& ctx) { return ctx->update(data, size); });
+  }
+
+  if (!helpers_)
+  {
+    helpers_ = std::make_unique<Helpers>(contexts_);
+  }
+  // The first context is updated on the calling thread.
+  helpers_->post(data, size);
+  const bool ok = contexts_[0]->update(data, size);
+  return helpers_->wait() && ok;
+}
+
+bool MultiDigest::final(std::uint8_t* out)
+{
+  for (std::size_t i = 0; i < contexts_.size(); ++i)
+  {
+    if (!contexts_[i]->final(out))
+    {
+      return false;
+    }
+    out += digest_size(algorithms_[i]);
+  }
+  return true;
+}
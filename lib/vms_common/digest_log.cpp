@@ -0,0 +1,519 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_common/digest_log.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <queue>
+
+namespace
+{
+  // Each log is written in pieces of about this size.
+  constexpr std::size_t logBufferSize = 1024 * 1024;
+  constexpr std::size_t runReadBufferSize = 256 * 1024;
+
+  // Sort records: u32 order length, order key, u32 name length, name,
+  // then the binary digests of every algorithm, the lengths in host byte
+  // order (the runs never outlive the process). Entries added by index use
+  // the index in big-endian as their order key.
+  template <typename T>
+  void put(std::string& out, T value)
+  {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  template <typename T>
+  T get(const char*& p)
+  {
+    T value;
+    std::memcpy(&value, p, sizeof(value));
+    p += sizeof(value);
+    return value;
+  }
+
+  struct RecordKey
+  {
+    std::string_view order;
+    std::string_view name;
+
+    // By name with `sorted`, by order otherwise.
+    bool before(const RecordKey& other, bool sorted) const
+    {
+      if (sorted && name != other.name)
+      {
+        return name < other.name;
+      }
+      return order < other.order;
+    }
+  };
+
+  void put_view(std::string& out, std::string_view bytes)
+  {
+    put(out, static_cast<std::uint32_t>(bytes.size()));
+    out.append(bytes);
+  }
+
+  std::string_view get_view(const char*& p)
+  {
+    auto length = get<std::uint32_t>(p);
+    std::string_view bytes{p, length};
+    p += length;
+    return bytes;
+  }
+
+  // The order key of entry `index`.
+  std::string index_order(std::size_t index)
+  {
+    std::string order(sizeof(std::uint64_t), '\0');
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+      order[order.size() - 1 - i] = static_cast<char>(static_cast<std::uint64_t>(index) >> (8 * i));
+    }
+    return order;
+  }
+
+  // Rough cost of an entry waiting for a lower index beyond its name and
+  // digests: the map node and the arena bookkeeping.
+  constexpr std::size_t waitingOverhead = 64;
+
+  RecordKey key_of(const char* p)
+  {
+    RecordKey key;
+    key.order = get_view(p);
+    key.name = get_view(p);
+    return key;
+  }
+
+  // Sequential reader of one spilled run.
+  class RunReader
+  {
+  public:
+    explicit RunReader(const std::filesystem::path& path)
+        : buffer_(std::make_unique<char[]>(runReadBufferSize))
+    {
+      in_.rdbuf()->pubsetbuf(buffer_.get(), runReadBufferSize);
+      in_.open(path, std::ios::binary);
+    }
+
+    bool good() const { return static_cast<bool>(in_); }
+
+    // Loads the next record; false at the end of the run or on error.
+    bool next(std::size_t digestBytes)
+    {
+      if (!read_view(order))
+      {
+        return false;
+      }
+      read_view(name);
+      digests.resize(digestBytes);
+      in_.read(reinterpret_cast<char*>(digests.data()), static_cast<std::streamsize>(digestBytes));
+      key.order = order;
+      key.name = name;
+      return static_cast<bool>(in_);
+    }
+
+    RecordKey key;
+    std::string order;
+    std::string name;
+    std::vector<std::uint8_t> digests;
+
+  private:
+    bool read_view(std::string& bytes)
+    {
+      std::uint32_t length = 0;
+      if (!in_.read(reinterpret_cast<char*>(&length), sizeof(length)))
+      {
+        return false;
+      }
+      bytes.resize(length);
+      return static_cast<bool>(in_.read(bytes.data(), length));
+    }
+
+    std::unique_ptr<char[]> buffer_;
+    std::ifstream in_;
+  };
+}  // namespace
+
+DigestLogWriter::DigestLogWriter(std::vector<DigestAlgorithm> algorithms, bool combined, bool sorted,
+                                 std::size_t sortMemory, std::string label)
+    : algorithms_(std::move(algorithms)), label_(std::move(label)), digestBytes_(digest_size(algorithms_)),
+      combined_(combined),
+      sorted_(sorted), sortMemory_(std::max<std::size_t>(sortMemory, 1024 * 1024)), waitingEntries_(digestBytes_),
+      throughRuns_(sorted)
+{
+  for (auto algorithm : algorithms_)
+  {
+    std::string tag = digest_name(algorithm);
+    tag += label_;
+    std::transform(tag.begin(), tag.end(), tag.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+    tags_.push_back(std::move(tag));
+  }
+}
+
+DigestLogWriter::~DigestLogWriter()
+{
+  if (open_)
+  {
+    abandon();
+  }
+}
+
+std::vector<std::filesystem::path> DigestLogWriter::file_names(const std::vector<DigestAlgorithm>& algorithms,
+                                                               bool combined, const std::string& stem,
+                                                               const std::string& label)
+{
+  std::vector<std::filesystem::path> names;
+  if (combined)
+  {
+    names.emplace_back(stem + label + ".digests");
+    return names;
+  }
+  for (auto algorithm : algorithms)
+  {
+    names.emplace_back(stem + "." + digest_name(algorithm) + label);
+  }
+  return names;
+}
+
+bool DigestLogWriter::open(const std::filesystem::path& logPath, const std::string& stem)
+{
+  paths_.clear();
+  logs_.clear();
+  buffers_.clear();
+  open_ = true;
+  for (const auto& name : file_names(algorithms_, combined_, stem, label_))
+  {
+    paths_.push_back(logPath / name);
+    std::filesystem::path part = paths_.back();
+    part += ".part";
+    logs_.emplace_back(part, std::ios::binary | std::ios::trunc);
+    buffers_.emplace_back();
+    buffers_.back().reserve(logBufferSize);
+    if (!logs_.back())
+    {
+      std::cerr << "Error! Cannot open " << part << " for writing" << std::endl;
+      failed_ = true;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DigestLogWriter::fail(const std::string& what)
+{
+  if (!failed_)
+  {
+    std::cerr << "Error! " << what << std::endl;
+  }
+  failed_ = true;
+  return false;
+}
+
+void DigestLogWriter::emit(std::string_view name, const std::uint8_t* digests)
+{
+  for (std::size_t i = 0; i < algorithms_.size(); ++i)
+  {
+    const std::size_t size = digest_size(algorithms_[i]);
+    if (combined_)
+    {
+      std::string& out = buffers_[0];
+      out.append(tags_[i]).append(" (").append(name).append(") = ");
+      append_hex(out, digests, size);
+      out.push_back('\n');
+    }
+    else
+    {
+      std::string& out = buffers_[i];
+      append_hex(out, digests, size);
+      out.append("  ").append(name).push_back('\n');
+    }
+    digests += size;
+  }
+  for (std::size_t log = 0; log < logs_.size(); ++log)
+  {
+    flush_log(log, false);
+  }
+}
+
+bool DigestLogWriter::flush_log(std::size_t log, bool force)
+{
+  std::string& out = buffers_[log];
+  if (out.empty() || (!force && out.size() < logBufferSize))
+  {
+    return !failed_;
+  }
+  logs_[log].write(out.data(), static_cast<std::streamsize>(out.size()));
+  out.clear();
+  if (!logs_[log])
+  {
+    return fail("Unable to write " + paths_[log].string() + ".part");
+  }
+  return !failed_;
+}
+
+bool DigestLogWriter::add(std::size_t index, std::string_view name, const std::uint8_t* digests)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (failed_)
+  {
+    return false;
+  }
+
+  if (throughRuns_)
+  {
+    const std::string order = index_order(index);
+    return add_run(order, name, digests);
+  }
+
+  if (index != nextIndex_)
+  {
+    waiting_.emplace(index, waitingEntries_.add(name, digests));
+    waitingBytes_ += name.size() + digestBytes_ + waitingOverhead;
+    if (waitingBytes_ >= sortMemory_)
+    {
+      return spill_waiting();
+    }
+    return true;
+  }
+  emit(name, digests);
+  ++nextIndex_;
+  for (auto it = waiting_.begin(); it != waiting_.end() && it->first == nextIndex_; it = waiting_.erase(it))
+  {
+    emit(waitingEntries_.name(it->second), waitingEntries_.digests(it->second));
+    ++nextIndex_;
+  }
+  if (waiting_.empty())
+  {
+    waitingEntries_.clear();
+    waitingBytes_ = 0;
+  }
+  return !failed_;
+}
+
+bool DigestLogWriter::add(std::string_view order, std::string_view name, const std::uint8_t* digests)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (failed_)
+  {
+    return false;
+  }
+  throughRuns_ = true;
+  return add_run(order, name, digests);
+}
+
+bool DigestLogWriter::add_run(std::string_view order, std::string_view name, const std::uint8_t* digests)
+{
+  append_run(order, name, digests);
+  if (run_.size() + offsets_.size() * sizeof(std::size_t) >= sortMemory_)
+  {
+    return spill();
+  }
+  return true;
+}
+
+void DigestLogWriter::append_run(std::string_view order, std::string_view name, const std::uint8_t* digests)
+{
+  offsets_.push_back(run_.size());
+  put_view(run_, order);
+  put_view(run_, name);
+  run_.append(reinterpret_cast<const char*>(digests), digestBytes_);
+}
+
+void DigestLogWriter::sort_run()
+{
+  std::sort(offsets_.begin(), offsets_.end(), [this](std::size_t a, std::size_t b)
+  {
+    return key_of(run_.data() + a).before(key_of(run_.data() + b), sorted_);
+  });
+}
+
+// Too many entries wait for a lower index, typically behind a large file:
+// they are spilled as a run sorted by index, and so is every later entry.
+// The rest of the log is then merged from the runs by close().
+bool DigestLogWriter::spill_waiting()
+{
+  throughRuns_ = true;
+  for (const auto& [index, entry] : waiting_)
+  {
+    append_run(index_order(index), waitingEntries_.name(entry), waitingEntries_.digests(entry));
+  }
+  waiting_.clear();
+  waitingEntries_.clear();
+  waitingBytes_ = 0;
+  return spill();
+}
+
+// Sorts the records of the current run and writes them to a new run file.
+bool DigestLogWriter::spill()
+{
+  std::filesystem::path path = paths_.front();
+  path += ".run" + std::to_string(spilled_.size());
+  spilled_.push_back(path);
+
+  sort_run();
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  std::string chunk;
+  chunk.reserve(logBufferSize);
+  for (std::size_t i = 0; i < offsets_.size() && out; ++i)
+  {
+    const std::size_t begin = offsets_[i];
+    const char* p = run_.data() + begin;
+    get_view(p);
+    get_view(p);
+    p += digestBytes_;
+    chunk.append(run_.data() + begin, static_cast<std::size_t>(p - (run_.data() + begin)));
+    if (chunk.size() >= logBufferSize)
+    {
+      out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+      chunk.clear();
+    }
+  }
+  out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+  out.close();
+
+  run_.clear();
+  offsets_.clear();
+  if (!out)
+  {
+    return fail("Unable to write " + path.string());
+  }
+  return true;
+}
+
+// K-way merge of the spilled runs into the logs.
+bool DigestLogWriter::merge()
+{
+  std::vector<std::unique_ptr<RunReader>> readers;
+  for (const auto& path : spilled_)
+  {
+    readers.push_back(std::make_unique<RunReader>(path));
+    if (!readers.back()->good())
+    {
+      return fail("Unable to read " + path.string());
+    }
+  }
+
+  auto later = [&readers, this](std::size_t a, std::size_t b) { return readers[b]->key.before(readers[a]->key, sorted_); };
+  std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(later)> heads(later);
+  for (std::size_t r = 0; r < readers.size(); ++r)
+  {
+    if (readers[r]->next(digestBytes_))
+    {
+      heads.push(r);
+    }
+  }
+  while (!heads.empty() && !failed_)
+  {
+    std::size_t r = heads.top();
+    heads.pop();
+    emit(readers[r]->name, readers[r]->digests.data());
+    if (readers[r]->next(digestBytes_))
+    {
+      heads.push(r);
+    }
+  }
+  return !failed_;
+}
+
+bool DigestLogWriter::close()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!failed_ && throughRuns_)
+  {
+    if (spilled_.empty())
+    {
+      // Everything fit in memory: sort and write the single run directly.
+      sort_run();
+      for (std::size_t offset : offsets_)
+      {
+        const char* p = run_.data() + offset;
+        get_view(p);
+        std::string_view name = get_view(p);
+        emit(name, reinterpret_cast<const std::uint8_t*>(p));
+      }
+    }
+    else if (offsets_.empty() || spill())
+    {
+      merge();
+    }
+  }
+  for (auto& entry : waiting_)
+  {
+    emit(waitingEntries_.name(entry.second), waitingEntries_.digests(entry.second));
+  }
+  waiting_.clear();
+  waitingEntries_.clear();
+
+  for (std::size_t log = 0; log < logs_.size(); ++log)
+  {
+    flush_log(log, true);
+    logs_[log].close();
+    if (!logs_[log])
+    {
+      fail("Unable to write " + paths_[log].string() + ".part");
+    }
+  }
+  logs_.clear();
+
+  std::error_code ec;
+  for (const auto& path : spilled_)
+  {
+    std::filesystem::remove(path, ec);
+  }
+  spilled_.clear();
+  run_.clear();
+  offsets_.clear();
+
+  for (const auto& path : paths_)
+  {
+    std::filesystem::path part = path;
+    part += ".part";
+    if (failed_)
+    {
+      std::filesystem::remove(part, ec);
+      continue;
+    }
+    std::filesystem::rename(part, path, ec);
+    if (ec)
+    {
+      fail("Unable to rename " + part.string() + ": " + ec.message());
+    }
+  }
+  open_ = false;
+  return !failed_;
+}
+
+void DigestLogWriter::abandon()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  logs_.clear();
+  std::error_code ec;
+  for (const auto& path : spilled_)
+  {
+    std::filesystem::remove(path, ec);
+  }
+  for (const auto& path : paths_)
+  {
+    std::filesystem::path part = path;
+    part += ".part";
+    std::filesystem::remove(part, ec);
+  }
+  spilled_.clear();
+  waiting_.clear();
+  waitingEntries_.clear();
+  waitingBytes_ = 0;
+  throughRuns_ = sorted_;
+  run_.clear();
+  offsets_.clear();
+  open_ = false;
+}
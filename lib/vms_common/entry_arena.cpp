@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_common/entry_arena.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+  constexpr std::size_t arenaBlockSize = 1024 * 1024;
+}  // namespace
+
+EntryArena::EntryArena(std::size_t digestBytes)
+    : digestBytes_(digestBytes)
+{
+}
+
+char* EntryArena::allocate(std::size_t size)
+{
+  if (blocks_.empty() || blockSize_ - used_ < size)
+  {
+    // An entry larger than a block gets a block of its own.
+    blockSize_ = std::max(size, arenaBlockSize);
+    // Not value-initialised: every byte handed out is written by add().
+    blocks_.emplace_back(new char[blockSize_]);
+    if (blocks_.size() == 1)
+    {
+      firstBlockSize_ = blockSize_;
+    }
+    used_ = 0;
+  }
+  char* p = blocks_.back().get() + used_;
+  used_ += size;
+  return p;
+}
+
+std::size_t EntryArena::add(std::string_view name, const std::uint8_t* digests)
+{
+  char* p = allocate(digestBytes_ + name.size());
+  if (digests)
+  {
+    std::memcpy(p, digests, digestBytes_);
+  }
+  else
+  {
+    std::memset(p, 0, digestBytes_);
+  }
+  if (!name.empty())
+  {
+    std::memcpy(p + digestBytes_, name.data(), name.size());
+  }
+  slots_.push_back(Slot{p, name.size()});
+  return slots_.size() - 1;
+}
+
+void EntryArena::clear()
+{
+  slots_.clear();
+  if (blocks_.size() > 1)
+  {
+    blocks_.erase(blocks_.begin() + 1, blocks_.end());
+    blockSize_ = firstBlockSize_;
+  }
+  used_ = 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_common/journal.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+  constexpr char journalMagic[8] = {'V', 'M', 'S', 'J', 'R', 'N', 'L', '1'};
+  constexpr std::size_t journalBufferSize = 1024 * 1024;
+  constexpr auto writeInterval = std::chrono::seconds(1);
+  constexpr auto syncInterval = std::chrono::seconds(5);
+
+  std::uint64_t fnv1a(const char* data, std::size_t size)
+  {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      hash ^= static_cast<std::uint8_t>(data[i]);
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  void put_le(std::string& out, std::uint64_t value, int bytes)
+  {
+    for (int i = 0; i < bytes; ++i)
+    {
+      out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+  }
+
+  std::uint64_t get_le(const char* p, int bytes)
+  {
+    std::uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+    {
+      value |= std::uint64_t{static_cast<std::uint8_t>(p[i])} << (8 * i);
+    }
+    return value;
+  }
+}  // namespace
+
+Journal::Journal(std::filesystem::path path, std::string identity, std::size_t digestBytes)
+    : path_(std::move(path)), identity_(std::move(identity)), digestBytes_(digestBytes)
+{
+}
+
+Journal::~Journal()
+{
+  if (fd_ >= 0)
+  {
+    std::string batch;
+    batch.swap(buffer_);
+    write_batch(batch, true);
+    ::close(fd_);
+  }
+}
+
+std::size_t Journal::load(const std::function<void(const Record&)>& visit)
+{
+  keep_ = 0;
+  std::ifstream in(path_, std::ios::binary);
+  if (!in)
+  {
+    return 0;
+  }
+  loaded_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  if (loaded_.empty())
+  {
+    return 0;
+  }
+
+  const std::size_t header = sizeof(journalMagic) + 4 + identity_.size();
+  if (loaded_.size() < header || std::memcmp(loaded_.data(), journalMagic, sizeof(journalMagic)) != 0
+      || get_le(loaded_.data() + sizeof(journalMagic), 4) != identity_.size()
+      || loaded_.compare(sizeof(journalMagic) + 4, identity_.size(), identity_) != 0)
+  {
+    std::cerr << "Warning: ignoring journal " << path_ << " (it does not match this run)" << std::endl;
+    loaded_.clear();
+    return 0;
+  }
+
+  std::size_t count = 0;
+  std::size_t pos = header;
+  keep_ = pos;
+  while (loaded_.size() - pos >= 8)
+  {
+    const std::size_t nameLength = get_le(loaded_.data() + pos, 4);
+    const std::size_t keyLength = get_le(loaded_.data() + pos + 4, 4);
+    const std::size_t body = 8 + nameLength + keyLength + digestBytes_;
+    if (loaded_.size() - pos < body + 8 || fnv1a(loaded_.data() + pos, body) != get_le(loaded_.data() + pos + body, 8))
+    {
+      break;
+    }
+    const char* name = loaded_.data() + pos + 8;
+    visit(Record{{name, nameLength},
+                 {name + nameLength, keyLength},
+                 reinterpret_cast<const std::uint8_t*>(name + nameLength + keyLength)});
+    ++count;
+    pos += body + 8;
+    keep_ = pos;
+  }
+  return count;
+}
+
+bool Journal::open()
+{
+  fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+  // Appends go after the records kept, a torn one at the end is cut off.
+  if (fd_ < 0 || ftruncate(fd_, static_cast<off_t>(keep_)) != 0
+      || lseek(fd_, static_cast<off_t>(keep_), SEEK_SET) < 0)
+  {
+    std::cerr << "Error! Cannot open journal " << path_ << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  buffer_.reserve(journalBufferSize);
+  if (keep_ == 0)
+  {
+    buffer_.append(journalMagic, sizeof(journalMagic));
+    put_le(buffer_, identity_.size(), 4);
+    buffer_ += identity_;
+  }
+  lastWrite_ = lastSync_ = std::chrono::steady_clock::now();
+  return true;
+}
+
+bool Journal::add(std::string_view name, std::string_view key, const std::uint8_t* digests)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (failed_)
+  {
+    return false;
+  }
+  const std::size_t start = buffer_.size();
+  put_le(buffer_, name.size(), 4);
+  put_le(buffer_, key.size(), 4);
+  buffer_.append(name).append(key).append(reinterpret_cast<const char*>(digests), digestBytes_);
+  put_le(buffer_, fnv1a(buffer_.data() + start, buffer_.size() - start), 8);
+
+  const auto now = std::chrono::steady_clock::now();
+  if (buffer_.size() < journalBufferSize && now - lastWrite_ < writeInterval)
+  {
+    return true;
+  }
+  const bool sync = now - lastSync_ >= syncInterval;
+  lastWrite_ = now;
+  if (sync)
+  {
+    lastSync_ = now;
+  }
+  std::string batch;
+  batch.reserve(journalBufferSize);
+  batch.swap(buffer_);
+  std::lock_guard<std::mutex> write_lock(writeMutex_);
+  lock.unlock();
+  if (write_batch(batch, sync))
+  {
+    return true;
+  }
+  if (!failed_.exchange(true))
+  {
+    std::cerr << "Error! Unable to write journal " << path_ << ": " << std::strerror(errno) << std::endl;
+  }
+  return false;
+}
+
+bool Journal::write_batch(std::string& batch, bool sync)
+{
+  for (std::size_t done = 0; done < batch.size();)
+  {
+    const ssize_t n = ::write(fd_, batch.data() + done, batch.size() - done);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n < 0)
+    {
+      return false;
+    }
+    done += static_cast<std::size_t>(n);
+  }
+  return !sync || fdatasync(fd_) == 0;
+}
+
+void Journal::remove()
+{
+  if (fd_ >= 0)
+  {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  buffer_.clear();
+  std::error_code ec;
+  std::filesystem::remove(path_, ec);
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_common/json.h>
+
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+JsonWriter::JsonWriter(std::ostream& os)
+    : os_(os)
+{
+}
+
+void JsonWriter::newline()
+{
+  os_ << '\n' << std::string(nonEmpty_.size() * 2, ' ');
+}
+
+// Called before every key and every value that is not preceded by a key.
+void JsonWriter::separate()
+{
+  if (afterKey_)
+  {
+    afterKey_ = false;
+    return;
+  }
+  if (nonEmpty_.empty())
+  {
+    return;
+  }
+  if (nonEmpty_.back())
+  {
+    os_ << ',';
+  }
+  nonEmpty_.back() = true;
+  newline();
+}
+
+JsonWriter& JsonWriter::begin_object()
+{
+  separate();
+  os_ << '{';
+  nonEmpty_.push_back(false);
+  return *this;
+}
+
+JsonWriter& JsonWriter::end_object()
+{
+  bool any = nonEmpty_.back();
+  nonEmpty_.pop_back();
+  if (any)
+  {
+    newline();
+  }
+  os_ << '}';
+  if (nonEmpty_.empty())
+  {
+    os_ << '\n';
+  }
+  return *this;
+}
+
+JsonWriter& JsonWriter::begin_array()
+{
+  separate();
+  os_ << '[';
+  nonEmpty_.push_back(false);
+  return *this;
+}
+
+JsonWriter& JsonWriter::end_array()
+{
+  bool any = nonEmpty_.back();
+  nonEmpty_.pop_back();
+  if (any)
+  {
+    newline();
+  }
+  os_ << ']';
+  if (nonEmpty_.empty())
+  {
+    os_ << '\n';
+  }
+  return *this;
+}
+
+JsonWriter& JsonWriter::key(std::string_view name)
+{
+  separate();
+  write_string(name);
+  os_ << ": ";
+  afterKey_ = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(std::string_view text)
+{
+  separate();
+  write_string(text);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(bool flag)
+{
+  separate();
+  os_ << (flag ? "true" : "false");
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(double number)
+{
+  separate();
+  if (!std::isfinite(number))
+  {
+    os_ << "null";
+    return *this;
+  }
+  auto flags = os_.flags();
+  auto precision = os_.precision();
+  os_ << std::defaultfloat << std::setprecision(6) << number;
+  os_.flags(flags);
+  os_.precision(precision);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(std::uint64_t number)
+{
+  separate();
+  os_ << number;
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(std::int64_t number)
+{
+  separate();
+  os_ << number;
+  return *this;
+}
+
+void JsonWriter::write_string(std::string_view text)
+{
+  static constexpr char digits[] = "0123456789abcdef";
+  os_ << '"';
+  for (char c : text)
+  {
+    auto u = static_cast<unsigned char>(c);
+    switch (c)
+    {
+      case '"': os_ << "\\\""; break;
+      case '\\': os_ << "\\\\"; break;
+      case '\n': os_ << "\\n"; break;
+      case '\r': os_ << "\\r"; break;
+      case '\t': os_ << "\\t"; break;
+      default:
+        if (u < 0x20)
+        {
+          os_ << "\\u00" << digits[u >> 4] << digits[u & 0x0f];
+        }
+        else
+        {
+          os_ << c;
+        }
+    }
+  }
+  os_ << '"';
+}
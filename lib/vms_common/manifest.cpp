@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_common/manifest.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+ManifestVerifier::ManifestVerifier(std::vector<DigestAlgorithm> algorithms, bool stopAtFirstFailure)
+    : algorithms_(std::move(algorithms)), stopAtFirstFailure_(stopAtFirstFailure), listed_(digest_size(algorithms_))
+{
+}
+
+bool ManifestVerifier::load(const std::vector<std::filesystem::path>& manifests)
+{
+  manifests_ = manifests;
+  for (std::size_t column = 0; column < manifests.size(); ++column)
+  {
+    if (!read(manifests[column], column))
+    {
+      return false;
+    }
+  }
+  columns_.clear();
+  columns_.shrink_to_fit();
+  seen_ = std::make_unique<std::atomic<bool>[]>(listed_.size());
+  return true;
+}
+
+bool ManifestVerifier::read(const std::filesystem::path& manifest, std::size_t column)
+{
+  std::ifstream in(manifest);
+  if (!in)
+  {
+    std::cerr << "Error! Cannot open manifest " << manifest << std::endl;
+    return false;
+  }
+  std::size_t offset = 0;
+  for (std::size_t c = 0; c < column; ++c)
+  {
+    offset += digest_size(algorithms_[c]);
+  }
+  const std::size_t size = digest_size(algorithms_[column]);
+  DigestBytes digest{};
+
+  std::string line;
+  std::size_t lineNo = 0;
+  std::size_t count = 0;
+  while (std::getline(in, line))
+  {
+    ++lineNo;
+    if (line.empty())
+    {
+      continue;
+    }
+    std::size_t hexLen = 0;
+    while (hexLen < line.size() && std::isxdigit(static_cast<unsigned char>(line[hexLen])))
+    {
+      ++hexLen;
+    }
+    if (hexLen == 0 || hexLen % 2 != 0 || hexLen + 2 > line.size() || line[hexLen] != ' '
+        || (line[hexLen + 1] != ' ' && line[hexLen + 1] != '*'))
+    {
+      std::cerr << "Error! " << manifest << ":" << lineNo << ": malformed line" << std::endl;
+      return false;
+    }
+    std::transform(line.begin(), line.begin() + static_cast<std::ptrdiff_t>(hexLen), line.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (!hex_to_digest(std::string_view{line}.substr(0, hexLen), digest.data(), size))
+    {
+      std::cerr << "Error! " << manifest << ":" << lineNo << ": not a " << digest_name(algorithms_[column])
+                << " digest" << std::endl;
+      return false;
+    }
+    std::string_view name = std::string_view{line}.substr(hexLen + 2);
+    ++count;
+
+    if (column == 0)
+    {
+      listed_.add(name, nullptr);
+      std::copy_n(digest.data(), size, listed_.digests(listed_.size() - 1));
+      columns_.push_back(1);
+      continue;
+    }
+    std::size_t i = find(name);
+    if (i == listed_.size() || columns_[i] != column)
+    {
+      std::cerr << "Error! " << manifest << ":" << lineNo << ": " << name << " is not listed once in "
+                << manifests_[0] << std::endl;
+      return false;
+    }
+    std::copy_n(digest.data(), size, listed_.digests(i) + offset);
+    ++columns_[i];
+  }
+
+  if (column == 0)
+  {
+    // The index points into listed_, whose names never move.
+    index_.reserve(listed_.size());
+    for (std::size_t i = 0; i < listed_.size(); ++i)
+    {
+      if (!index_.emplace(listed_.name(i), i).second)
+      {
+        std::cerr << "Error! " << manifest << ": duplicate entry " << listed_.name(i) << std::endl;
+        return false;
+      }
+    }
+  }
+  else if (count != listed_.size())
+  {
+    std::cerr << "Error! " << manifest << " and " << manifests_[0] << " do not list the same entries" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+std::size_t ManifestVerifier::find(std::string_view name) const
+{
+  auto it = index_.find(name);
+  return it == index_.end() ? listed_.size() : it->second;
+}
+
+void ManifestVerifier::report(std::string_view name, std::string_view what)
+{
+  std::lock_guard<std::mutex> lock(outputMutex_);
+  std::cout << name << ": " << what << "\n";
+}
+
+bool ManifestVerifier::expect(std::string_view name)
+{
+  std::size_t i = find(name);
+  if (i == listed_.size())
+  {
+    ++extra_;
+    report(name, "EXTRA (not in manifest)");
+    return false;
+  }
+  seen_[i] = true;
+  return true;
+}
+
+bool ManifestVerifier::check(std::string_view name, const std::uint8_t* digests)
+{
+  std::size_t i = find(name);
+  if (i == listed_.size())
+  {
+    return false;  // already reported by expect()
+  }
+  if (std::memcmp(listed_.digests(i), digests, listed_.digest_bytes()) != 0)
+  {
+    ++mismatched_;
+    report(name, "FAILED");
+    return false;
+  }
+  ++matched_;
+  return true;
+}
+
+bool ManifestVerifier::report_missing()
+{
+  bool ok = true;
+  for (std::size_t i = 0; i < listed_.size(); ++i)
+  {
+    if (!seen_[i].exchange(true))
+    {
+      ++missing_;
+      report(listed_.name(i), "MISSING");
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+bool ManifestVerifier::finish()
+{
+  std::lock_guard<std::mutex> lock(outputMutex_);
+  for (std::size_t i = 0; i < manifests_.size(); ++i)
+  {
+    std::cout << (i > 0 ? ", " : "") << manifests_[i].string();
+  }
+  std::cout << ": " << matched_ << " OK, " << mismatched_ << " FAILED, "
+            << missing_ << " MISSING, " << extra_ << " EXTRA" << std::endl;
+  return mismatched_ == 0 && missing_ == 0 && extra_ == 0;
+}
+
+bool ManifestVerifier::should_stop() const
+{
+  return stopAtFirstFailure_ && (mismatched_ > 0 || missing_ > 0 || extra_ > 0);
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_common/mapped_range.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+struct MappedRangeGuard::Slot
+{
+  std::atomic<bool> used{false};
+  std::atomic<std::uint8_t*> begin{nullptr};
+  std::atomic<std::size_t> length{0};
+  std::atomic<bool> truncated{false};
+};
+
+namespace
+{
+  using Slot = MappedRangeGuard::Slot;
+
+  // Blocks of slots are added as more ranges are read at once and never
+  // freed, so the handler can walk them without taking a lock. The table
+  // grows to one range per thread reading a mapping; the limit is only
+  // there to keep the walk bounded.
+  constexpr std::size_t slotsPerBlock = 256;
+  constexpr std::size_t maxBlocks = 256;
+  std::array<std::atomic<Slot*>, maxBlocks> blocks{};
+  std::mutex growMutex;
+
+  // Read once when the handler is installed: sysconf() is not
+  // async-signal-safe.
+  std::uintptr_t pageSize = 4096;
+
+  void on_sigbus(int sig, siginfo_t* info, void*)
+  {
+    auto* addr = static_cast<std::uint8_t*>(info->si_addr);
+    for (auto& block : blocks)
+    {
+      Slot* slots = block.load();
+      if (!slots)
+      {
+        break;
+      }
+      for (std::size_t i = 0; i < slotsPerBlock; ++i)
+      {
+        Slot& slot = slots[i];
+        std::uint8_t* begin = slot.begin.load();
+        const std::size_t length = slot.length.load();
+        if (!begin || addr < begin || addr >= begin + length)
+        {
+          continue;
+        }
+        auto* from = reinterpret_cast<std::uint8_t*>(reinterpret_cast<std::uintptr_t>(addr) & ~(pageSize - 1));
+        if (mmap(from, static_cast<std::size_t>(begin + length - from), PROT_READ,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED)
+        {
+          slot.truncated.store(true);
+          return;
+        }
+        signal(sig, SIG_DFL);
+        return;
+      }
+    }
+    // Not ours: the fault repeats with the default action.
+    signal(sig, SIG_DFL);
+  }
+
+  void install_handler()
+  {
+    static std::once_flag installed;
+    std::call_once(installed, []
+    {
+      pageSize = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+      struct sigaction action{};
+      action.sa_sigaction = on_sigbus;
+      action.sa_flags = SA_SIGINFO;
+      sigemptyset(&action.sa_mask);
+      sigaction(SIGBUS, &action, nullptr);
+    });
+  }
+
+  bool claim(Slot* slots, std::size_t count, Slot*& out)
+  {
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      if (!slots[i].used.exchange(true))
+      {
+        out = &slots[i];
+        return true;
+      }
+    }
+    return false;
+  }
+
+  Slot* claim_slot()
+  {
+    for (std::size_t b = 0; b < maxBlocks; ++b)
+    {
+      Slot* slots = blocks[b].load();
+      if (!slots)
+      {
+        std::lock_guard<std::mutex> lock(growMutex);
+        slots = blocks[b].load();
+        if (!slots)
+        {
+          slots = new Slot[slotsPerBlock];
+          blocks[b].store(slots);
+        }
+      }
+      Slot* slot = nullptr;
+      if (claim(slots, slotsPerBlock, slot))
+      {
+        return slot;
+      }
+    }
+    return nullptr;
+  }
+}  // namespace
+
+MappedRangeGuard::MappedRangeGuard(const void* data, std::size_t length)
+{
+  install_handler();
+  slot_ = claim_slot();
+  if (slot_)
+  {
+    slot_->length.store(length);
+    slot_->begin.store(static_cast<std::uint8_t*>(const_cast<void*>(data)));
+  }
+}
+
+MappedRangeGuard::~MappedRangeGuard()
+{
+  if (slot_)
+  {
+    slot_->begin.store(nullptr);
+    slot_->truncated.store(false);
+    slot_->used.store(false);
+  }
+}
+
+bool MappedRangeGuard::truncated() const
+{
+  return slot_ && slot_->truncated.load();
+}
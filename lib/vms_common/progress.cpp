@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_common/progress.h>
+
+#include <iostream>
+#include <sstream>
+
+#include <unistd.h>
+
+ProgressRenderer::ProgressRenderer(bool requested, Draw draw, std::chrono::milliseconds period)
+    : enabled_(requested && isatty(STDERR_FILENO) == 1), draw_(std::move(draw)), period_(period)
+{
+}
+
+ProgressRenderer::~ProgressRenderer()
+{
+  stop();
+}
+
+void ProgressRenderer::start()
+{
+  if (!enabled_ || thread_.joinable())
+  {
+    return;
+  }
+  stopping_ = false;
+  thread_ = std::thread([this]()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_)
+    {
+      lock.unlock();
+      render();
+      lock.lock();
+      cv_.wait_for(lock, period_, [this]() { return stopping_; });
+    }
+  });
+}
+
+void ProgressRenderer::stop()
+{
+  if (!thread_.joinable())
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+  render();
+}
+
+void ProgressRenderer::render()
+{
+  std::ostringstream frame;
+  draw_(frame);
+  std::cerr << frame.str() << std::flush;
+}
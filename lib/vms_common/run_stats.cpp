@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_common/run_stats.h>
+#include <vms_common/json.h>
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+  constexpr const char* phaseNames[] = {"scan", "load", "open", "read", "decompress",
+                                        "digest", "hash", "sort", "write"};
+  constexpr const char* counterNames[] = {"cache_hits", "multi_buffer_files", "shared_files", "shared_bytes",
+                                          "hole_bytes", "resumed_entries"};
+
+  std::uint64_t to_ns(RunStats::Clock::duration d)
+  {
+    return static_cast<std::uint64_t>(std::max<std::int64_t>(
+        0, std::chrono::duration_cast<std::chrono::nanoseconds>(d).count()));
+  }
+
+  double to_seconds(std::uint64_t ns)
+  {
+    return static_cast<double>(ns) / 1e9;
+  }
+
+  double per_second(double amount, std::uint64_t ns)
+  {
+    return ns > 0 ? amount / to_seconds(ns) : 0.0;
+  }
+
+  // Heap order of the slowest files: the fastest one on top.
+  constexpr auto slower = [](const auto& a, const auto& b) { return a.ns > b.ns; };
+}  // namespace
+
+RunStats::RunStats(std::string name)
+    : name_(std::move(name)), start_(Clock::now())
+{
+}
+
+void RunStats::add_time(StatPhase phase, Clock::duration elapsed)
+{
+  phaseNs_[static_cast<std::size_t>(phase)].fetch_add(to_ns(elapsed), std::memory_order_relaxed);
+}
+
+void RunStats::add_count(StatCounter counter, std::uint64_t n)
+{
+  counters_[static_cast<std::size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+}
+
+void RunStats::add_read(std::uint64_t bytes)
+{
+  std::size_t bucket = bytes == 0 ? 0 : static_cast<std::size_t>(std::bit_width(bytes - 1)) + 1;
+  readSizes_[std::min(bucket, histogram_buckets - 1)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void RunStats::add_file(std::string_view name, std::uint64_t bytes, Clock::duration elapsed)
+{
+  files_.fetch_add(1, std::memory_order_relaxed);
+  bytes_.fetch_add(bytes, std::memory_order_relaxed);
+
+  const std::uint64_t ns = to_ns(elapsed);
+  if (ns <= slowestFloorNs_.load(std::memory_order_relaxed))
+  {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(slowestMutex_);
+  if (slowest_.size() == slowest_kept)
+  {
+    if (ns <= slowest_.front().ns)
+    {
+      return;
+    }
+    std::pop_heap(slowest_.begin(), slowest_.end(), slower);
+    slowest_.pop_back();
+  }
+  slowest_.push_back(SlowFile{std::string{name}, bytes, ns});
+  std::push_heap(slowest_.begin(), slowest_.end(), slower);
+  if (slowest_.size() == slowest_kept)
+  {
+    slowestFloorNs_.store(slowest_.front().ns, std::memory_order_relaxed);
+  }
+}
+
+void RunStats::finish()
+{
+  elapsed_ = Clock::now() - start_;
+}
+
+void RunStats::write_json(JsonWriter& json) const
+{
+  const std::uint64_t wallNs = to_ns(elapsed_);
+  const std::uint64_t files = files_.load();
+  const std::uint64_t bytes = bytes_.load();
+
+  json.begin_object();
+  json.field("name", name_);
+  json.field("seconds", to_seconds(wallNs));
+  json.field("files", files);
+  json.field("bytes", bytes);
+  json.field("files_per_s", per_second(static_cast<double>(files), wallNs));
+  json.field("mb_per_s", per_second(static_cast<double>(bytes) / 1e6, wallNs));
+
+  json.key("phases").begin_object();
+  for (std::size_t i = 0; i < phase_count; ++i)
+  {
+    json.field(phaseNames[i], to_seconds(phaseNs_[i].load()));
+  }
+  json.end_object();
+
+  json.key("counters").begin_object();
+  for (std::size_t i = 0; i < counter_count; ++i)
+  {
+    json.field(counterNames[i], counters_[i].load());
+  }
+  json.end_object();
+
+  // Only the buckets that were hit, as {"up_to": <bytes>, "count": <reads>}.
+  json.key("read_sizes").begin_array();
+  for (std::size_t k = 0; k < histogram_buckets; ++k)
+  {
+    std::uint64_t count = readSizes_[k].load();
+    if (count > 0)
+    {
+      std::uint64_t upTo = k == 0 ? 0 : std::uint64_t{1} << (k - 1);
+      json.begin_object().field("up_to", upTo).field("count", count).end_object();
+    }
+  }
+  json.end_array();
+
+  std::vector<SlowFile> slowest = slowest_;
+  std::sort(slowest.begin(), slowest.end(), slower);
+  json.key("slowest").begin_array();
+  for (const auto& f : slowest)
+  {
+    json.begin_object();
+    json.field("name", f.name);
+    json.field("bytes", f.bytes);
+    json.field("seconds", to_seconds(f.ns));
+    json.end_object();
+  }
+  json.end_array();
+  json.end_object();
+}
+
+StatsReport::StatsReport(std::string tool)
+    : tool_(std::move(tool)), start_(RunStats::Clock::now())
+{
+}
+
+RunStats& StatsReport::add_item(std::string name)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  items_.push_back(std::make_unique<RunStats>(std::move(name)));
+  return *items_.back();
+}
+
+bool StatsReport::write(const std::filesystem::path& path) const
+{
+  std::ofstream out(path);
+  if (!out)
+  {
+    std::cerr << "Error! Cannot open " << path << " for writing" << std::endl;
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  JsonWriter json(out);
+  json.begin_object();
+  json.field("tool", tool_);
+  json.field("seconds", to_seconds(to_ns(RunStats::Clock::now() - start_)));
+  json.key("items").begin_array();
+  for (const auto& item : items_)
+  {
+    item->write_json(json);
+  }
+  json.end_array();
+  json.end_object();
+
+  out.close();
+  if (!out)
+  {
+    std::cerr << "Error! Unable to write " << path << std::endl;
+    return false;
+  }
+  return true;
+}
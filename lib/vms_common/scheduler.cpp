@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_common/scheduler.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace
+{
+  dev_t device_of(const std::filesystem::path& path)
+  {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+      return 0;
+    }
+    return st.st_dev;
+  }
+}  // namespace
+
+ItemScheduler::ItemScheduler(unsigned maxItems, unsigned perDevice)
+    : maxItems_(std::max(1u, maxItems)), perDevice_(std::max(1u, perDevice))
+{
+}
+
+bool ItemScheduler::run(const std::vector<std::filesystem::path>& items, const Task& task) const
+{
+  if (maxItems_ == 1 || items.size() < 2)
+  {
+    bool ok = true;
+    for (const auto& item : items)
+    {
+      ok &= task(item);
+    }
+    return ok;
+  }
+
+  std::vector<dev_t> devices;
+  devices.reserve(items.size());
+  for (const auto& item : items)
+  {
+    devices.push_back(device_of(item));
+  }
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<bool> started(items.size(), false);
+  std::map<dev_t, unsigned> running;
+  bool ok = true;
+
+  auto worker = [&]()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+      std::size_t pick = items.size();
+      for (std::size_t i = 0; i < items.size(); ++i)
+      {
+        if (!started[i] && running[devices[i]] < perDevice_)
+        {
+          pick = i;
+          break;
+        }
+      }
+
+      if (pick == items.size())
+      {
+        if (std::find(started.begin(), started.end(), false) == started.end())
+        {
+          return;
+        }
+        cv.wait(lock);
+        continue;
+      }
+
+      started[pick] = true;
+      ++running[devices[pick]];
+      lock.unlock();
+
+      bool itemOk = task(items[pick]);
+
+      lock.lock();
+      ok &= itemOk;
+      --running[devices[pick]];
+      cv.notify_all();
+    }
+  };
+
+  std::size_t threads = std::min<std::size_t>(maxItems_, items.size());
+  std::vector<std::thread> pool;
+  pool.reserve(threads);
+  for (std::size_t i = 0; i < threads; ++i)
+  {
+    pool.emplace_back(worker);
+  }
+  for (auto& t : pool)
+  {
+    t.join();
+  }
+
+  return ok;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+// Built with -mavx2.
+
+#include "sha256_mb_backends.h"
+
+#include <immintrin.h>
+
+#include "sha256_mb_impl.h"
+
+namespace
+{
+  struct Avx2Lanes
+  {
+    using V = __m256i;
+    static constexpr std::size_t lanes = 8;
+
+    static V load(const std::uint32_t* p) { return _mm256_load_si256(reinterpret_cast<const V*>(p)); }
+    static void store(std::uint32_t* p, V v) { _mm256_store_si256(reinterpret_cast<V*>(p), v); }
+    static V set1(std::uint32_t x) { return _mm256_set1_epi32(static_cast<int>(x)); }
+    static V add(V a, V b) { return _mm256_add_epi32(a, b); }
+    static V xor_(V a, V b) { return _mm256_xor_si256(a, b); }
+    static V xor3(V a, V b, V c) { return _mm256_xor_si256(_mm256_xor_si256(a, b), c); }
+    static V and_(V a, V b) { return _mm256_and_si256(a, b); }
+    static V or_(V a, V b) { return _mm256_or_si256(a, b); }
+    static V andnot(V a, V b) { return _mm256_andnot_si256(a, b); }
+    template <int N> static V shr(V x) { return _mm256_srli_epi32(x, N); }
+    template <int N> static V rotr(V x) { return _mm256_or_si256(_mm256_srli_epi32(x, N), _mm256_slli_epi32(x, 32 - N)); }
+  };
+}  // namespace
+
+void sha256_mb_avx2(const std::uint8_t* const* data, const std::size_t* sizes, std::size_t count,
+                    std::uint8_t (*digests)[32], std::size_t* order)
+{
+  hash_lanes<Avx2Lanes>(data, sizes, count, digests, order);
+}
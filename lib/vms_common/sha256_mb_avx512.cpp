@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+// Built with -mavx512f.
+
+#include "sha256_mb_backends.h"
+
+#include <immintrin.h>
+
+#include "sha256_mb_impl.h"
+
+namespace
+{
+  struct Avx512Lanes
+  {
+    using V = __m512i;
+    static constexpr std::size_t lanes = 16;
+
+    static V load(const std::uint32_t* p) { return _mm512_load_si512(p); }
+    static void store(std::uint32_t* p, V v) { _mm512_store_si512(p, v); }
+    static V set1(std::uint32_t x) { return _mm512_set1_epi32(static_cast<int>(x)); }
+    static V add(V a, V b) { return _mm512_add_epi32(a, b); }
+    static V xor_(V a, V b) { return _mm512_xor_si512(a, b); }
+    static V xor3(V a, V b, V c) { return _mm512_ternarylogic_epi32(a, b, c, 0x96); }
+    static V and_(V a, V b) { return _mm512_and_si512(a, b); }
+    static V or_(V a, V b) { return _mm512_or_si512(a, b); }
+    static V andnot(V a, V b) { return _mm512_andnot_si512(a, b); }
+    template <int N> static V shr(V x) { return _mm512_srli_epi32(x, N); }
+    template <int N> static V rotr(V x) { return _mm512_ror_epi32(x, N); }
+  };
+}  // namespace
+
+void sha256_mb_avx512(const std::uint8_t* const* data, const std::size_t* sizes, std::size_t count,
+                      std::uint8_t (*digests)[32], std::size_t* order)
+{
+  hash_lanes<Avx512Lanes>(data, sizes, count, digests, order);
+}
@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Backends of Sha256MultiBuffer, each built in its own translation unit
+// with the matching instruction set enabled. Only call them after checking
+// the CPU supports it. `order` is a permutation of [0, count) listing the
+// messages by increasing size.
+using Sha256MbFn = void (*)(const std::uint8_t* const* data, const std::size_t* sizes, std::size_t count,
+                            std::uint8_t (*digests)[32], std::size_t* order);
+
+void sha256_mb_sse2(const std::uint8_t* const* data, const std::size_t* sizes, std::size_t count,
+                    std::uint8_t (*digests)[32], std::size_t* order);
+void sha256_mb_avx2(const std::uint8_t* const* data, const std::size_t* sizes, std::size_t count,
+                    std::uint8_t (*digests)[32], std::size_t* order);
+void sha256_mb_avx512(const std::uint8_t* const* data, const std::size_t* sizes, std::size_t count,
+                      std::uint8_t (*digests)[32], std::size_t* order);
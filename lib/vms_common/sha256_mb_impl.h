@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+// Lane-generic SHA-256 shared by the SIMD backends. Every backend includes
+// this file after defining its vector traits: everything lives in an
+// anonymous namespace, so code compiled for one instruction set can never
+// be picked by the linker for another translation unit.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+  constexpr std::uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+  };
+
+  constexpr std::uint32_t sha256_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+  };
+
+  inline std::uint32_t load_be32(const std::uint8_t* p)
+  {
+    return (static_cast<std::uint32_t>(p[0]) << 24) | (static_cast<std::uint32_t>(p[1]) << 16)
+        | (static_cast<std::uint32_t>(p[2]) << 8) | static_cast<std::uint32_t>(p[3]);
+  }
+
+  inline void store_be32(std::uint8_t* p, std::uint32_t v)
+  {
+    p[0] = static_cast<std::uint8_t>(v >> 24);
+    p[1] = static_cast<std::uint8_t>(v >> 16);
+    p[2] = static_cast<std::uint8_t>(v >> 8);
+    p[3] = static_cast<std::uint8_t>(v);
+  }
+
+  // Number of 64-byte blocks of the padded message.
+  inline std::size_t padded_blocks(std::size_t size)
+  {
+    return (size + 9 + 63) / 64;
+  }
+
+  // Writes the 16 big-endian words of block `b` of the padded message.
+  inline void message_block(const std::uint8_t* data, std::size_t size, std::size_t b, std::uint32_t* words)
+  {
+    const std::size_t begin = b * 64;
+    if (begin + 64 <= size)
+    {
+      for (int t = 0; t < 16; ++t)
+      {
+        words[t] = load_be32(data + begin + 4 * t);
+      }
+      return;
+    }
+
+    std::uint8_t tail[64];
+    std::memset(tail, 0, sizeof(tail));
+    if (begin < size)
+    {
+      std::memcpy(tail, data + begin, size - begin);
+    }
+    if (begin <= size)
+    {
+      tail[size - begin] = 0x80;
+    }
+    if (b + 1 == padded_blocks(size))
+    {
+      const std::uint64_t bits = static_cast<std::uint64_t>(size) * 8;
+      for (int i = 0; i < 8; ++i)
+      {
+        tail[56 + i] = static_cast<std::uint8_t>(bits >> (56 - 8 * i));
+      }
+    }
+    for (int t = 0; t < 16; ++t)
+    {
+      words[t] = load_be32(tail + 4 * t);
+    }
+  }
+
+  template <typename T>
+  inline typename T::V big_sigma0(typename T::V x)
+  {
+    return T::xor3(T::template rotr<2>(x), T::template rotr<13>(x), T::template rotr<22>(x));
+  }
+
+  template <typename T>
+  inline typename T::V big_sigma1(typename T::V x)
+  {
+    return T::xor3(T::template rotr<6>(x), T::template rotr<11>(x), T::template rotr<25>(x));
+  }
+
+  template <typename T>
+  inline typename T::V small_sigma0(typename T::V x)
+  {
+    return T::xor3(T::template rotr<7>(x), T::template rotr<18>(x), T::template shr<3>(x));
+  }
+
+  template <typename T>
+  inline typename T::V small_sigma1(typename T::V x)
+  {
+    return T::xor3(T::template rotr<17>(x), T::template rotr<19>(x), T::template shr<10>(x));
+  }
+
+  // One compression of every lane: state[i][lane] and block[t][lane].
+  template <typename T>
+  void compress_lanes(std::uint32_t (*state)[T::lanes], const std::uint32_t (*block)[T::lanes])
+  {
+    using V = typename T::V;
+
+    V w[16];
+    for (int t = 0; t < 16; ++t)
+    {
+      w[t] = T::load(block[t]);
+    }
+
+    V a = T::load(state[0]), b = T::load(state[1]), c = T::load(state[2]), d = T::load(state[3]);
+    V e = T::load(state[4]), f = T::load(state[5]), g = T::load(state[6]), h = T::load(state[7]);
+
+    for (int t = 0; t < 64; ++t)
+    {
+      if (t >= 16)
+      {
+        w[t & 15] = T::add(T::add(small_sigma1<T>(w[(t - 2) & 15]), w[(t - 7) & 15]),
+                           T::add(small_sigma0<T>(w[(t - 15) & 15]), w[t & 15]));
+      }
+      V ch = T::xor_(T::and_(e, f), T::andnot(e, g));
+      V maj = T::or_(T::and_(a, b), T::and_(c, T::or_(a, b)));
+      V t1 = T::add(T::add(T::add(h, big_sigma1<T>(e)), T::add(ch, T::set1(sha256_k[t]))), w[t & 15]);
+      V t2 = T::add(big_sigma0<T>(a), maj);
+      h = g;
+      g = f;
+      f = e;
+      e = T::add(d, t1);
+      d = c;
+      c = b;
+      b = a;
+      a = T::add(t1, t2);
+    }
+
+    T::store(state[0], T::add(a, T::load(state[0])));
+    T::store(state[1], T::add(b, T::load(state[1])));
+    T::store(state[2], T::add(c, T::load(state[2])));
+    T::store(state[3], T::add(d, T::load(state[3])));
+    T::store(state[4], T::add(e, T::load(state[4])));
+    T::store(state[5], T::add(f, T::load(state[5])));
+    T::store(state[6], T::add(g, T::load(state[6])));
+    T::store(state[7], T::add(h, T::load(state[7])));
+  }
+
+  // Hashes T::lanes messages at a time, picking them by increasing length
+  // so that the lanes of a group run for a similar number of blocks. Lanes
+  // whose message is shorter keep computing on padding once done: their
+  // digest was already taken after their last block.
+  template <typename T>
+  void hash_lanes(const std::uint8_t* const* data, const std::size_t* sizes, std::size_t count,
+                  std::uint8_t (*digests)[32], std::size_t* order)
+  {
+    constexpr std::size_t L = T::lanes;
+    alignas(64) std::uint32_t state[8][L];
+    alignas(64) std::uint32_t block[16][L];
+    std::uint32_t words[16];
+
+    for (std::size_t first = 0; first < count; first += L)
+    {
+      const std::size_t n = count - first < L ? count - first : L;
+      const std::size_t* lane = order + first;
+      std::size_t blocks[L];
+      std::size_t maxBlocks = 0;
+      for (std::size_t j = 0; j < L; ++j)
+      {
+        blocks[j] = j < n ? padded_blocks(sizes[lane[j]]) : 0;
+        maxBlocks = blocks[j] > maxBlocks ? blocks[j] : maxBlocks;
+        for (int i = 0; i < 8; ++i)
+        {
+          state[i][j] = sha256_iv[i];
+        }
+      }
+
+      for (std::size_t b = 0; b < maxBlocks; ++b)
+      {
+        for (std::size_t j = 0; j < L; ++j)
+        {
+          if (b >= blocks[j])
+          {
+            continue;  // stale data, the lane is already done
+          }
+          const std::uint8_t* msg = data[lane[j]];
+          const std::size_t size = sizes[lane[j]];
+          if ((b + 1) * 64 <= size)
+          {
+            const std::uint8_t* p = msg + b * 64;
+            for (int t = 0; t < 16; ++t)
+            {
+              block[t][j] = load_be32(p + 4 * t);
+            }
+          }
+          else
+          {
+            message_block(msg, size, b, words);
+            for (int t = 0; t < 16; ++t)
+            {
+              block[t][j] = words[t];
+            }
+          }
+        }
+
+        compress_lanes<T>(state, block);
+
+        for (std::size_t j = 0; j < n; ++j)
+        {
+          if (b + 1 == blocks[j])
+          {
+            for (int i = 0; i < 8; ++i)
+            {
+              store_be32(digests[lane[j]] + 4 * i, state[i][j]);
+            }
+          }
+        }
+      }
+    }
+  }
+}  // namespace
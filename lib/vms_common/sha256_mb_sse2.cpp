@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include "sha256_mb_backends.h"
+
+#include <emmintrin.h>
+
+#include "sha256_mb_impl.h"
+
+namespace
+{
+  struct Sse2Lanes
+  {
+    using V = __m128i;
+    static constexpr std::size_t lanes = 4;
+
+    static V load(const std::uint32_t* p) { return _mm_load_si128(reinterpret_cast<const V*>(p)); }
+    static void store(std::uint32_t* p, V v) { _mm_store_si128(reinterpret_cast<V*>(p), v); }
+    static V set1(std::uint32_t x) { return _mm_set1_epi32(static_cast<int>(x)); }
+    static V add(V a, V b) { return _mm_add_epi32(a, b); }
+    static V xor_(V a, V b) { return _mm_xor_si128(a, b); }
+    static V xor3(V a, V b, V c) { return _mm_xor_si128(_mm_xor_si128(a, b), c); }
+    static V and_(V a, V b) { return _mm_and_si128(a, b); }
+    static V or_(V a, V b) { return _mm_or_si128(a, b); }
+    static V andnot(V a, V b) { return _mm_andnot_si128(a, b); }
+    template <int N> static V shr(V x) { return _mm_srli_epi32(x, N); }
+    template <int N> static V rotr(V x) { return _mm_or_si128(_mm_srli_epi32(x, N), _mm_slli_epi32(x, 32 - N)); }
+  };
+}  // namespace
+
+void sha256_mb_sse2(const std::uint8_t* const* data, const std::size_t* sizes, std::size_t count,
+                    std::uint8_t (*digests)[32], std::size_t* order)
+{
+  hash_lanes<Sse2Lanes>(data, sizes, count, digests, order);
+}
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <sha_from_dir/dir_walker.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+namespace
+{
+  // Room for a few hundred entries per getdents64() call.
+  constexpr std::size_t direntBufferSize = 64 * 1024;
+
+  constexpr unsigned statxMask = STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_INO | STATX_NLINK | STATX_MTIME
+                                 | STATX_CTIME;
+
+  // Record layout of getdents64(), not exported by every libc.
+  struct LinuxDirent64
+  {
+    std::uint64_t d_ino;
+    std::int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+  };
+
+  std::int64_t to_ns(const struct statx_timestamp& ts)
+  {
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
+  bool is_dot(const char* name)
+  {
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+  }
+
+  // The order key of an entry: its parent's key followed by its position in
+  // the listing, big-endian so that the keys compare as bytes.
+  void order_key(std::string& order, const std::string& parent, std::uint32_t position)
+  {
+    order.assign(parent);
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+      order.push_back(static_cast<char>(position >> shift));
+    }
+  }
+}  // namespace
+
+DirWalker::DirWalker(std::filesystem::path root, std::string prefix, unsigned threads)
+    : root_(std::move(root)), prefix_(std::move(prefix)), threads_(std::max(threads, 1u))
+{
+}
+
+DirWalker::~DirWalker()
+{
+  if (rootFd_ >= 0)
+  {
+    close(rootFd_);
+  }
+}
+
+bool DirWalker::open()
+{
+  rootFd_ = ::open(root_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (rootFd_ < 0)
+  {
+    std::cerr << "Error! Cannot open directory " << root_ << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool DirWalker::fail(const std::string& what)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!failed_)
+  {
+    std::cerr << "Error! " << what << std::endl;
+  }
+  failed_ = true;
+  return false;
+}
+
+// Lists one directory: files go to the sink, subdirectories to pending_.
+bool DirWalker::list(const DirNode& node, const FileSink& sink, std::vector<char>& buffer, std::string& name,
+                     std::string& order)
+{
+  const char* relative = node.name.size() > prefix_.size() ? node.name.c_str() + prefix_.size() : ".";
+  int fd = openat(rootFd_, relative, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return fail("Cannot open directory " + (root_ / relative).string() + ": " + std::strerror(errno));
+  }
+
+  std::uint32_t position = 0;
+  bool ok = true;
+  while (ok)
+  {
+    long n = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n < 0)
+    {
+      ok = fail("Cannot read directory " + (root_ / relative).string() + ": " + std::strerror(errno));
+      break;
+    }
+    if (n == 0)
+    {
+      break;
+    }
+
+    for (long offset = 0; offset < n && ok; )
+    {
+      const auto* entry = reinterpret_cast<const LinuxDirent64*>(buffer.data() + offset);
+      offset += entry->d_reclen;
+      const char* entryName = entry->d_name;
+      if (is_dot(entryName))
+      {
+        continue;
+      }
+
+      unsigned char type = entry->d_type;
+      if (type != DT_DIR && type != DT_REG && type != DT_LNK && type != DT_UNKNOWN)
+      {
+        continue;  // fifos, sockets, devices
+      }
+      struct statx stx;
+      if (type != DT_DIR)
+      {
+        // Links are described by their target, like is_regular_file() does.
+        int flags = type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW;
+        int res = statx(fd, entryName, flags, statxMask, &stx);
+        if (res == 0 && type == DT_UNKNOWN && S_ISLNK(stx.stx_mode))
+        {
+          res = statx(fd, entryName, 0, statxMask, &stx);
+        }
+        else if (res == 0 && type == DT_UNKNOWN && S_ISDIR(stx.stx_mode))
+        {
+          type = DT_DIR;
+        }
+        if (res != 0)
+        {
+          // Deleted since it was listed, or a dangling link: not a file.
+          if (errno == ENOENT)
+          {
+            continue;
+          }
+          ok = fail("Cannot stat " + (root_ / relative / entryName).string() + ": " + std::strerror(errno));
+          break;
+        }
+      }
+
+      name.assign(node.name).append(entryName);
+      if (type == DT_DIR)
+      {
+        order_key(order, node.order, position++);
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          pending_.push_back(DirNode{name + '/', order});
+        }
+        wake_.notify_one();
+        continue;
+      }
+      if (!S_ISREG(stx.stx_mode))
+      {
+        continue;
+      }
+      order_key(order, node.order, position++);
+
+      ScannedFile file;
+      file.name = name;
+      file.path = name.c_str() + prefix_.size();
+      file.order = order;
+      file.key = CacheKey{static_cast<std::uint64_t>(makedev(stx.stx_dev_major, stx.stx_dev_minor)), stx.stx_ino,
+                          stx.stx_size, to_ns(stx.stx_mtime), to_ns(stx.stx_ctime)};
+      file.links = stx.stx_nlink;
+      if (!sink(file))
+      {
+        ok = false;
+        break;
+      }
+    }
+  }
+  close(fd);
+  return ok;
+}
+
+void DirWalker::crawl(const FileSink& sink)
+{
+  std::vector<char> buffer(direntBufferSize);
+  std::string name;
+  std::string order;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true)
+  {
+    wake_.wait(lock, [this] { return stopped_ || !pending_.empty() || busy_ == 0; });
+    if (stopped_ || pending_.empty())
+    {
+      break;
+    }
+    // Depth first: the most recently found directory is listed next.
+    DirNode node = std::move(pending_.back());
+    pending_.pop_back();
+    ++busy_;
+    lock.unlock();
+    bool ok = list(node, sink, buffer, name, order);
+    lock.lock();
+    --busy_;
+    stopped_ = stopped_ || !ok;
+    if (stopped_ || (pending_.empty() && busy_ == 0))
+    {
+      wake_.notify_all();
+    }
+  }
+}
+
+bool DirWalker::walk(const FileSink& sink)
+{
+  pending_.assign(1, DirNode{prefix_, {}});
+  busy_ = 0;
+  stopped_ = false;
+
+  std::vector<std::thread> crawlers;
+  crawlers.reserve(threads_ - 1);
+  for (unsigned i = 1; i < threads_; ++i)
+  {
+    crawlers.emplace_back([this, &sink]() { crawl(sink); });
+  }
+  crawl(sink);
+  for (auto& t : crawlers)
+  {
+    t.join();
+  }
+  return !stopped_;
+}
@@ -0,0 +1,487 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <sha_from_dir/hash_cache.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+  constexpr char cacheMagic[8] = {'V', 'M', 'S', 'H', 'C', 'A', 'C', 'H'};
+  constexpr std::uint32_t cacheVersion = 3;
+
+  struct CacheHeader
+  {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t recordSize;
+    std::uint64_t count;
+    char algorithm[16];
+    std::uint8_t reserved[24];
+  };
+
+  // A record is the CacheKey followed by the digest, digest_size() bytes
+  // for the algorithm of the cache: records are not aligned and are read
+  // with memcpy().
+  constexpr std::size_t keySize = sizeof(CacheKey);
+
+  static_assert(sizeof(CacheHeader) == 64);
+  static_assert(keySize == 40);
+
+  std::size_t record_size(DigestAlgorithm algorithm)
+  {
+    return keySize + digest_size(algorithm);
+  }
+
+  CacheKey key_at(const std::uint8_t* record)
+  {
+    CacheKey key;
+    std::memcpy(&key, record, keySize);
+    return key;
+  }
+
+  bool key_less(std::uint64_t dev_a, std::uint64_t ino_a, std::uint64_t dev_b, std::uint64_t ino_b)
+  {
+    return dev_a != dev_b ? dev_a < dev_b : ino_a < ino_b;
+  }
+
+  // Records added before a batch is sorted and spilled: about 13 MiB.
+  constexpr std::size_t batchRecords = 128 * 1024;
+  constexpr std::size_t writeBufferSize = 1024 * 1024;
+
+  // Sorted records read one at a time from a spilled batch, or from memory.
+  class RecordCursor
+  {
+  public:
+    RecordCursor(const std::filesystem::path& path, std::size_t recordSize)
+        : record_(recordSize), buffer_(std::make_unique<char[]>(writeBufferSize))
+    {
+      in_.rdbuf()->pubsetbuf(buffer_.get(), writeBufferSize);
+      in_.open(path, std::ios::binary);
+    }
+
+    RecordCursor(const std::uint8_t* data, std::size_t size, std::size_t recordSize)
+        : record_(recordSize), memory_(true), data_(data), end_(data + size)
+    {
+    }
+
+    bool good() const { return memory_ || in_.is_open(); }
+    // A spilled batch ended with a partial record or a read error.
+    bool failed() const { return failed_; }
+
+    // Loads the next record; false at the end.
+    bool next()
+    {
+      if (memory_)
+      {
+        if (data_ == end_)
+        {
+          return false;
+        }
+        current_ = data_;
+        data_ += record_.size();
+        return true;
+      }
+      if (!in_.read(reinterpret_cast<char*>(record_.data()), static_cast<std::streamsize>(record_.size())))
+      {
+        failed_ = in_.gcount() != 0 || in_.bad();
+        return false;
+      }
+      current_ = record_.data();
+      return true;
+    }
+
+    const std::uint8_t* record() const { return current_; }
+
+  private:
+    std::vector<std::uint8_t> record_;
+    std::unique_ptr<char[]> buffer_;
+    std::ifstream in_;
+    bool memory_ = false;
+    const std::uint8_t* data_ = nullptr;
+    const std::uint8_t* end_ = nullptr;
+    const std::uint8_t* current_ = nullptr;
+    bool failed_ = false;
+  };
+
+  // Locks the directory holding the cache rather than a lock file beside
+  // it, so no stray file is left next to the logs.
+  class DirLock
+  {
+  public:
+    explicit DirLock(const std::filesystem::path& dir)
+    {
+      fd_ = open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (fd_ >= 0 && flock(fd_, LOCK_EX) != 0)
+      {
+        close(fd_);
+        fd_ = -1;
+      }
+    }
+    ~DirLock()
+    {
+      if (fd_ >= 0)
+      {
+        flock(fd_, LOCK_UN);
+        close(fd_);
+      }
+    }
+    bool locked() const { return fd_ >= 0; }
+    bool sync() const { return fsync(fd_) == 0; }
+
+  private:
+    int fd_ = -1;
+  };
+
+  bool write_all(int fd, const void* data, std::size_t size)
+  {
+    const auto* p = static_cast<const std::uint8_t*>(data);
+    while (size > 0)
+    {
+      ssize_t n = write(fd, p, size);
+      if (n < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        return false;
+      }
+      p += n;
+      size -= static_cast<std::size_t>(n);
+    }
+    return true;
+  }
+}  // namespace
+
+HashCache::HashCache(std::filesystem::path path, DigestAlgorithm algorithm)
+    : path_(std::move(path)), algorithm_(algorithm)
+{
+}
+
+HashCache::~HashCache()
+{
+  remove_spilled();
+  if (map_)
+  {
+    munmap(map_, mapSize_);
+  }
+}
+
+void HashCache::load()
+{
+  int fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(CacheHeader))
+  {
+    close(fd);
+    std::cerr << "Warning: ignoring invalid cache " << path_ << std::endl;
+    return;
+  }
+
+  std::size_t size = static_cast<std::size_t>(st.st_size);
+  void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    std::cerr << "Warning: unable to map cache " << path_ << std::endl;
+    return;
+  }
+
+  const auto* header = static_cast<const CacheHeader*>(map);
+  const std::size_t recordSize = record_size(algorithm_);
+  if (std::memcmp(header->magic, cacheMagic, sizeof(cacheMagic)) == 0 && header->version < cacheVersion)
+  {
+    // Older layout: the files are hashed again and the cache rewritten.
+    munmap(map, size);
+    std::cerr << "Warning: ignoring cache " << path_ << " from an older version" << std::endl;
+    return;
+  }
+  if (std::memcmp(header->magic, cacheMagic, sizeof(cacheMagic)) != 0
+      || header->version != cacheVersion
+      || header->count > (size - sizeof(CacheHeader)) / recordSize
+      || sizeof(CacheHeader) + header->count * recordSize != size)
+  {
+    munmap(map, size);
+    std::cerr << "Warning: ignoring invalid cache " << path_ << std::endl;
+    return;
+  }
+  if (std::strncmp(header->algorithm, digest_name(algorithm_), sizeof(header->algorithm)) != 0
+      || header->recordSize != recordSize)
+  {
+    munmap(map, size);
+    std::cerr << "Warning: ignoring cache " << path_ << " (not a " << digest_name(algorithm_) << " cache)" << std::endl;
+    return;
+  }
+
+  map_ = map;
+  mapSize_ = size;
+  count_ = header->count;
+  madvise(map_, mapSize_, MADV_RANDOM);
+}
+
+const std::uint8_t* HashCache::record(std::uint64_t i) const
+{
+  return static_cast<const std::uint8_t*>(map_) + sizeof(CacheHeader) + i * record_size(algorithm_);
+}
+
+const std::uint8_t* HashCache::lookup(const CacheKey& key) const
+{
+  if (!map_)
+  {
+    return nullptr;
+  }
+
+  // Binary search over the records, which are not addressable as an array
+  // of structs.
+  std::uint64_t lo = 0;
+  std::uint64_t hi = count_;
+  while (lo < hi)
+  {
+    const std::uint64_t mid = lo + (hi - lo) / 2;
+    const CacheKey k = key_at(record(mid));
+    if (key_less(k.dev, k.ino, key.dev, key.ino))
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  if (lo == count_)
+  {
+    return nullptr;
+  }
+  const std::uint8_t* r = record(lo);
+  const CacheKey found = key_at(r);
+  if (found.dev != key.dev || found.ino != key.ino || found.size != key.size || found.mtimeNs != key.mtimeNs
+      || found.ctimeNs != key.ctimeNs)
+  {
+    return nullptr;
+  }
+  return r + keySize;
+}
+
+std::vector<std::uint8_t> HashCache::take_batch()
+{
+  std::sort(batch_.begin(), batch_.end(), [](const auto& a, const auto& b)
+  {
+    return key_less(a.first.dev, a.first.ino, b.first.dev, b.first.ino);
+  });
+  // A file seen under several names (hard links) is recorded once.
+  batch_.erase(std::unique(batch_.begin(), batch_.end(),
+                           [](const auto& a, const auto& b) { return a.first.dev == b.first.dev && a.first.ino == b.first.ino; }),
+               batch_.end());
+
+  const std::size_t recordSize = record_size(algorithm_);
+  std::vector<std::uint8_t> out(batch_.size() * recordSize);
+  std::uint8_t* p = out.data();
+  for (const auto& [key, digest] : batch_)
+  {
+    std::memcpy(p, &key, keySize);
+    std::memcpy(p + keySize, digest.data(), recordSize - keySize);
+    p += recordSize;
+  }
+  batch_.clear();
+  return out;
+}
+
+// Writes the current batch, sorted, to a new file beside the cache.
+bool HashCache::spill()
+{
+  std::filesystem::path path = path_;
+  path += ".run" + std::to_string(spilled_.size()) + "." + std::to_string(getpid());
+  spilled_.push_back(path);
+
+  const std::vector<std::uint8_t> records = take_batch();
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool ok = fd >= 0 && write_all(fd, records.data(), records.size());
+  if (fd >= 0)
+  {
+    ok = (close(fd) == 0) && ok;
+  }
+  if (!ok)
+  {
+    std::cerr << "Error! Unable to write " << path << std::endl;
+    failed_ = true;
+  }
+  return ok;
+}
+
+bool HashCache::add(const CacheKey& key, const std::uint8_t* digest)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (failed_)
+  {
+    return false;
+  }
+  batch_.emplace_back(key, CachedDigest{});
+  std::memcpy(batch_.back().second.data(), digest, digest_size(algorithm_));
+  if (batch_.size() >= batchRecords)
+  {
+    return spill();
+  }
+  return true;
+}
+
+bool HashCache::save(bool merge)
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (failed_)
+  {
+    return false;
+  }
+  DirLock lock(path_.parent_path());
+  if (!lock.locked())
+  {
+    std::cerr << "Error! Unable to lock cache " << path_ << std::endl;
+    return false;
+  }
+
+  const std::size_t recordSize = record_size(algorithm_);
+  // The spilled batches, then the last one still in memory, then with
+  // `merge` the cache on disk; on equal inodes the first source wins.
+  std::vector<std::unique_ptr<RecordCursor>> sources;
+  for (const auto& path : spilled_)
+  {
+    sources.push_back(std::make_unique<RecordCursor>(path, recordSize));
+    if (!sources.back()->good())
+    {
+      std::cerr << "Error! Unable to read " << path << std::endl;
+      return false;
+    }
+  }
+  const std::vector<std::uint8_t> last = take_batch();
+  sources.push_back(std::make_unique<RecordCursor>(last.data(), last.size(), recordSize));
+
+  // Reload under the lock: another process may have saved in the meantime.
+  HashCache current(path_, algorithm_);
+  if (merge)
+  {
+    current.load();
+    if (current.map_)
+    {
+      sources.push_back(std::make_unique<RecordCursor>(current.record(0), current.count_ * recordSize, recordSize));
+    }
+  }
+
+  std::filesystem::path tmpPath = path_;
+  tmpPath += ".tmp." + std::to_string(getpid());
+  int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    std::cerr << "Error! Cannot open " << tmpPath << " for writing" << std::endl;
+    return false;
+  }
+
+  CacheHeader header{};
+  std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+  header.version = cacheVersion;
+  header.recordSize = static_cast<std::uint32_t>(recordSize);
+  std::strncpy(header.algorithm, digest_name(algorithm_), sizeof(header.algorithm) - 1);
+  bool ok = write_all(fd, &header, sizeof(header));
+
+  // K-way merge; the count in the header is only known at the end.
+  auto later = [&sources](std::size_t a, std::size_t b)
+  {
+    const CacheKey ka = key_at(sources[a]->record());
+    const CacheKey kb = key_at(sources[b]->record());
+    if (ka.dev != kb.dev || ka.ino != kb.ino)
+    {
+      return key_less(kb.dev, kb.ino, ka.dev, ka.ino);
+    }
+    return b < a;
+  };
+  std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(later)> heads(later);
+  for (std::size_t i = 0; i < sources.size(); ++i)
+  {
+    if (sources[i]->next())
+    {
+      heads.push(i);
+    }
+  }
+  std::vector<std::uint8_t> out;
+  out.reserve(writeBufferSize);
+  bool any = false;
+  CacheKey previous;
+  while (!heads.empty() && ok)
+  {
+    const std::size_t i = heads.top();
+    heads.pop();
+    const std::uint8_t* r = sources[i]->record();
+    const CacheKey key = key_at(r);
+    if (!any || key.dev != previous.dev || key.ino != previous.ino)
+    {
+      out.insert(out.end(), r, r + recordSize);
+      ++header.count;
+      previous = key;
+      any = true;
+      if (out.size() >= writeBufferSize)
+      {
+        ok = write_all(fd, out.data(), out.size());
+        out.clear();
+      }
+    }
+    if (sources[i]->next())
+    {
+      heads.push(i);
+    }
+  }
+  for (const auto& source : sources)
+  {
+    ok = ok && !source->failed();
+  }
+
+  ok = ok && write_all(fd, out.data(), out.size())
+      && pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))
+      && fsync(fd) == 0;
+  ok = (close(fd) == 0) && ok;
+  sources.clear();
+  remove_spilled();
+  if (!ok || rename(tmpPath.c_str(), path_.c_str()) != 0)
+  {
+    std::cerr << "Error! Unable to write cache " << path_ << std::endl;
+    unlink(tmpPath.c_str());
+    return false;
+  }
+  // The rename itself is only durable once the directory is.
+  if (!lock.sync())
+  {
+    std::cerr << "Error! Unable to sync the directory of cache " << path_ << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+void HashCache::remove_spilled()
+{
+  for (const auto& path : spilled_)
+  {
+    unlink(path.c_str());
+  }
+  spilled_.clear();
+}
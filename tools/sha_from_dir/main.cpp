@@ -9,10 +9,12 @@
 #include <vector>
 #include <filesystem>
 #include <iostream>
+#include <optional>
 #include <system_error>
 
 #include <sha_from_dir/options.h>
 #include <sha_from_dir/process.h>
+#include <vms_common/scheduler.h>
 
 int main(int argc, char* argv[])
 {
@@ -75,11 +77,30 @@ int main(int argc, char* argv[])
     return EXIT_FAILURE;
   }
 
-  DirProcessor processor;
-  bool ok = true;
-  for (const auto& tarPath : dir_list) 
+  // Progress bars redraw the same terminal lines: with several directories
+  // in flight they would overwrite each other, so only plain lines are kept.
+  if (options.parallelItems > 1 && dir_list.size() > 1)
   {
-    ok &= processor.process(tarPath, logPath, options.sortEntries);
+    options.showProgress = false;
+  }
+
+  std::optional<StatsReport> stats;
+  if (options.statsPath)
+  {
+    stats.emplace("sha_from_dir");
+  }
+
+  DirProcessor processor(options, stats ? &*stats : nullptr);
+  ItemScheduler scheduler(options.parallelItems, options.perDevice);
+  bool ok = scheduler.run(dir_list, [&processor, &logPath](const std::filesystem::path& dirPath)
+  {
+    return processor.process(dirPath, logPath);
+  });
+
+  // Written even after a failure: that is when it is most useful.
+  if (stats && !stats->write(*options.statsPath))
+  {
+    ok = false;
   }
 
   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
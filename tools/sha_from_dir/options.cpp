@@ -6,6 +6,8 @@
  */
 
 #include <sha_from_dir/options.h>
+#include <vms_common/cli.h>
+#include <vms_common/digest.h>
 
 #include <filesystem>
 #include <iostream>
@@ -19,16 +21,49 @@ void OptionsParser::print_usage(std::ostream& os) const
   os << "sha-from-dir — by Manuel Virgilio" << std::endl;
   os << "Compute SHA-256 for files in a directory or for each subdirectory within a container." << std::endl;
   os << "Usage:" << std::endl;
-  os << "  sha_from_dir [-d] [-O <dir>] [-s] [-h] <path>" << std::endl;
+  os << "  sha_from_dir [-d] [-O <dir>] [-s] [--sort-memory <MiB>] [-j <n>] [-P <n>] [--per-device <n>] [-i] [--cache <file>] [--algo <list>] [--combined] [--verify <manifest> [--fail-fast]] [--stats <file>] [--resume] [--read-mode <mode>] [--order <order>] [--dedup-extents] [--tree-hash [--tree-chunk <MiB>] [--tree-sidecar]] [--io-uring [--io-depth <n>] [--io-buffer <KiB>]] [-h] <path>" << std::endl;
   os << "Options:" << std::endl;
   os << "  -d            Treat <path> as a single directory (default: treat it as a container of directories)" << std::endl;
-  os << "  -O <dir>      Directory where .sha256 logs are written (default: <path>)" << std::endl;
+  os << "  -O <dir>      Directory where the .<algo> logs are written (default: <path>)" << std::endl;
   os << "  -s            Sort entries alphabetically in each log" << std::endl;
+  os << "  --sort-memory <MiB>  Memory for the log entries sorted by name with -s, or by walk order without" << std::endl;
+  os << "                it, before they are spilled to disk in runs (default: 256)" << std::endl;
+  os << "  -j <n>        Hash up to <n> files in parallel (0: one per CPU, default: 1)" << std::endl;
+  os << "  -P <n>        Process up to <n> directories at once (0: one per CPU, default: 1)" << std::endl;
+  os << "  --per-device <n>  Process at most <n> directories at once on the same device (default: 1)" << std::endl;
+  os << "  -i            Skip files whose inode, size, mtime and ctime match the cache kept beside the log" << std::endl;
+  os << "  --cache <file>    Like -i, using <file> as cache (may be shared by several runs)" << std::endl;
+  os << "  --algo <list> Comma separated digest algorithms, computed in a single pass, one log each named after" << std::endl;
+  os << "                the algorithm: " << available_digests() << " (default: sha256)" << std::endl;
+  os << "  --combined    Write a single <name>.digests log in BSD tag format instead of one log per algorithm" << std::endl;
+  os << "  --verify <manifest>  Check the files against <manifest> instead of writing a log;" << std::endl;
+  os << "                if <manifest> is a directory, <manifest>/<name>.<algo> is used for each directory" << std::endl;
+  os << "  --fail-fast   With --verify, stop at the first missing, extra or mismatching file" << std::endl;
+  os << "  --stats <file> Write timings, counters, read sizes and the slowest files of each directory to <file> as JSON" << std::endl;
+  os << "  --resume      Continue an interrupted run: files it journaled in <name>.journal, beside the logs," << std::endl;
+  os << "                are not hashed again unless they changed" << std::endl;
+  os << "  --read-mode <mode>  How files are read: buffered (read() through the page cache), fadvise (sequential" << std::endl;
+  os << "                read() dropping the pages behind it from the cache), mmap (MADV_SEQUENTIAL mappings, no" << std::endl;
+  os << "                copy) or direct (O_DIRECT, bypassing the cache) (default: buffered)" << std::endl;
+  os << "  --order <order>  Order in which files are read: size (largest first), inode, or extent (first" << std::endl;
+  os << "                physical block, via FIEMAP) to limit seeks on rotational disks; the logs keep" << std::endl;
+  os << "                the walk order (default: size)" << std::endl;
+  os << "  --dedup-extents  Hash reflinked copies once, like hard links: files whose extents are all shared" << std::endl;
+  os << "                and the same (FIEMAP) take the digests of the first one" << std::endl;
+  os << "  --tree-hash   Hash files as chunks, several workers on the chunks of a large file, and log the root" << std::endl;
+  os << "                of their digests in <name>.<algo>-tree<MiB>m logs instead of plain digests" << std::endl;
+  os << "  --tree-chunk <MiB>  With --tree-hash, size of the chunks (default: 64)" << std::endl;
+  os << "  --tree-sidecar  With --tree-hash, also write the chunk digests to <name>-tree<MiB>m.chunks" << std::endl;
+  os << "  --io-uring    Read files asynchronously through io_uring, several at once per worker" << std::endl;
+  os << "                (falls back to blocking reads where io_uring is not available)" << std::endl;
+  os << "  --io-depth <n>    With --io-uring, files read at once by each worker (default: 32)" << std::endl;
+  os << "  --io-buffer <KiB> With --io-uring, size of each read (default: 256)" << std::endl;
   os << "  -h, --help    Show this help message" << std::endl;
 }
 
 bool OptionsParser::parse(int argc, char* argv[], Options& out) const
 {
+  bool chunkGiven = false;
   for (int i = 1; i < argc; ++i)
   {
     std::string_view arg{argv[i]};
@@ -62,6 +97,264 @@ bool OptionsParser::parse(int argc, char* argv[], Options& out) const
       continue;
     }
 
+    if (arg == "--sort-memory")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --sort-memory requires a number" << std::endl;
+        return false;
+      }
+      if (!parse_unsigned(arg, argv[++i], out.sortMemoryMiB))
+      {
+        return false;
+      }
+      if (out.sortMemoryMiB == 0)
+      {
+        std::cerr << "Error: --sort-memory must be greater than 0" << std::endl;
+        return false;
+      }
+      continue;
+    }
+
+    if (arg == "-j")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: -j requires a number" << std::endl;
+        return false;
+      }
+      if (!parse_thread_count(arg, argv[++i], out.jobs))
+      {
+        return false;
+      }
+      continue;
+    }
+
+    if (arg == "-P")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: -P requires a number" << std::endl;
+        return false;
+      }
+      if (!parse_thread_count(arg, argv[++i], out.parallelItems))
+      {
+        return false;
+      }
+      continue;
+    }
+
+    if (arg == "--per-device")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --per-device requires a number" << std::endl;
+        return false;
+      }
+      if (!parse_thread_count(arg, argv[++i], out.perDevice))
+      {
+        return false;
+      }
+      continue;
+    }
+
+    if (arg == "-i")
+    {
+      out.incremental = true;
+      continue;
+    }
+
+    if (arg == "--cache")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --cache requires a path" << std::endl;
+        return false;
+      }
+      out.incremental = true;
+      out.cachePath = fs::path{argv[++i]};
+      continue;
+    }
+
+    if (arg == "--algo")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --algo requires a list of names" << std::endl;
+        return false;
+      }
+      if (!parse_digest_algorithms(arg, argv[++i], out.algorithms))
+      {
+        return false;
+      }
+      continue;
+    }
+
+    if (arg == "--combined")
+    {
+      out.combinedLog = true;
+      continue;
+    }
+
+    if (arg == "--verify")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --verify requires a path" << std::endl;
+        return false;
+      }
+      out.verifyManifest = fs::path{argv[++i]};
+      continue;
+    }
+
+    if (arg == "--fail-fast")
+    {
+      out.failFast = true;
+      continue;
+    }
+
+    if (arg == "--stats")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --stats requires a path" << std::endl;
+        return false;
+      }
+      out.statsPath = fs::path{argv[++i]};
+      continue;
+    }
+
+    if (arg == "--resume")
+    {
+      out.resume = true;
+      continue;
+    }
+
+    if (arg == "--read-mode")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --read-mode requires a mode" << std::endl;
+        return false;
+      }
+      std::string_view mode{argv[++i]};
+      if (mode == "buffered")
+      {
+        out.readMode = ReadMode::buffered;
+      }
+      else if (mode == "fadvise")
+      {
+        out.readMode = ReadMode::fadvise;
+      }
+      else if (mode == "mmap")
+      {
+        out.readMode = ReadMode::mmap;
+      }
+      else if (mode == "direct")
+      {
+        out.readMode = ReadMode::direct;
+      }
+      else
+      {
+        std::cerr << "Error: unknown mode for --read-mode: " << mode << std::endl;
+        return false;
+      }
+      continue;
+    }
+
+    if (arg == "--order")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --order requires an order" << std::endl;
+        return false;
+      }
+      std::string_view order{argv[++i]};
+      if (order == "size")
+      {
+        out.readOrder = ReadOrder::size;
+      }
+      else if (order == "inode")
+      {
+        out.readOrder = ReadOrder::inode;
+      }
+      else if (order == "extent")
+      {
+        out.readOrder = ReadOrder::extent;
+      }
+      else
+      {
+        std::cerr << "Error: unknown order for --order: " << order << std::endl;
+        return false;
+      }
+      continue;
+    }
+
+    if (arg == "--dedup-extents")
+    {
+      out.dedupExtents = true;
+      continue;
+    }
+
+    if (arg == "--tree-hash")
+    {
+      out.treeHash = true;
+      continue;
+    }
+
+    if (arg == "--tree-chunk")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --tree-chunk requires a number" << std::endl;
+        return false;
+      }
+      if (!parse_unsigned(arg, argv[++i], out.treeChunkMiB))
+      {
+        return false;
+      }
+      chunkGiven = true;
+      if (out.treeChunkMiB == 0 || out.treeChunkMiB > 65536)
+      {
+        std::cerr << "Error: --tree-chunk must be between 1 and 65536" << std::endl;
+        return false;
+      }
+      continue;
+    }
+
+    if (arg == "--tree-sidecar")
+    {
+      out.treeSidecar = true;
+      continue;
+    }
+
+    if (arg == "--io-uring")
+    {
+      out.ioUring = true;
+      continue;
+    }
+
+    if (arg == "--io-depth" || arg == "--io-buffer")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: " << arg << " requires a number" << std::endl;
+        return false;
+      }
+      unsigned& value = arg == "--io-depth" ? out.ioDepth : out.ioBufferKiB;
+      if (!parse_unsigned(arg, argv[++i], value))
+      {
+        return false;
+      }
+      if (value == 0 || value > (arg == "--io-depth" ? 4096u : 65536u))
+      {
+        std::cerr << "Error: " << arg << " must be between 1 and " << (arg == "--io-depth" ? 4096 : 65536)
+                  << std::endl;
+        return false;
+      }
+      continue;
+    }
+
     if (!arg.empty() && arg.front() == '-')
     {
       std::cerr << "Unknown parameter: " << arg << std::endl;
@@ -83,5 +376,48 @@ bool OptionsParser::parse(int argc, char* argv[], Options& out) const
     return false;
   }
 
+  if (out.ioUring && out.readMode == ReadMode::mmap)
+  {
+    std::cerr << "Error: --read-mode mmap cannot be combined with --io-uring" << std::endl;
+    return false;
+  }
+
+  if (!out.treeHash && chunkGiven)
+  {
+    std::cerr << "Error: --tree-chunk requires --tree-hash" << std::endl;
+    return false;
+  }
+
+  if (out.treeSidecar && !out.treeHash)
+  {
+    std::cerr << "Error: --tree-sidecar requires --tree-hash" << std::endl;
+    return false;
+  }
+
+  // Chunks have their own queue and are read with pread().
+  if (out.treeHash && (out.ioUring || out.readMode == ReadMode::mmap || out.readOrder != ReadOrder::size))
+  {
+    std::cerr << "Error: --tree-hash cannot be combined with --io-uring, --read-mode mmap or --order" << std::endl;
+    return false;
+  }
+
+  // Files taken from the cache or the journal have no chunk digests.
+  if (out.treeSidecar && (out.incremental || out.resume || out.verifyManifest))
+  {
+    std::cerr << "Error: --tree-sidecar cannot be combined with -i, --cache, --resume or --verify" << std::endl;
+    return false;
+  }
+
+  if (out.resume && out.verifyManifest)
+  {
+    std::cerr << "Error: --resume cannot be combined with --verify" << std::endl;
+    return false;
+  }
+
+  if (out.algorithms.empty())
+  {
+    out.algorithms.push_back(DigestAlgorithm::sha256);
+  }
+
   return true;
 }
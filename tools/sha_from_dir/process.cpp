@@ -8,25 +8,98 @@
 #include <iostream>
 #include <vector>
 #include <filesystem>
-#include <fstream>
 #include <array>
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
 #include <sstream>
 #include <iomanip>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 
-#include <openssl/evp.h>
-#include <openssl/sha.h>
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <sha_from_dir/dir_walker.h>
+#include <sha_from_dir/hash_cache.h>
 #include <sha_from_dir/process.h>
+#include <sha_from_dir/tree_hash.h>
+#include <sha_from_dir/uring.h>
+#include <vms_common/aligned_buffer.h>
+#include <vms_common/digest.h>
+#include <vms_common/digest_log.h>
+#include <vms_common/journal.h>
+#include <vms_common/manifest.h>
+#include <vms_common/mapped_range.h>
+#include <vms_common/progress.h>
+#include <vms_common/run_stats.h>
+#include <vms_common/sha256_mb.h>
 
 namespace
 {
-  struct HashedEntry
+  struct TreeFile;
+
+  struct WorkItem
+  {
+    // As written in the log, NUL-terminated in `storage`.
+    std::string_view name;
+    // The part of `name` below the scanned directory, opened relative to it.
+    const char* path = nullptr;
+    // ScannedFile::order, in `storage`: the place of the entry in the log.
+    std::string_view order;
+    // digest_size(algorithms) bytes in `storage`.
+    std::uint8_t* digests = nullptr;
+    std::uint64_t size = 0;
+    CacheKey key;
+    // Inode or first physical block, with --order inode/extent.
+    std::uint64_t location = 0;
+    // First path of a DedupTable group: the others wait for its digests.
+    bool leader = false;
+    // The leader of the DedupTable group this path joined; only valid
+    // while the items are kept for --tree-sidecar.
+    const WorkItem* same = nullptr;
+    // With --tree-hash, where its chunk digests go.
+    std::unique_ptr<TreeFile> tree;
+    // The name, the order key and the digests, in a single allocation.
+    std::unique_ptr<char[]> storage;
+  };
+
+  // Journal key of a file: its CacheKey as is, which has no padding.
+  std::string_view journal_key(const CacheKey& key)
   {
-    std::string name;
-    std::string hash;
+    static_assert(sizeof(CacheKey) == 5 * sizeof(std::uint64_t));
+    return {reinterpret_cast<const char*>(&key), sizeof(key)};
+  }
+
+  // Closes a file descriptor when leaving the scope.
+  struct FileDescriptor
+  {
+    int fd = -1;
+
+    ~FileDescriptor()
+    {
+      if (fd >= 0)
+      {
+        close(fd);
+      }
+    }
   };
 
   /*
@@ -40,188 +113,2060 @@ namespace
 
   constexpr int bar_width = 50;
 
-  void print_progress(double percent)
+  const size_t chunkSize = 4 * 1024 * 1024;
+
+  // Directory listing threads, at least.
+  constexpr unsigned walker_threads = 4;
+
+  void print_progress(std::ostream& os, double percent)
   {
     int pos = static_cast<int>(bar_width * percent / 100.0);
-    
-    std::cerr << "\033[2K[";
+
+    os << "\033[2K[";
     for (int i = 0; i < bar_width; ++i)
     {
-        std::cerr << (i < pos ? '=' : (i == pos ? '>' : ' '));
+        os << (i < pos ? '=' : (i == pos ? '>' : ' '));
     }
-    std::cerr << "] ";
+    os << "] ";
   }
 
-  void print_file_status(uint32_t file_idx, uint32_t file_total, const std::filesystem::path& path)
+  void print_file_status(std::ostream& os, std::size_t file_idx, std::size_t file_total, std::string_view path)
   {
     double progress = file_idx > 0
         ? (100.0 * static_cast<double>(file_idx) / static_cast<double>(file_total))
         : 0.0;
 
-    if ( file_idx > 1 )
-    {
-        std::cerr << "\033[2A";
-    }
-
     // Line 1
-    std::cerr << "\r\033[K-->Processing " << path.string() << std::endl;
+    os << "\r\033[K-->Processing " << path << "\n";
 
     // Line 2
-    std::cerr << "\r\033[K";
-    print_progress(progress);
-    std::cerr << " " << file_idx << "/" << file_total << std::endl;
+    os << "\r\033[K";
+    print_progress(os, progress);
+    os << " " << file_idx << "/" << file_total << "\n";
   }
 
-  void print_data_status(uint64_t bytes_read, uint64_t bytes_total, bool first_call)
+  void print_data_status(std::ostream& os, uint64_t bytes_read, uint64_t bytes_total)
   {
     double progress = bytes_read > 0
         ? (100.0 * static_cast<double>(bytes_read) / static_cast<double>(bytes_total))
         : 0.0;
 
-    std::cerr << "\r";
-    if ( first_call )
+    os << "\r\033[K";
+    print_progress(os, progress);
+    os << " " << bytes_read << "/" << bytes_total << " bytes";
+  }
+
+  /*
+  Progress shared by all the workers: they only bump atomic counters, the
+  three status lines are redrawn by the renderer thread ten times a second.
+  The totals grow while the directory walk is still running.
+  */
+  class SharedProgress
+  {
+  public:
+    explicit SharedProgress(bool enabled)
+        : renderer_(enabled, [this](std::ostream& os) { draw(os); })
     {
-        std::cerr << "\033[K";
+        renderer_.start();
     }
-    print_progress(progress);
-    std::cerr << " " << bytes_read << "/" << bytes_total << " bytes";
-  }
 
-  const size_t chunkSize = 4 * 1024 * 1024;
-}  // namespace
+    void file_queued(std::uint64_t bytes)
+    {
+        file_total_.fetch_add(1, std::memory_order_relaxed);
+        bytes_total_.fetch_add(bytes, std::memory_order_relaxed);
+    }
 
-bool DirProcessor::process(const std::filesystem::path& scanDir, const std::filesystem::path& logPath,
-               bool sortEntries) const
-{
-    std::filesystem::path logFileName = scanDir.stem().string() + ".sha256";  
-    std::filesystem::path logFilePath = logPath / logFileName;
+    // The name is copied: the item may be gone by the next frame.
+    void file_started(const WorkItem& item)
+    {
+        files_started_.fetch_add(1, std::memory_order_relaxed);
+        if (renderer_.enabled())
+        {
+            std::lock_guard<std::mutex> lock(current_mutex_);
+            current_.assign(item.name);
+        }
+    }
 
-    std::vector<std::filesystem::path> path_list;
-    std::cout << "Scanning " << scanDir << "..." << std::flush;
-    try 
+    void add_bytes(std::uint64_t bytes)
     {
-      for (const auto& entry : std::filesystem::recursive_directory_iterator(scanDir))
-      {
-          if (entry.is_regular_file())
-          {
-              path_list.push_back(entry.path());
-          }
-      }
-    } 
-    catch (const std::filesystem::filesystem_error& e)
+        bytes_done_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void finish()
     {
-        std::cerr << std::endl << "Error: " << e.what() << std::endl;
-        return false;
+        renderer_.stop();
     }
-    std::cout << "Ok" << std::endl << std::flush;
-    
-    std::vector<HashedEntry> entries;
-    std::size_t file_count = 0;
-    for ( const auto&path : path_list )
+
+  private:
+    void draw(std::ostream& os)
     {
-        std::ifstream file(path, std::ios::binary);
-        if (!file)
+        std::lock_guard<std::mutex> lock(current_mutex_);
+        if (current_.empty())
         {
-            std::cerr << "Unable to open file: " << path << "\n";
-            return false;
+            return;
+        }
+        if (drawn_)
+        {
+            os << "\033[2A";
         }
+        drawn_ = true;
+        print_file_status(os, files_started_.load(std::memory_order_relaxed),
+                          file_total_.load(std::memory_order_relaxed), current_);
+        print_data_status(os, bytes_done_.load(std::memory_order_relaxed),
+                          bytes_total_.load(std::memory_order_relaxed));
+    }
+
+    std::atomic<std::size_t> file_total_{0};
+    std::atomic<std::uint64_t> bytes_total_{0};
+    std::atomic<std::size_t> files_started_{0};
+    std::mutex current_mutex_;
+    std::string current_;
+    std::atomic<std::uint64_t> bytes_done_{0};
+    // Only touched by the thread drawing.
+    bool drawn_ = false;
+    ProgressRenderer renderer_;
+  };
 
-        std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> mdctx(EVP_MD_CTX_new(),
-                                                                    &EVP_MD_CTX_free);
-        if (!mdctx)
+  // Physical offset of the first extent of a file, by FIEMAP. Files with
+  // none (empty, data inline in the inode) come first; where FIEMAP is not
+  // supported the inode number stands in for it.
+  std::uint64_t first_block(int dir_fd, const WorkItem& item)
+  {
+    FileDescriptor file{openat(dir_fd, item.path, O_RDONLY | O_CLOEXEC)};
+    if (file.fd < 0)
+    {
+        return item.key.ino;
+    }
+    alignas(struct fiemap) std::uint8_t request[sizeof(struct fiemap) + sizeof(struct fiemap_extent)] = {};
+    auto* map = reinterpret_cast<struct fiemap*>(request);
+    map->fm_length = FIEMAP_MAX_OFFSET;
+    map->fm_extent_count = 1;
+    if (ioctl(file.fd, FS_IOC_FIEMAP, map) != 0)
+    {
+        static std::once_flag warned;
+        std::call_once(warned, []
         {
-            std::cerr << "Unable to allocate SHA256 context for " << path.filename() << std::endl;
-            return false;
+            std::cerr << "FIEMAP not supported here, reading files in inode order" << std::endl;
+        });
+        return item.key.ino;
+    }
+    return map->fm_mapped_extents > 0 ? map->fm_extents[0].fe_physical : 0;
+  }
+
+  // Below this size reading a file costs about as much as mapping its
+  // extents: --dedup-extents leaves it alone.
+  constexpr std::uint64_t extentDedupMinSize = 64 * 1024;
+
+  // The contents of a file reflinked to others, as its size and every
+  // extent (logical, physical, length). Empty when some extent is not
+  // shared, its place is not settled (delayed allocation, inline data) or
+  // FIEMAP is not supported. Dirty pages are written back first: until
+  // then a modified copy still maps the shared extents.
+  std::string extent_signature(int dir_fd, const WorkItem& item)
+  {
+    FileDescriptor file{openat(dir_fd, item.path, O_RDONLY | O_CLOEXEC)};
+    if (file.fd < 0)
+    {
+        return {};
+    }
+    constexpr std::uint32_t batch = 64;
+    constexpr std::uint32_t unsettled = FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_DATA_INLINE
+                                        | FIEMAP_EXTENT_DATA_TAIL | FIEMAP_EXTENT_NOT_ALIGNED;
+    std::vector<std::uint64_t> request((sizeof(struct fiemap) + batch * sizeof(struct fiemap_extent))
+                                       / sizeof(std::uint64_t));
+    std::string signature;
+    auto append = [&signature](std::uint64_t value)
+    {
+        signature.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    append(item.key.dev);
+    append(item.size);
+    std::uint64_t start = 0;
+    while (true)
+    {
+        std::fill(request.begin(), request.end(), 0);
+        auto* map = reinterpret_cast<struct fiemap*>(request.data());
+        map->fm_start = start;
+        map->fm_length = FIEMAP_MAX_OFFSET - start;
+        map->fm_flags = FIEMAP_FLAG_SYNC;
+        map->fm_extent_count = batch;
+        if (ioctl(file.fd, FS_IOC_FIEMAP, map) != 0 || map->fm_mapped_extents == 0)
+        {
+            return {};
+        }
+        for (std::uint32_t i = 0; i < map->fm_mapped_extents; ++i)
+        {
+            const struct fiemap_extent& extent = map->fm_extents[i];
+            if (!(extent.fe_flags & FIEMAP_EXTENT_SHARED) || (extent.fe_flags & unsettled))
+            {
+                return {};
+            }
+            append(extent.fe_logical);
+            append(extent.fe_physical);
+            append(extent.fe_length);
+            if (extent.fe_flags & FIEMAP_EXTENT_LAST)
+            {
+                return signature;
+            }
+            start = extent.fe_logical + extent.fe_length;
         }
-        if (EVP_DigestInit_ex(mdctx.get(), EVP_sha256(), nullptr) != 1)
+    }
+  }
+
+  /*
+  Paths sharing their contents with one found before: hard links to the
+  same inode and, with --dedup-extents, reflinked copies mapping the same
+  extents. Only the first path of a group, its leader, is hashed; the
+  others take a copy of its digests, which the group keeps once the leader
+  is done and freed.
+  */
+  class DedupTable
+  {
+  public:
+    explicit DedupTable(std::size_t digest_bytes)
+        : digest_bytes_(digest_bytes)
+    {
+    }
+
+    // False when `item` leads a new group and is to be hashed. Otherwise
+    // it joined one: `ready` tells whether the leader was done already and
+    // the digests copied, else finish() takes care of it.
+    bool join(std::string key, WorkItem* item, bool& ready)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto [it, created] = groups_.try_emplace(std::move(key));
+        Group& group = it->second;
+        if (created)
         {
-            std::cerr << "Unable to initialize SHA256 for " << path.filename() << std::endl;
+            group.leader = item;
+            item->leader = true;
+            leaders_.emplace(item, &group);
             return false;
         }
+        item->same = group.leader;
+        ready = group.done;
+        if (ready)
+        {
+            std::copy_n(group.digests.data(), digest_bytes_, item->digests);
+        }
+        else
+        {
+            group.waiting.push_back(item);
+        }
+        return true;
+    }
+
+    // `leader` has its digests: hands them to the paths waiting for them,
+    // which are returned.
+    std::vector<WorkItem*> finish(const WorkItem& leader)
+    {
+        std::vector<WorkItem*> waiting;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = leaders_.find(&leader);
+            Group& group = *it->second;
+            group.done = true;
+            group.digests.assign(leader.digests, leader.digests + digest_bytes_);
+            waiting.swap(group.waiting);
+            // The address may come back with a new item.
+            leaders_.erase(it);
+        }
+        for (WorkItem* item : waiting)
+        {
+            std::copy_n(leader.digests, digest_bytes_, item->digests);
+        }
+        return waiting;
+    }
 
-        std::vector<std::uint8_t> buffer(chunkSize);
-        const std::streamsize chunk = static_cast<std::streamsize>(buffer.size());
-        uint64_t file_size = std::filesystem::file_size(path);
-        uint64_t file_read = 0;
+  private:
+    struct Group
+    {
+        const WorkItem* leader = nullptr;
+        bool done = false;
+        std::vector<std::uint8_t> digests;
+        std::vector<WorkItem*> waiting;
+    };
 
-        std::filesystem::path absolute_path = std::filesystem::absolute(scanDir);
-        std::filesystem::path parent_path = absolute_path.has_parent_path() ? absolute_path.parent_path() : absolute_path;
-        std::filesystem::path relative_path = std::filesystem::relative(path, parent_path);
+    std::size_t digest_bytes_;
+    std::mutex mutex_;
+    // Nodes stay in place: groups are also found from their leader.
+    std::unordered_map<std::string, Group> groups_;
+    // Groups whose leader is still being hashed.
+    std::unordered_map<const WorkItem*, Group*> leaders_;
+  };
 
-        print_file_status(static_cast<uint32_t>(file_count + 1),
-            static_cast<uint32_t>(path_list.size()),
-            relative_path);
+  /*
+  Files waiting to be hashed. The walker pushes them as it finds them and
+  the workers take the largest one known so far: a huge file picked up
+  last would leave a single worker busy while all the others sit idle at
+  the end of the run. Files up to the multi-buffer limit are handed out in
+  batches instead, only full ones while the walk is still running.
 
-        bool first_data_run = true;
-        while (true) 
-        {
-            file.read(reinterpret_cast<char*>(buffer.data()), chunk);
-            std::streamsize bytes_read = file.gcount();
-            file_read += static_cast<uint64_t>(bytes_read);
+  With --order inode/extent the files go out in elevator order instead:
+  the next one is the first at or past the location of the last one,
+  wrapping around at the end, so a disk head sweeps across the files even
+  while the walk keeps adding some behind it. Small files in a row along
+  the sweep make up the multi-buffer batches, partial ones included.
+  */
+  class HashQueue
+  {
+  public:
+    // `small_batch` is 0 without a multi-buffer backend.
+    HashQueue(std::size_t small_batch, ReadOrder order)
+        : small_batch_(small_batch), sweep_(order != ReadOrder::size)
+    {
+    }
 
-            if (bytes_read > 0)
+    void push(WorkItem* item)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (sweep_)
             {
-                if (EVP_DigestUpdate(mdctx.get(), buffer.data(), static_cast<size_t>(bytes_read)) != 1)
-                {
-                    std::cerr << "Error updating SHA256 for " << path.filename() << std::endl;
-                    return false;
-                }
+                layout_.emplace(item->location, item);
             }
-
-            if (bytes_read < chunk)
+            else if (small_batch_ > 0 && item->size <= Sha256MultiBuffer::small_message_limit)
             {
-                if (!file.eof() && file.fail()) {
-                    std::cerr << "Error reading file: " << path << "\n";
-                    return false;
-                }
-                break;
+                small_.push_back(item);
+            }
+            else
+            {
+                large_.push(item);
             }
-        
-            print_data_status(file_read, file_size, first_data_run);
-            first_data_run = false;
         }
+        ready_.notify_one();
+    }
+
+    // The walk is over: what is left goes out, small files in partial batches.
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        ready_.notify_all();
+    }
+
+    void abort()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            aborted_ = true;
+        }
+        ready_.notify_all();
+    }
+
+    // Either a single large file or a batch of small ones (`small`); false
+    // once the queue is closed and drained, or aborted.
+    bool pop(std::vector<WorkItem*>& batch, bool& small)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return ready(); });
+        return take(batch, small);
+    }
+
+    // Like pop() without waiting: false when nothing is ready yet, with
+    // `over` set when nothing will ever be.
+    bool try_pop(std::vector<WorkItem*>& batch, bool& small, bool& over)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        over = false;
+        if (!ready())
+        {
+            return false;
+        }
+        over = !take(batch, small);
+        return !over;
+    }
+
+  private:
+    struct Smaller
+    {
+        bool operator()(const WorkItem* a, const WorkItem* b) const { return a->size < b->size; }
+    };
+
+    static bool is_small(std::size_t small_batch, const WorkItem* item)
+    {
+        return small_batch > 0 && item->size <= Sha256MultiBuffer::small_message_limit;
+    }
+
+    bool ready() const
+    {
+        if (sweep_)
+        {
+            return aborted_ || closed_ || !layout_.empty();
+        }
+        return aborted_ || closed_ || !large_.empty() || (small_batch_ > 0 && small_.size() >= small_batch_);
+    }
 
-        print_data_status(file_size, file_size, false);
-        ++file_count;
+    bool take(std::vector<WorkItem*>& batch, bool& small)
+    {
+        if (aborted_)
+        {
+            return false;
+        }
+        batch.clear();
+        if (sweep_)
+        {
+            return take_next(batch, small);
+        }
+        if (!large_.empty())
+        {
+            batch.push_back(large_.top());
+            large_.pop();
+            small = false;
+            return true;
+        }
+        if (small_.empty())
+        {
+            return false;
+        }
+        const std::size_t n = std::min(small_batch_, small_.size());
+        batch.assign(small_.end() - static_cast<std::ptrdiff_t>(n), small_.end());
+        small_.resize(small_.size() - n);
+        small = true;
+        return true;
+    }
 
-        std::array<unsigned char, EVP_MAX_MD_SIZE> hash{};
-        unsigned int hashLen = 0;
-        if (EVP_DigestFinal_ex(mdctx.get(), hash.data(), &hashLen) != 1)
+    bool take_next(std::vector<WorkItem*>& batch, bool& small)
+    {
+        if (layout_.empty())
         {
-            std::cerr << "Error finalizing SHA256 for " << path.filename() << std::endl;
             return false;
         }
+        auto it = layout_.lower_bound(cursor_);
+        if (it == layout_.end())
+        {
+            it = layout_.begin();
+        }
+        small = is_small(small_batch_, it->second);
+        do
+        {
+            cursor_ = it->first;
+            batch.push_back(it->second);
+            it = layout_.erase(it);
+        } while (small && batch.size() < small_batch_ && it != layout_.end() && is_small(small_batch_, it->second));
+        return true;
+    }
+
+    std::size_t small_batch_;
+    bool sweep_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::priority_queue<WorkItem*, std::vector<WorkItem*>, Smaller> large_;
+    std::vector<WorkItem*> small_;
+    std::multimap<std::uint64_t, WorkItem*> layout_;
+    std::uint64_t cursor_ = 0;
+    bool closed_ = false;
+    bool aborted_ = false;
+  };
+
+  // --tree-hash: a file hashed a chunk at a time, its chunks possibly by
+  // several workers at once. The worker finishing the last one computes the
+  // root.
+  struct TreeFile
+  {
+    TreeFile(WorkItem* item_, std::uint64_t chunks_, std::size_t digest_bytes)
+        : item(item_), chunks(chunks_), digests(chunks_ * digest_bytes), remaining(chunks_)
+    {
+    }
+
+    WorkItem* item;
+    std::uint64_t chunks;
+    // The chunk digests, laid out as by MultiDigest::final, one after the other.
+    std::vector<std::uint8_t> digests;
+    std::atomic<std::uint64_t> remaining;
+    // Set with the first chunk, for --stats.
+    RunStats::Clock::time_point started{};
+  };
+
+  /*
+  Chunks waiting to be hashed with --tree-hash, in the order the files were
+  found: every worker takes the next chunk, so the chunks of a large file
+  are spread over all of them, and since no chunk is larger than the chunk
+  size there is no huge file to schedule first.
+  */
+  class ChunkQueue
+  {
+  public:
+    void push(TreeFile* file)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            files_.push_back(file);
+        }
+        ready_.notify_all();
+    }
 
-        std::ostringstream hex;
-        hex << std::hex << std::setfill('0');
-        for (unsigned int i = 0; i < hashLen; ++i)
+    void close()
+    {
         {
-            unsigned char b = hash[i];
-            hex << std::setw(2) << static_cast<int>(b);
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
         }
+        ready_.notify_all();
+    }
 
-        entries.push_back(HashedEntry{std::move(relative_path), hex.str()});
+    void abort()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            aborted_ = true;
+        }
+        ready_.notify_all();
     }
 
-    if (sortEntries)
+    // False once the queue is closed and drained, or aborted.
+    bool pop(TreeFile*& file, std::uint64_t& chunk)
     {
-        std::cout << std::endl << "Sorting results..." << std::flush;
-        std::sort(entries.begin(), entries.end(),
-                [](const HashedEntry& a, const HashedEntry& b) { return a.name < b.name; });
-        std::cout << "Ok" << std::endl << std::flush;
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return aborted_ || closed_ || !files_.empty(); });
+        if (aborted_ || files_.empty())
+        {
+            return false;
+        }
+        file = files_.front();
+        chunk = next_++;
+        if (next_ == file->chunks)
+        {
+            files_.pop_front();
+            next_ = 0;
+        }
+        return true;
     }
 
-    std::ofstream log(logFilePath);
-    std::cout << std::endl << "Log file: " << logFilePath << std::endl;
-    if (!log)
+  private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<TreeFile*> files_;
+    // Next chunk of the front file.
+    std::uint64_t next_ = 0;
+    bool closed_ = false;
+    bool aborted_ = false;
+  };
+
+  // Files between the walk and the log at any time: past this the walk
+  // waits for the workers.
+  constexpr std::size_t maxLiveItems = 64 * 1024;
+
+  /*
+  Owner of the files between the walk and the log. An item is freed as soon
+  as the writer has its entry, and the walk waits while maxLiveItems are
+  queued or being hashed, so memory does not follow the size of the tree;
+  with `keep`, as --tree-sidecar needs, released items are set aside
+  instead. Whatever a failed run leaves behind goes with the pool.
+  */
+  class ItemPool
+  {
+  public:
+    explicit ItemPool(bool keep)
+        : keep_(keep)
     {
-        std::cerr << "Error! Cannot open " << logFilePath << " for writing" << std::endl;
-        return false;
     }
-    for (const auto& e : entries)
+
+    // A new item for `file`, with room for its digests; waits for room
+    // unless the run was aborted.
+    WorkItem* create(const ScannedFile& file, std::size_t digest_bytes)
     {
-        log << e.hash << "  " << e.name << std::endl;
+        auto item = std::make_unique<WorkItem>();
+        // The name is stored with its NUL: the path within it is opened as is.
+        const std::size_t name_bytes = file.name.size() + 1;
+        item->storage = std::make_unique<char[]>(name_bytes + file.order.size() + digest_bytes);
+        char* p = item->storage.get();
+        std::copy_n(file.name.data(), file.name.size(), p);
+        p[file.name.size()] = '\0';
+        item->name = std::string_view{p, file.name.size()};
+        item->path = p + (file.path - file.name.data());
+        p += name_bytes;
+        std::copy_n(file.order.data(), file.order.size(), p);
+        item->order = std::string_view{p, file.order.size()};
+        item->digests = reinterpret_cast<std::uint8_t*>(p + file.order.size());
+        item->size = file.key.size;
+        item->key = file.key;
+
+        WorkItem* raw = item.get();
+        std::unique_lock<std::mutex> lock(mutex_);
+        room_.wait(lock, [this] { return aborted_ || live_.size() < maxLiveItems; });
+        live_.emplace(raw, std::move(item));
+        return raw;
     }
 
-    return true;
+    void release(const WorkItem* item)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = live_.find(item);
+            if (keep_)
+            {
+                kept_.push_back(std::move(it->second));
+            }
+            live_.erase(it);
+        }
+        room_.notify_one();
+    }
+
+    // No item is going to be released anymore.
+    void abort()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            aborted_ = true;
+        }
+        room_.notify_all();
+    }
+
+    // The released items, in walk order.
+    const std::vector<std::unique_ptr<WorkItem>>& kept()
+    {
+        std::sort(kept_.begin(), kept_.end(), [](const auto& a, const auto& b) { return a->order < b->order; });
+        return kept_;
+    }
+
+  private:
+    bool keep_;
+    std::mutex mutex_;
+    std::condition_variable room_;
+    bool aborted_ = false;
+    std::unordered_map<const WorkItem*, std::unique_ptr<WorkItem>> live_;
+    std::vector<std::unique_ptr<WorkItem>> kept_;
+  };
+
+  // Owned by one worker and reused for every file: the buffers are
+  // allocated once, the read buffer page aligned and never zeroed, and the
+  // digest contexts are reset by init() instead of being reallocated.
+  struct WorkerState
+  {
+    WorkerState(const std::vector<DigestAlgorithm>& algorithms, bool parallel, ReadMode mode_)
+        : mode(mode_), buffer(chunkSize), digest(algorithms, parallel)
+    {
+    }
+
+    ReadMode mode;
+    AlignedBuffer buffer;
+    MultiDigest digest;
+
+    // Multi-buffer batches.
+    std::vector<std::uint8_t> small_buffer;
+    std::vector<const std::uint8_t*> small_data;
+    std::vector<std::size_t> small_sizes;
+    std::vector<const WorkItem*> small_targets;
+    std::vector<Sha256MultiBuffer::Digest> small_digests;
+  };
+
+  // Mappings span at most this much of a file at a time.
+  constexpr std::size_t mapWindow = 64 * 1024 * 1024;
+
+  void warn_no_direct_io()
+  {
+    static std::once_flag warned;
+    std::call_once(warned, []
+    {
+        std::cerr << "O_DIRECT not supported here, reading through the page cache and dropping it instead"
+                  << std::endl;
+    });
+  }
+
+  // Opens a file to be hashed as `mode` requires. Filesystems refusing
+  // O_DIRECT (tmpfs, for one) are read like ReadMode::fadvise instead, and
+  // `mode` is changed accordingly.
+  int open_file(int dir_fd, const char* path, ReadMode& mode)
+  {
+    if (mode == ReadMode::direct)
+    {
+        int fd = openat(dir_fd, path, O_RDONLY | O_CLOEXEC | O_DIRECT);
+        if (fd >= 0 || errno != EINVAL)
+        {
+            return fd;
+        }
+        warn_no_direct_io();
+        mode = ReadMode::fadvise;
+    }
+    int fd = openat(dir_fd, path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0 && mode == ReadMode::fadvise)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    return fd;
+  }
+
+  // ReadMode::mmap: the file is digested straight from the page cache, a
+  // window at a time. The size comes from fstat() rather than the walk, and
+  // is checked again before each window; a file truncated while a window is
+  // digested is caught by MappedRangeGuard.
+  bool hash_mapped(int fd, const WorkItem& item, MultiDigest& digest, SharedProgress& progress, RunStats* stats)
+  {
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        std::cerr << "Error reading file: " << item.name << "\n";
+        return false;
+    }
+    const auto size = static_cast<std::uint64_t>(st.st_size);
+    for (std::uint64_t offset = 0; offset < size; offset += mapWindow)
+    {
+        const auto length = static_cast<std::size_t>(std::min<std::uint64_t>(mapWindow, size - offset));
+        if (offset > 0 && fstat(fd, &st) != 0)
+        {
+            std::cerr << "Error reading file: " << item.name << "\n";
+            return false;
+        }
+        if (static_cast<std::uint64_t>(st.st_size) < offset + length)
+        {
+            std::cerr << "File truncated while hashing: " << item.name << "\n";
+            return false;
+        }
+        StatTimer read_timer(stats, StatPhase::read);
+        void* data = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(offset));
+        read_timer.stop();
+        if (data == MAP_FAILED)
+        {
+            std::cerr << "Unable to map file: " << item.name << "\n";
+            return false;
+        }
+        madvise(data, length, MADV_SEQUENTIAL);
+        if (stats)
+        {
+            stats->add_read(length);
+        }
+        bool ok = true;
+        bool truncated = false;
+        {
+            MappedRangeGuard guard(data, length);
+            if (!guard.registered())
+            {
+                munmap(data, length);
+                std::cerr << "Too many files mapped at once: " << item.name << "\n";
+                return false;
+            }
+            for (std::size_t done = 0; ok && done < length; done += chunkSize)
+            {
+                const std::size_t part = std::min(chunkSize, length - done);
+                StatTimer digest_timer(stats, StatPhase::digest);
+                ok = digest.update(static_cast<const std::uint8_t*>(data) + done, part);
+                digest_timer.stop();
+                progress.add_bytes(part);
+            }
+            truncated = guard.truncated();
+        }
+        munmap(data, length);
+        if (truncated)
+        {
+            std::cerr << "File truncated while hashing: " << item.name << "\n";
+            return false;
+        }
+        if (!ok)
+        {
+            std::cerr << "Error updating digest for " << item.name << std::endl;
+            return false;
+        }
+    }
+    return true;
+  }
+
+  // Holes of sparse files are digested from here, with no I/O.
+  std::array<std::uint8_t, 1024 * 1024> zeroBuffer{};
+
+  // Size of a file with holes, 0 when it has none (or the filesystem
+  // cannot tell) and is read whole.
+  std::uint64_t sparse_size(int fd)
+  {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        return 0;
+    }
+    const off_t hole = lseek(fd, 0, SEEK_HOLE);
+    if (hole < 0 || hole >= st.st_size)
+    {
+        // The probe moved the offset for read().
+        lseek(fd, 0, SEEK_SET);
+        return 0;
+    }
+    return static_cast<std::uint64_t>(st.st_size);
+  }
+
+  // Length of the next read of a sparse file, which ends with the data
+  // range; rounded up as O_DIRECT needs, which may read some zeros of the
+  // hole that follows.
+  std::size_t data_read_length(std::size_t buffer_size, std::uint64_t offset, std::uint64_t data_end)
+  {
+    const std::uint64_t rounded = (data_end - offset + AlignedBuffer::alignment - 1) / AlignedBuffer::alignment
+                                  * AlignedBuffer::alignment;
+    return static_cast<std::size_t>(std::min<std::uint64_t>(buffer_size, rounded));
+  }
+
+  // Digests the zeros of the hole at `offset`, if there is one, moving
+  // `offset` to the data that follows and `data_end` to the end of that
+  // data; both end up at `size` past the last data.
+  bool skip_hole(int fd, std::uint64_t size, std::uint64_t& offset, std::uint64_t& data_end, MultiDigest& digest,
+                 SharedProgress& progress, RunStats* stats)
+  {
+    off_t data = lseek(fd, static_cast<off_t>(offset), SEEK_DATA);
+    // ENXIO: nothing but a hole up to the end.
+    std::uint64_t next = data < 0 ? size : std::min(static_cast<std::uint64_t>(data), size);
+    const std::uint64_t zeros = next - offset;
+    StatTimer digest_timer(stats, StatPhase::digest);
+    for (std::uint64_t left = zeros; left > 0;)
+    {
+        const std::size_t part = static_cast<std::size_t>(std::min<std::uint64_t>(left, zeroBuffer.size()));
+        if (!digest.update(zeroBuffer.data(), part))
+        {
+            return false;
+        }
+        left -= part;
+    }
+    digest_timer.stop();
+    progress.add_bytes(zeros);
+    if (stats)
+    {
+        stats->add_count(StatCounter::hole_bytes, zeros);
+    }
+    offset = next;
+    const off_t hole = next < size ? lseek(fd, static_cast<off_t>(next), SEEK_HOLE) : -1;
+    data_end = hole < 0 ? size : std::min(static_cast<std::uint64_t>(hole), size);
+    return true;
+  }
+
+  bool hash_file(int dir_fd, const WorkItem& item, WorkerState& state, SharedProgress& progress, RunStats* stats)
+  {
+    ReadMode mode = state.mode;
+    StatTimer open_timer(stats, StatPhase::open);
+    FileDescriptor file{open_file(dir_fd, item.path, mode)};
+    open_timer.stop();
+    if (file.fd < 0)
+    {
+        std::cerr << "Unable to open file: " << item.name << "\n";
+        return false;
+    }
+
+    MultiDigest& digest = state.digest;
+    if (!digest.valid())
+    {
+        std::cerr << "Unable to allocate digest context for " << item.name << std::endl;
+        return false;
+    }
+    if (!digest.init())
+    {
+        std::cerr << "Unable to initialize digest for " << item.name << std::endl;
+        return false;
+    }
+
+    if (mode == ReadMode::mmap)
+    {
+        if (!hash_mapped(file.fd, item, digest, progress, stats))
+        {
+            return false;
+        }
+        StatTimer digest_timer(stats, StatPhase::digest);
+        if (!digest.final(item.digests))
+        {
+            std::cerr << "Error finalizing digest for " << item.name << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Sparse files are read a data range at a time, the holes in between
+    // are digested as zeros.
+    const std::uint64_t sparse = sparse_size(file.fd);
+    std::uint64_t data_end = 0;
+
+    AlignedBuffer& buffer = state.buffer;
+    std::uint64_t total = 0;
+    while (true)
+    {
+        if (sparse > 0 && total >= data_end)
+        {
+            if (!skip_hole(file.fd, sparse, total, data_end, digest, progress, stats))
+            {
+                std::cerr << "Error updating digest for " << item.name << std::endl;
+                return false;
+            }
+            if (total >= sparse)
+            {
+                break;
+            }
+        }
+        StatTimer read_timer(stats, StatPhase::read);
+        ssize_t bytes_read = sparse > 0
+            ? pread(file.fd, buffer.data(), data_read_length(buffer.size(), total, data_end), static_cast<off_t>(total))
+            : read(file.fd, buffer.data(), buffer.size());
+        read_timer.stop();
+        if (bytes_read < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes_read < 0)
+        {
+            std::cerr << "Error reading file: " << item.name << "\n";
+            return false;
+        }
+        if (bytes_read == 0)
+        {
+            break;
+        }
+        if (stats)
+        {
+            stats->add_read(static_cast<std::uint64_t>(bytes_read));
+        }
+
+        StatTimer digest_timer(stats, StatPhase::digest);
+        if (!digest.update(buffer.data(), static_cast<size_t>(bytes_read)))
+        {
+            std::cerr << "Error updating digest for " << item.name << std::endl;
+            return false;
+        }
+        digest_timer.stop();
+        progress.add_bytes(static_cast<std::uint64_t>(bytes_read));
+
+        // Nobody else is going to read these pages again soon.
+        if (mode == ReadMode::fadvise)
+        {
+            posix_fadvise(file.fd, static_cast<off_t>(total), bytes_read, POSIX_FADV_DONTNEED);
+        }
+
+        // A short read reaching the size seen by the walk is the end of the
+        // file: files smaller than the buffer take a single read().
+        total += static_cast<std::uint64_t>(bytes_read);
+        if (sparse == 0 && static_cast<std::size_t>(bytes_read) < buffer.size() && total == item.size)
+        {
+            break;
+        }
+    }
+
+    StatTimer digest_timer(stats, StatPhase::digest);
+    if (!digest.final(item.digests))
+    {
+        std::cerr << "Error finalizing digest for " << item.name << std::endl;
+        return false;
+    }
+
+    return true;
+  }
+
+  // --tree-hash: digests chunk `chunk` of a file into its place among the
+  // chunk digests. Like hash_file(), holes are not read; reads are rounded
+  // up for O_DIRECT and what they return past the chunk is left out.
+  bool hash_chunk(int dir_fd, TreeFile& file, std::uint64_t chunk, std::uint64_t chunk_size, WorkerState& state,
+                  SharedProgress& progress, RunStats* stats)
+  {
+    const WorkItem& item = *file.item;
+    ReadMode mode = state.mode;
+    StatTimer open_timer(stats, StatPhase::open);
+    FileDescriptor fd{open_file(dir_fd, item.path, mode)};
+    open_timer.stop();
+    if (fd.fd < 0)
+    {
+        std::cerr << "Unable to open file: " << item.name << "\n";
+        return false;
+    }
+
+    MultiDigest& digest = state.digest;
+    if (!digest.valid() || !digest.init())
+    {
+        std::cerr << "Unable to initialize digest for " << item.name << std::endl;
+        return false;
+    }
+
+    const std::uint64_t begin = chunk * chunk_size;
+    const std::uint64_t end = std::min(item.size, begin + chunk_size);
+    const bool sparse = sparse_size(fd.fd) > 0;
+    std::uint64_t data_end = sparse ? begin : end;
+    AlignedBuffer& buffer = state.buffer;
+    for (std::uint64_t offset = begin; offset < end;)
+    {
+        if (sparse && offset >= data_end)
+        {
+            if (!skip_hole(fd.fd, end, offset, data_end, digest, progress, stats))
+            {
+                std::cerr << "Error updating digest for " << item.name << std::endl;
+                return false;
+            }
+            if (offset >= end)
+            {
+                break;
+            }
+        }
+        StatTimer read_timer(stats, StatPhase::read);
+        const ssize_t bytes_read = pread(fd.fd, buffer.data(), data_read_length(buffer.size(), offset, data_end),
+                                         static_cast<off_t>(offset));
+        read_timer.stop();
+        if (bytes_read < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes_read < 0)
+        {
+            std::cerr << "Error reading file: " << item.name << "\n";
+            return false;
+        }
+        if (bytes_read == 0)
+        {
+            break;
+        }
+        if (stats)
+        {
+            stats->add_read(static_cast<std::uint64_t>(bytes_read));
+        }
+
+        const std::uint64_t used = std::min(static_cast<std::uint64_t>(bytes_read), end - offset);
+        StatTimer digest_timer(stats, StatPhase::digest);
+        if (!digest.update(buffer.data(), static_cast<std::size_t>(used)))
+        {
+            std::cerr << "Error updating digest for " << item.name << std::endl;
+            return false;
+        }
+        digest_timer.stop();
+        progress.add_bytes(used);
+
+        if (mode == ReadMode::fadvise)
+        {
+            posix_fadvise(fd.fd, static_cast<off_t>(offset), static_cast<off_t>(used), POSIX_FADV_DONTNEED);
+        }
+        offset += used;
+    }
+
+    StatTimer digest_timer(stats, StatPhase::digest);
+    if (!digest.final(file.digests.data() + chunk * digest_size(digest.algorithms())))
+    {
+        std::cerr << "Error finalizing digest for " << item.name << std::endl;
+        return false;
+    }
+    return true;
+  }
+
+  // Reads a whole small file, with a single read() unless it changed since
+  // the walk. `len` is set to cap when it grew beyond cap - 1 bytes. The
+  // slots are not aligned for O_DIRECT: with ReadMode::direct and fadvise
+  // the pages are dropped from the cache once read, mmap is not worth it.
+  bool read_small_file(int dir_fd, const WorkItem& item, ReadMode mode, std::uint8_t* buf, std::size_t cap,
+                       std::size_t& len, RunStats* stats)
+  {
+    StatTimer open_timer(stats, StatPhase::open);
+    FileDescriptor file{openat(dir_fd, item.path, O_RDONLY | O_CLOEXEC)};
+    open_timer.stop();
+    if (file.fd < 0)
+    {
+        std::cerr << "Unable to open file: " << item.name << "\n";
+        return false;
+    }
+    len = 0;
+    while (len < cap)
+    {
+        StatTimer read_timer(stats, StatPhase::read);
+        ssize_t n = read(file.fd, buf + len, cap - len);
+        read_timer.stop();
+        if (stats && n > 0)
+        {
+            stats->add_read(static_cast<std::uint64_t>(n));
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            std::cerr << "Error reading file: " << item.name << "\n";
+            return false;
+        }
+        if (n == 0)
+        {
+            break;
+        }
+        len += static_cast<std::size_t>(n);
+        if (len < cap && len == item.size)
+        {
+            break;
+        }
+    }
+    if (mode == ReadMode::fadvise || mode == ReadMode::direct)
+    {
+        posix_fadvise(file.fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    return true;
+  }
+
+  // Hashes a batch of small files side by side with the multi-buffer
+  // SHA-256; a file that grew past the limit since the walk goes through
+  // hash_file instead.
+  bool hash_small_files(int dir_fd, const std::vector<WorkItem*>& batch, WorkerState& state,
+                        SharedProgress& progress, RunStats* stats)
+  {
+    constexpr std::size_t slot = Sha256MultiBuffer::small_message_limit + 1;
+    std::vector<std::uint8_t>& buffer = state.small_buffer;
+    if (buffer.size() < batch.size() * slot)
+    {
+        buffer.resize(batch.size() * slot);
+    }
+
+    std::vector<const std::uint8_t*>& data = state.small_data;
+    std::vector<std::size_t>& sizes = state.small_sizes;
+    std::vector<const WorkItem*>& targets = state.small_targets;
+    data.clear();
+    sizes.clear();
+    targets.clear();
+    for (std::size_t i = 0; i < batch.size(); ++i)
+    {
+        const WorkItem& item = *batch[i];
+        progress.file_started(item);
+        const auto started = stats ? RunStats::Clock::now() : RunStats::Clock::time_point{};
+        std::uint8_t* buf = buffer.data() + i * slot;
+        std::size_t len = 0;
+        if (!read_small_file(dir_fd, item, state.mode, buf, slot, len, stats))
+        {
+            return false;
+        }
+        if (len == slot && !hash_file(dir_fd, item, state, progress, stats))
+        {
+            return false;
+        }
+        // The batched digest is shared: a small file is timed up to its read.
+        if (stats)
+        {
+            stats->add_file(item.name, item.size, RunStats::Clock::now() - started);
+        }
+        if (len == slot)
+        {
+            continue;
+        }
+        progress.add_bytes(len);
+        data.push_back(buf);
+        sizes.push_back(len);
+        targets.push_back(&item);
+    }
+
+    std::vector<Sha256MultiBuffer::Digest>& digests = state.small_digests;
+    digests.resize(data.size());
+    StatTimer digest_timer(stats, StatPhase::digest);
+    Sha256MultiBuffer::hash(data.data(), sizes.data(), data.size(), digests.data());
+    digest_timer.stop();
+    if (stats)
+    {
+        stats->add_count(StatCounter::multi_buffer_files, data.size());
+    }
+    for (std::size_t j = 0; j < targets.size(); ++j)
+    {
+        std::copy(digests[j].begin(), digests[j].end(), targets[j]->digests);
+    }
+    return true;
+  }
+
+  /*
+  Asynchronous read path (--io-uring). Each worker keeps up to `depth`
+  files in flight on a ring of its own, every one with a registered buffer
+  and its own digest contexts: the opens, reads and closes of all of them
+  go to the kernel in a single io_uring_enter() per round, and a file is
+  digested as its reads complete. A file is read sequentially, one request
+  at a time; batches of small files still take the multi-buffer path.
+  The read modes other than mmap apply as they do to hash_file().
+  */
+  class UringHasher
+  {
+  public:
+    using BatchHasher = std::function<bool(const std::vector<WorkItem*>& batch)>;
+    using Completed = std::function<void(const WorkItem& item)>;
+
+    // The buffer size is rounded up to a multiple of the page size, as
+    // O_DIRECT requires.
+    UringHasher(const std::vector<DigestAlgorithm>& algorithms, bool parallel, ReadMode mode, unsigned depth,
+                std::size_t buffer_size)
+        : mode_(mode), depth_(depth),
+          buffer_size_((buffer_size + AlignedBuffer::alignment - 1) / AlignedBuffer::alignment
+                       * AlignedBuffer::alignment),
+          buffers_(std::size_t{depth} * buffer_size_)
+    {
+        slots_.reserve(depth);
+        for (unsigned i = 0; i < depth; ++i)
+        {
+            slots_.emplace_back(buffers_.data() + std::size_t{i} * buffer_size_, algorithms, parallel);
+            free_.push_back(depth - 1 - i);
+        }
+    }
+
+    ~UringHasher()
+    {
+        for (const Slot& slot : slots_)
+        {
+            if (slot.fd >= 0)
+            {
+                close(slot.fd);
+            }
+        }
+    }
+
+    // False, after saying so once, when io_uring cannot be used here.
+    bool init()
+    {
+        if (!ring_.init(2 * depth_))
+        {
+            const int error = errno;
+            static std::once_flag warned;
+            std::call_once(warned, [error]
+            {
+                std::cerr << "io_uring not available (" << std::strerror(error) << "), using blocking reads"
+                          << std::endl;
+            });
+            return false;
+        }
+        // Without registered buffers every read maps its buffer again.
+        std::vector<struct iovec> iov(depth_);
+        for (unsigned i = 0; i < depth_; ++i)
+        {
+            iov[i].iov_base = slots_[i].buffer;
+            iov[i].iov_len = buffer_size_;
+        }
+        registered_ = ring_.register_buffers(iov.data(), depth_);
+        return true;
+    }
+
+    // Hashes the files of `queue` until it is drained or `stop` is set.
+    bool run(int dir_fd, HashQueue& queue, const std::atomic<bool>& stop, SharedProgress& progress,
+             RunStats* stats, const BatchHasher& hash_batch, const Completed& completed)
+    {
+        std::vector<WorkItem*> batch;
+        bool small = false;
+        bool over = false;
+        bool ok = true;
+        dir_fd_ = dir_fd;
+        while (ok && !stop.load(std::memory_order_relaxed))
+        {
+            // Only wait for the queue with nothing in flight.
+            while (!over && !free_.empty() && !stop.load(std::memory_order_relaxed))
+            {
+                const bool popped = in_flight_ == 0 ? queue.pop(batch, small) : queue.try_pop(batch, small, over);
+                over = over || (in_flight_ == 0 && !popped);
+                if (!popped)
+                {
+                    break;
+                }
+                if (small)
+                {
+                    ok = hash_batch(batch);
+                    if (!ok)
+                    {
+                        break;
+                    }
+                    continue;
+                }
+                start(*batch.front(), progress, stats);
+            }
+            if (!ok || in_flight_ == 0)
+            {
+                break;
+            }
+
+            if (!ring_.submit(1))
+            {
+                std::cerr << "Error submitting reads: " << std::strerror(errno) << std::endl;
+                ok = false;
+                break;
+            }
+            // Each completion queues at most one operation: with no more
+            // than `depth` of them per round the ring never fills up.
+            IoUring::Completion completion;
+            for (unsigned n = 0; ok && n < depth_ && ring_.pop(completion); ++n)
+            {
+                --in_flight_;
+                ok = complete(completion, progress, stats, completed);
+            }
+        }
+        drain();
+        return ok;
+    }
+
+  private:
+    enum Operation : std::uint64_t
+    {
+        op_open,
+        op_read,
+        op_close
+    };
+
+    struct Slot
+    {
+        Slot(std::uint8_t* buffer_, const std::vector<DigestAlgorithm>& algorithms, bool parallel)
+            : buffer(buffer_), digest(algorithms, parallel)
+        {
+        }
+
+        std::uint8_t* buffer;
+        MultiDigest digest;
+        const WorkItem* item = nullptr;
+        // As for open_file().
+        ReadMode mode = ReadMode::buffered;
+        int fd = -1;
+        std::uint64_t offset = 0;
+        // As for hash_file(): the size of a sparse file, and the end of
+        // the data range being read.
+        std::uint64_t sparse = 0;
+        std::uint64_t data_end = 0;
+        RunStats::Clock::time_point started;
+    };
+
+    static std::uint64_t tag(std::size_t slot, Operation op) { return (std::uint64_t{slot} << 2) | op; }
+
+    void start(const WorkItem& item, SharedProgress& progress, RunStats* stats)
+    {
+        const std::size_t index = free_.back();
+        free_.pop_back();
+        Slot& slot = slots_[index];
+        slot.item = &item;
+        slot.mode = mode_;
+        slot.offset = 0;
+        slot.sparse = 0;
+        slot.data_end = 0;
+        slot.started = stats ? RunStats::Clock::now() : RunStats::Clock::time_point{};
+        progress.file_started(item);
+        open(index);
+    }
+
+    void open(std::size_t index)
+    {
+        const Slot& slot = slots_[index];
+        const int flags = O_RDONLY | O_CLOEXEC | (slot.mode == ReadMode::direct ? O_DIRECT : 0);
+        ring_.openat(dir_fd_, slot.item->path, flags, tag(index, op_open));
+        ++in_flight_;
+    }
+
+    void read_next(std::size_t index)
+    {
+        Slot& slot = slots_[index];
+        const std::size_t length = slot.sparse > 0 ? data_read_length(buffer_size_, slot.offset, slot.data_end)
+                                                   : buffer_size_;
+        if (registered_)
+        {
+            ring_.read_fixed(slot.fd, slot.buffer, length, slot.offset, static_cast<unsigned>(index),
+                             tag(index, op_read));
+        }
+        else
+        {
+            ring_.read(slot.fd, slot.buffer, length, slot.offset, tag(index, op_read));
+        }
+        ++in_flight_;
+    }
+
+    // Reads on, past the hole at the current offset of a sparse file.
+    bool advance(std::size_t index, SharedProgress& progress, RunStats* stats, const Completed& completed)
+    {
+        Slot& slot = slots_[index];
+        if (slot.sparse > 0 && slot.offset >= slot.data_end)
+        {
+            if (!skip_hole(slot.fd, slot.sparse, slot.offset, slot.data_end, slot.digest, progress, stats))
+            {
+                std::cerr << "Error updating digest for " << slot.item->name << std::endl;
+                return false;
+            }
+            if (slot.offset >= slot.sparse)
+            {
+                return finish(index, stats, completed);
+            }
+        }
+        read_next(index);
+        return true;
+    }
+
+    bool complete(const IoUring::Completion& completion, SharedProgress& progress, RunStats* stats,
+                  const Completed& completed)
+    {
+        const auto op = static_cast<Operation>(completion.user_data & 3);
+        const std::size_t index = static_cast<std::size_t>(completion.user_data >> 2);
+        if (op == op_close)
+        {
+            return true;
+        }
+        Slot& slot = slots_[index];
+        const WorkItem& item = *slot.item;
+        const std::int32_t res = completion.res;
+
+        if (op == op_open)
+        {
+            if (res == -EINVAL && slot.mode == ReadMode::direct)
+            {
+                warn_no_direct_io();
+                slot.mode = ReadMode::fadvise;
+                open(index);
+                return true;
+            }
+            if (res < 0)
+            {
+                std::cerr << "Unable to open file: " << item.name << "\n";
+                return false;
+            }
+            slot.fd = res;
+            if (slot.mode == ReadMode::fadvise)
+            {
+                posix_fadvise(slot.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            }
+            if (!slot.digest.valid() || !slot.digest.init())
+            {
+                std::cerr << "Unable to initialize digest for " << item.name << std::endl;
+                return false;
+            }
+            slot.sparse = sparse_size(slot.fd);
+            return advance(index, progress, stats, completed);
+        }
+
+        if (res == -EINTR || res == -EAGAIN)
+        {
+            read_next(index);
+            return true;
+        }
+        if (res < 0)
+        {
+            std::cerr << "Error reading file: " << item.name << "\n";
+            return false;
+        }
+        if (res > 0)
+        {
+            if (stats)
+            {
+                stats->add_read(static_cast<std::uint64_t>(res));
+            }
+            StatTimer digest_timer(stats, StatPhase::digest);
+            if (!slot.digest.update(slot.buffer, static_cast<std::size_t>(res)))
+            {
+                std::cerr << "Error updating digest for " << item.name << std::endl;
+                return false;
+            }
+            digest_timer.stop();
+            progress.add_bytes(static_cast<std::uint64_t>(res));
+            if (slot.mode == ReadMode::fadvise)
+            {
+                posix_fadvise(slot.fd, static_cast<off_t>(slot.offset), res, POSIX_FADV_DONTNEED);
+            }
+            slot.offset += static_cast<std::uint64_t>(res);
+            // Same end of file rule as hash_file().
+            if (slot.sparse > 0 || static_cast<std::size_t>(res) == buffer_size_ || slot.offset != item.size)
+            {
+                return advance(index, progress, stats, completed);
+            }
+        }
+        return finish(index, stats, completed);
+    }
+
+    bool finish(std::size_t index, RunStats* stats, const Completed& completed)
+    {
+        Slot& slot = slots_[index];
+        const WorkItem& item = *slot.item;
+        StatTimer digest_timer(stats, StatPhase::digest);
+        if (!slot.digest.final(item.digests))
+        {
+            std::cerr << "Error finalizing digest for " << item.name << std::endl;
+            return false;
+        }
+        digest_timer.stop();
+        // Pages still being read ahead were skipped by the drops so far.
+        if (slot.mode == ReadMode::fadvise)
+        {
+            posix_fadvise(slot.fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+        ring_.close(slot.fd, tag(index, op_close));
+        ++in_flight_;
+        slot.fd = -1;
+        free_.push_back(index);
+        if (stats)
+        {
+            stats->add_file(item.name, item.size, RunStats::Clock::now() - slot.started);
+        }
+        completed(item);
+        return true;
+    }
+
+    // Waits for what is still in flight after an error or a stop: the
+    // kernel may write into the buffers until then.
+    void drain()
+    {
+        IoUring::Completion completion;
+        while (in_flight_ > 0 && ring_.submit(1))
+        {
+            while (ring_.pop(completion))
+            {
+                --in_flight_;
+                const std::size_t index = static_cast<std::size_t>(completion.user_data >> 2);
+                if ((completion.user_data & 3) == op_open && completion.res >= 0)
+                {
+                    slots_[index].fd = completion.res;
+                }
+            }
+        }
+    }
+
+    ReadMode mode_;
+    unsigned depth_;
+    std::size_t buffer_size_;
+    int dir_fd_ = -1;
+    AlignedBuffer buffers_;
+    std::vector<Slot> slots_;
+    std::vector<std::size_t> free_;
+    // Declared after the buffers: torn down first.
+    IoUring ring_;
+    bool registered_ = false;
+    // Operations submitted or queued and not completed yet.
+    unsigned in_flight_ = 0;
+  };
+}  // namespace
+
+DirProcessor::DirProcessor(const Options& options, StatsReport* stats)
+    : options_(options), stats_(stats)
+{
+}
+
+bool DirProcessor::process(const std::filesystem::path& scanDir, const std::filesystem::path& logPath) const
+{
+    const std::vector<DigestAlgorithm>& algorithms = options_.algorithms;
+    const std::string stem = scanDir.stem().string();
+    // Tree-hash roots go to logs (and caches) of their own.
+    const std::uint64_t tree_chunk = options_.treeHash ? std::uint64_t{options_.treeChunkMiB} * 1024 * 1024 : 0;
+    const std::string label = tree_chunk > 0 ? tree_label(tree_chunk) : std::string{};
+    RunStats* stats = stats_ ? &stats_->add_item(scanDir.string()) : nullptr;
+    StatsFinisher stats_finisher(stats);
+
+    // Files modified after this instant may change again within the
+    // timestamp granularity without any visible metadata change: they are
+    // hashed but not cached.
+    const std::int64_t run_start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    if (options_.showProgress)
+    {
+        std::cout << "Processing " << scanDir << std::endl;
+    }
+
+    // Names in the log are relative to the parent of the scanned directory.
+    std::string prefix;
+    try
+    {
+      std::filesystem::path absolute_path = std::filesystem::absolute(scanDir);
+      std::filesystem::path parent_path = absolute_path.has_parent_path() ? absolute_path.parent_path() : absolute_path;
+      std::filesystem::path relative = std::filesystem::relative(absolute_path, parent_path);
+      if (!relative.empty() && relative != ".")
+      {
+          prefix = relative.generic_string() + '/';
+      }
+    }
+    catch (const std::filesystem::filesystem_error& e)
+    {
+        std::cerr << std::endl << "Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    // Listing is bound by the latency of the filesystem rather than by the
+    // CPU: a few crawling threads pay off even with -j 1.
+    DirWalker walker(scanDir, prefix, std::max(walker_threads, options_.jobs));
+    if (!walker.open())
+    {
+        return false;
+    }
+
+    // Verification reads every byte: the cache is not consulted.
+    StatTimer load_timer(stats, StatPhase::load);
+    std::optional<ManifestVerifier> verifier;
+    if (options_.verifyManifest)
+    {
+        const std::filesystem::path& manifest = *options_.verifyManifest;
+        std::vector<std::filesystem::path> manifests;
+        if (std::filesystem::is_directory(manifest))
+        {
+            for (const auto& name : DigestLogWriter::file_names(algorithms, false, stem, label))
+            {
+                manifests.push_back(manifest / name);
+            }
+        }
+        else if (algorithms.size() == 1)
+        {
+            manifests.push_back(manifest);
+        }
+        else
+        {
+            std::cerr << "Error! --verify with several algorithms needs a directory of manifests" << std::endl;
+            return false;
+        }
+        verifier.emplace(algorithms, options_.failFast);
+        if (!verifier->load(manifests))
+        {
+            return false;
+        }
+    }
+
+    // One cache per algorithm; a file is skipped only when all of them
+    // still match it.
+    std::vector<std::unique_ptr<HashCache>> caches;
+    if (options_.incremental && !verifier)
+    {
+        for (auto algorithm : algorithms)
+        {
+            const std::string suffix = std::string{"."} + digest_name(algorithm) + label;
+            std::filesystem::path cachePath = logPath / (stem + suffix + ".cache");
+            if (options_.cachePath)
+            {
+                cachePath = *options_.cachePath;
+                if (algorithms.size() > 1)
+                {
+                    cachePath += suffix;
+                }
+            }
+            caches.push_back(std::make_unique<HashCache>(cachePath, algorithm));
+            caches.back()->load();
+        }
+    }
+
+    // Completed files are journaled while the logs are written; --resume
+    // takes those an interrupted run journaled, if they did not change,
+    // instead of hashing them again.
+    std::optional<Journal> journal;
+    std::unordered_map<std::string_view, Journal::Record> journaled;
+    if (!verifier)
+    {
+        std::string identity = "sha_from_dir";
+        for (auto algorithm : algorithms)
+        {
+            identity += ' ';
+            identity += digest_name(algorithm);
+        }
+        identity += label;
+        journal.emplace(logPath / (stem + label + ".journal"), std::move(identity), digest_size(algorithms));
+        if (options_.resume)
+        {
+            journal->load([&journaled](const Journal::Record& record) { journaled.insert_or_assign(record.name, record); });
+        }
+        if (!journal->open())
+        {
+            return false;
+        }
+    }
+    load_timer.stop();
+
+    // The log is streamed while hashing: entries are handed to the writer
+    // as they complete, placed by their walk order key.
+    std::optional<DigestLogWriter> writer;
+    if (!verifier)
+    {
+        writer.emplace(algorithms, options_.combinedLog, options_.sortEntries,
+                       std::size_t{options_.sortMemoryMiB} * 1024 * 1024, label);
+        if (!writer->open(logPath, stem))
+        {
+            return false;
+        }
+    }
+
+    // Files from the walk until their entry is logged. Their raw digests
+    // hold all the algorithms of a file one after the other; digests are
+    // only turned into hex as the log is written.
+    const std::size_t digest_bytes = digest_size(algorithms);
+    ItemPool items(options_.treeSidecar);
+
+    std::atomic<bool> failed{false};
+    std::atomic<bool> stop{false};
+    std::atomic<std::size_t> cache_hits{0};
+    std::atomic<std::size_t> resumed{0};
+    SharedProgress progress(options_.showProgress);
+
+    // Hard links, and reflinks with --dedup-extents, are hashed once.
+    DedupTable dedup(digest_bytes);
+    std::atomic<std::size_t> shared_files{0};
+    std::atomic<std::uint64_t> shared_bytes{0};
+
+    // Small files are hashed side by side in SIMD lanes rather than with
+    // one digest context each, unless no multi-buffer backend is available.
+    const bool sha256_only = algorithms.size() == 1 && algorithms[0] == DigestAlgorithm::sha256;
+    const std::size_t lanes = sha256_only ? Sha256MultiBuffer::lanes() : 1;
+    HashQueue queue(lanes > 1 ? lanes * 4 : 0, options_.readOrder);
+
+    // With --tree-hash the workers take chunks instead.
+    ChunkQueue chunks;
+
+    auto halt = [&]()
+    {
+        stop = true;
+        queue.abort();
+        chunks.abort();
+        items.abort();
+    };
+
+    // Files changed during the run may change again unnoticed: they are
+    // neither journaled nor cached. Cache records go straight to the
+    // caches, which spill them as they grow.
+    auto record = [&](const WorkItem& item, bool journal_it)
+    {
+        if (verifier && !verifier->check(item.name, item.digests) && verifier->should_stop())
+        {
+            halt();
+        }
+        if (!writer)
+        {
+            return;
+        }
+        const bool settled = item.key.mtimeNs < run_start_ns && item.key.ctimeNs < run_start_ns;
+        if (journal_it && settled && !journal->add(item.name, journal_key(item.key), item.digests))
+        {
+            failed = true;
+            halt();
+        }
+        const std::uint8_t* digest = item.digests;
+        for (std::size_t a = 0; settled && a < caches.size(); ++a)
+        {
+            if (!caches[a]->add(item.key, digest))
+            {
+                failed = true;
+                halt();
+            }
+            digest += digest_size(algorithms[a]);
+        }
+        if (!writer->add(item.order, item.name, item.digests))
+        {
+            failed = true;
+            halt();
+        }
+    };
+
+    // Logs `item`, and the paths that waited for its digests, then frees them.
+    auto completed = [&](const WorkItem& item)
+    {
+        record(item, true);
+        if (item.leader)
+        {
+            for (const WorkItem* other : dedup.finish(item))
+            {
+                record(*other, true);
+                items.release(other);
+            }
+        }
+        items.release(&item);
+    };
+
+    // Called once all the chunks of a file are done.
+    auto finish_tree = [&](TreeFile& file)
+    {
+        WorkItem& item = *file.item;
+        StatTimer digest_timer(stats, StatPhase::digest);
+        const bool ok = tree_root(algorithms, tree_chunk, item.size, file.digests.data(), file.chunks, item.digests);
+        digest_timer.stop();
+        if (!ok)
+        {
+            std::cerr << "Error finalizing digest for " << item.name << std::endl;
+            return false;
+        }
+        if (stats && file.chunks > 0)
+        {
+            stats->add_file(item.name, item.size, RunStats::Clock::now() - file.started);
+        }
+        completed(item);
+        return true;
+    };
+
+    // Called by the crawling threads for every file found. Once handed to
+    // a queue or to the DedupTable, an item may be freed at any time.
+    auto found = [&](const ScannedFile& file)
+    {
+        if (stop.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+        WorkItem* item = items.create(file, digest_bytes);
+
+        if (verifier && !verifier->expect(item->name) && verifier->should_stop())
+        {
+            halt();
+            return false;
+        }
+
+        if (!journaled.empty())
+        {
+            auto it = journaled.find(item->name);
+            if (it != journaled.end() && it->second.key == journal_key(item->key))
+            {
+                std::copy_n(it->second.digests, digest_bytes, item->digests);
+                resumed.fetch_add(1, std::memory_order_relaxed);
+                record(*item, false);
+                items.release(item);
+                return true;
+            }
+        }
+
+        std::size_t hits = 0;
+        std::uint8_t* out = item->digests;
+        for (; hits < caches.size(); ++hits)
+        {
+            const std::uint8_t* cached = caches[hits]->lookup(item->key);
+            if (!cached)
+            {
+                break;
+            }
+            out = std::copy_n(cached, digest_size(algorithms[hits]), out);
+        }
+        if (!caches.empty() && hits == caches.size())
+        {
+            cache_hits.fetch_add(1, std::memory_order_relaxed);
+            completed(*item);
+            return true;
+        }
+
+        std::string group;
+        if (file.links > 1)
+        {
+            group.assign("i", 1);
+            group.append(reinterpret_cast<const char*>(&item->key.dev), sizeof(item->key.dev));
+            group.append(reinterpret_cast<const char*>(&item->key.ino), sizeof(item->key.ino));
+        }
+        else if (options_.dedupExtents && item->size >= extentDedupMinSize)
+        {
+            const std::string signature = extent_signature(walker.fd(), *item);
+            if (!signature.empty())
+            {
+                group = 'e' + signature;
+            }
+        }
+        bool ready = false;
+        const std::uint64_t size = item->size;
+        if (!group.empty() && dedup.join(std::move(group), item, ready))
+        {
+            shared_files.fetch_add(1, std::memory_order_relaxed);
+            shared_bytes.fetch_add(size, std::memory_order_relaxed);
+            if (ready)
+            {
+                record(*item, true);
+                items.release(item);
+            }
+            return true;
+        }
+
+        if (options_.readOrder == ReadOrder::inode)
+        {
+            item->location = item->key.ino;
+        }
+        else if (options_.readOrder == ReadOrder::extent)
+        {
+            item->location = first_block(walker.fd(), *item);
+        }
+        progress.file_queued(item->size);
+        if (tree_chunk > 0)
+        {
+            item->tree = std::make_unique<TreeFile>(item, tree_chunk_count(item->size, tree_chunk), digest_bytes);
+            if (item->tree->chunks > 0)
+            {
+                chunks.push(item->tree.get());
+            }
+            else if (!finish_tree(*item->tree))
+            {
+                failed = true;
+                halt();
+                return false;
+            }
+            return true;
+        }
+        queue.push(item);
+        return true;
+    };
+
+    // With a single worker the other CPUs would sit idle: the algorithms of
+    // each file are spread over threads instead.
+    const bool spread = options_.jobs <= 1 && std::thread::hardware_concurrency() > 1;
+
+    auto hash_batch = [&](const std::vector<WorkItem*>& batch, WorkerState& state)
+    {
+        if (!hash_small_files(walker.fd(), batch, state, progress, stats))
+        {
+            return false;
+        }
+        for (const WorkItem* item : batch)
+        {
+            completed(*item);
+        }
+        return true;
+    };
+
+    auto worker = [&]()
+    {
+        std::vector<WorkItem*> batch;
+        WorkerState state(algorithms, spread, options_.readMode);
+        if (tree_chunk > 0)
+        {
+            TreeFile* file = nullptr;
+            std::uint64_t chunk = 0;
+            while (!stop.load(std::memory_order_relaxed) && chunks.pop(file, chunk))
+            {
+                if (chunk == 0)
+                {
+                    progress.file_started(*file->item);
+                    if (stats)
+                    {
+                        file->started = RunStats::Clock::now();
+                    }
+                }
+                if (!hash_chunk(walker.fd(), *file, chunk, tree_chunk, state, progress, stats)
+                    || (file->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1 && !finish_tree(*file)))
+                {
+                    failed = true;
+                    halt();
+                    break;
+                }
+            }
+            return;
+        }
+        if (options_.ioUring)
+        {
+            UringHasher hasher(algorithms, spread, options_.readMode, options_.ioDepth,
+                               std::size_t{options_.ioBufferKiB} * 1024);
+            if (hasher.init())
+            {
+                auto hash_state_batch = [&](const std::vector<WorkItem*>& small_batch)
+                {
+                    return hash_batch(small_batch, state);
+                };
+                if (!hasher.run(walker.fd(), queue, stop, progress, stats, hash_state_batch, completed))
+                {
+                    failed = true;
+                    halt();
+                }
+                return;
+            }
+        }
+
+        bool small = false;
+        while (!stop.load(std::memory_order_relaxed) && queue.pop(batch, small))
+        {
+            if (small)
+            {
+                if (!hash_batch(batch, state))
+                {
+                    failed = true;
+                    halt();
+                    break;
+                }
+                continue;
+            }
+
+            const WorkItem& item = *batch.front();
+            progress.file_started(item);
+            const auto started = stats ? RunStats::Clock::now() : RunStats::Clock::time_point{};
+            if (!hash_file(walker.fd(), item, state, progress, stats))
+            {
+                failed = true;
+                halt();
+                break;
+            }
+            if (stats)
+            {
+                stats->add_file(item.name, item.size, RunStats::Clock::now() - started);
+            }
+            completed(item);
+        }
+    };
+
+    // Hashing starts with the first file found, while the walk goes on.
+    StatTimer hash_timer(stats, StatPhase::hash);
+    std::vector<std::thread> workers;
+    workers.reserve(std::max(options_.jobs, 1u));
+    for (unsigned i = 0; i < std::max(options_.jobs, 1u); ++i)
+    {
+        workers.emplace_back(worker);
+    }
+
+    StatTimer scan_timer(stats, StatPhase::scan);
+    const bool walked = walker.walk(found);
+    scan_timer.stop();
+    queue.close();
+    chunks.close();
+    if (!walked && !stop)
+    {
+        failed = true;
+        halt();
+    }
+    if (walked && verifier)
+    {
+        verifier->report_missing();
+        if (verifier->should_stop())
+        {
+            halt();
+        }
+    }
+    for (auto& t : workers)
+    {
+        t.join();
+    }
+    hash_timer.stop();
+
+    if (failed)
+    {
+        return false;
+    }
+    progress.finish();
+    if (stats)
+    {
+        stats->add_count(StatCounter::cache_hits, cache_hits);
+        stats->add_count(StatCounter::shared_files, shared_files);
+        stats->add_count(StatCounter::shared_bytes, shared_bytes);
+        stats->add_count(StatCounter::resumed_entries, resumed);
+    }
+
+    if (verifier)
+    {
+        if (options_.showProgress)
+        {
+            std::cout << std::endl;
+        }
+        return verifier->finish();
+    }
+
+    // A cache that could not be saved fails the run: the next one would
+    // silently hash everything again.
+    StatTimer cache_timer(stats, StatPhase::write);
+    bool cached = true;
+    for (const auto& cache : caches)
+    {
+        // A cache beside the log belongs to this directory only: rewriting it
+        // from scratch drops the files that were deleted.
+        cached = cache->save(options_.cachePath.has_value()) && cached;
+    }
+    cache_timer.stop();
+
+    // Sorted logs are merged from their runs here.
+    StatTimer write_timer(stats, options_.sortEntries ? StatPhase::sort : StatPhase::write);
+    bool closed = writer->close();
+    if (closed)
+    {
+        journal->remove();
+    }
+    std::optional<ChunkSidecar> sidecar;
+    if (options_.treeSidecar)
+    {
+        // In walk order; paths sharing their contents take those of their
+        // DedupTable leader.
+        sidecar.emplace(algorithms, tree_chunk);
+        if (!sidecar->open(logPath, stem))
+        {
+            return false;
+        }
+        for (const auto& item : items.kept())
+        {
+            const TreeFile& file = *(item->same ? item->same : item.get())->tree;
+            sidecar->add(item->name, file.digests.data(), file.chunks);
+        }
+        closed = sidecar->close() && closed;
+    }
+    std::ostringstream done_line;
+    done_line << (options_.showProgress ? "\n" : "");
+    if (!caches.empty() && options_.showProgress)
+    {
+        done_line << cache_hits << " unchanged files taken from cache\n";
+    }
+    if (options_.resume && options_.showProgress)
+    {
+        done_line << resumed << " files taken from the journal of the interrupted run\n";
+    }
+    if (shared_files > 0 && options_.showProgress)
+    {
+        done_line << shared_files << " files sharing the contents of another one hashed once, "
+                  << shared_bytes << " bytes not read\n";
+    }
+    for (const auto& path : writer->paths())
+    {
+        done_line << "Log file: " << path << "\n";
+    }
+    if (sidecar)
+    {
+        done_line << "Chunk digests: " << sidecar->path() << "\n";
+    }
+    std::cout << done_line.str() << std::flush;
+    return closed && cached;
 }
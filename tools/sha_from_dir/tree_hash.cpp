@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <sha_from_dir/tree_hash.h>
+
+#include <iostream>
+#include <system_error>
+
+namespace
+{
+  constexpr std::size_t sidecarBufferSize = 1024 * 1024;
+
+  void put_le64(std::uint8_t* out, std::uint64_t value)
+  {
+    for (int i = 0; i < 8; ++i)
+    {
+      out[i] = static_cast<std::uint8_t>(value >> (8 * i));
+    }
+  }
+}  // namespace
+
+std::uint64_t tree_chunk_count(std::uint64_t size, std::uint64_t chunkSize)
+{
+  return (size + chunkSize - 1) / chunkSize;
+}
+
+std::string tree_label(std::uint64_t chunkSize)
+{
+  std::string label = "-tree";
+  label += std::to_string(chunkSize / (1024 * 1024));
+  label += 'm';
+  return label;
+}
+
+bool tree_root(const std::vector<DigestAlgorithm>& algorithms, std::uint64_t chunkSize, std::uint64_t size,
+               const std::uint8_t* chunkDigests, std::uint64_t chunks, std::uint8_t* out)
+{
+  const std::size_t stride = digest_size(algorithms);
+  std::uint8_t header[16];
+  put_le64(header, chunkSize);
+  put_le64(header + 8, size);
+
+  std::size_t offset = 0;
+  for (auto algorithm : algorithms)
+  {
+    const std::size_t length = digest_size(algorithm);
+    MultiDigest digest({algorithm}, false);
+    if (!digest.valid() || !digest.init() || !digest.update(header, sizeof(header)))
+    {
+      return false;
+    }
+    for (std::uint64_t i = 0; i < chunks; ++i)
+    {
+      if (!digest.update(chunkDigests + i * stride + offset, length))
+      {
+        return false;
+      }
+    }
+    if (!digest.final(out + offset))
+    {
+      return false;
+    }
+    offset += length;
+  }
+  return true;
+}
+
+ChunkSidecar::ChunkSidecar(std::vector<DigestAlgorithm> algorithms, std::uint64_t chunkSize)
+    : algorithms_(std::move(algorithms)), chunkSize_(chunkSize)
+{
+}
+
+bool ChunkSidecar::open(const std::filesystem::path& logPath, const std::string& stem)
+{
+  path_ = logPath / (stem + tree_label(chunkSize_) + ".chunks");
+  partPath_ = path_;
+  partPath_ += ".part";
+  out_.open(partPath_, std::ios::binary | std::ios::trunc);
+  if (!out_)
+  {
+    std::cerr << "Error! Cannot open " << partPath_ << " for writing" << std::endl;
+    return false;
+  }
+  buffer_.reserve(sidecarBufferSize);
+  buffer_ = "# tree-hash chunk ";
+  buffer_ += std::to_string(chunkSize_);
+  for (std::size_t i = 0; i < algorithms_.size(); ++i)
+  {
+    buffer_ += i == 0 ? ' ' : ',';
+    buffer_ += digest_name(algorithms_[i]);
+  }
+  buffer_ += '\n';
+  return true;
+}
+
+void ChunkSidecar::add(std::string_view name, const std::uint8_t* chunkDigests, std::uint64_t chunks)
+{
+  for (std::uint64_t i = 0; i < chunks; ++i)
+  {
+    buffer_ += std::to_string(i);
+    for (auto algorithm : algorithms_)
+    {
+      const std::size_t length = digest_size(algorithm);
+      buffer_ += ' ';
+      append_hex(buffer_, chunkDigests, length);
+      chunkDigests += length;
+    }
+    buffer_.append("  ").append(name).push_back('\n');
+    if (buffer_.size() >= sidecarBufferSize)
+    {
+      out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+      buffer_.clear();
+    }
+  }
+}
+
+bool ChunkSidecar::close()
+{
+  out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+  buffer_.clear();
+  out_.close();
+  std::error_code ec;
+  if (!out_)
+  {
+    std::cerr << "Error! Unable to write " << partPath_ << std::endl;
+    std::filesystem::remove(partPath_, ec);
+    return false;
+  }
+  std::filesystem::rename(partPath_, path_, ec);
+  if (ec)
+  {
+    std::cerr << "Error! Cannot rename " << partPath_ << ": " << ec.message() << std::endl;
+    return false;
+  }
+  return true;
+}
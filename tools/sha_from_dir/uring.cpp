@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <sha_from_dir/uring.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+  int io_uring_setup(unsigned entries, struct io_uring_params* params)
+  {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+  }
+
+  int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+  {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+  }
+
+  int io_uring_register(int fd, unsigned opcode, const void* arg, unsigned count)
+  {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+  }
+
+  // The ring indices are shared with the kernel.
+  unsigned load_acquire(unsigned* p)
+  {
+    return std::atomic_ref<unsigned>(*p).load(std::memory_order_acquire);
+  }
+
+  void store_release(unsigned* p, unsigned value)
+  {
+    std::atomic_ref<unsigned>(*p).store(value, std::memory_order_release);
+  }
+
+  void* map_ring(int fd, std::size_t size, off_t offset)
+  {
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return p == MAP_FAILED ? nullptr : p;
+  }
+
+  template <typename T>
+  T* at(void* base, std::uint32_t offset)
+  {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+  }
+}  // namespace
+
+IoUring::~IoUring()
+{
+  if (sqes_)
+  {
+    munmap(sqes_, sqesSize_);
+  }
+  if (cqRing_ && cqRing_ != sqRing_)
+  {
+    munmap(cqRing_, cqRingSize_);
+  }
+  if (sqRing_)
+  {
+    munmap(sqRing_, sqRingSize_);
+  }
+  if (fd_ >= 0)
+  {
+    ::close(fd_);
+  }
+}
+
+bool IoUring::init(unsigned entries)
+{
+  struct io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  fd_ = io_uring_setup(entries, &params);
+  if (fd_ < 0)
+  {
+    return false;
+  }
+
+  // Kernels before 5.6 have no openat/close/read operations.
+  std::vector<std::uint8_t> probeBuffer(sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op));
+  auto* probe = reinterpret_cast<struct io_uring_probe*>(probeBuffer.data());
+  if (io_uring_register(fd_, IORING_REGISTER_PROBE, probe, 256) < 0)
+  {
+    return false;
+  }
+  for (unsigned op : {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_READ_FIXED, IORING_OP_CLOSE})
+  {
+    if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+    {
+      errno = EOPNOTSUPP;
+      return false;
+    }
+  }
+
+  sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single)
+  {
+    sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+  }
+  sqRing_ = map_ring(fd_, sqRingSize_, IORING_OFF_SQ_RING);
+  if (!sqRing_)
+  {
+    return false;
+  }
+  cqRing_ = single ? sqRing_ : map_ring(fd_, cqRingSize_, IORING_OFF_CQ_RING);
+  if (!cqRing_)
+  {
+    return false;
+  }
+  sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = static_cast<struct io_uring_sqe*>(map_ring(fd_, sqesSize_, IORING_OFF_SQES));
+  if (!sqes_)
+  {
+    return false;
+  }
+
+  sqHead_ = at<unsigned>(sqRing_, params.sq_off.head);
+  sqTail_ = at<unsigned>(sqRing_, params.sq_off.tail);
+  sqMask_ = *at<unsigned>(sqRing_, params.sq_off.ring_mask);
+  cqHead_ = at<unsigned>(cqRing_, params.cq_off.head);
+  cqTail_ = at<unsigned>(cqRing_, params.cq_off.tail);
+  cqMask_ = *at<unsigned>(cqRing_, params.cq_off.ring_mask);
+  cqes_ = at<struct io_uring_cqe>(cqRing_, params.cq_off.cqes);
+  tail_ = *sqTail_;
+
+  // Entries are always used in ring order: the indirection array is the
+  // identity.
+  unsigned* array = at<unsigned>(sqRing_, params.sq_off.array);
+  for (unsigned i = 0; i < params.sq_entries; ++i)
+  {
+    array[i] = i;
+  }
+  return true;
+}
+
+bool IoUring::register_buffers(const struct iovec* buffers, unsigned count)
+{
+  return io_uring_register(fd_, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+}
+
+struct io_uring_sqe* IoUring::next_sqe(std::uint8_t opcode, int fd, std::uint64_t user_data)
+{
+  struct io_uring_sqe* sqe = &sqes_[tail_ & sqMask_];
+  ++tail_;
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->user_data = user_data;
+  return sqe;
+}
+
+void IoUring::openat(int dir_fd, const char* path, int flags, std::uint64_t user_data)
+{
+  struct io_uring_sqe* sqe = next_sqe(IORING_OP_OPENAT, dir_fd, user_data);
+  sqe->addr = reinterpret_cast<std::uint64_t>(path);
+  sqe->open_flags = static_cast<std::uint32_t>(flags);
+}
+
+void IoUring::read(int fd, void* buffer, std::size_t length, std::uint64_t offset, std::uint64_t user_data)
+{
+  struct io_uring_sqe* sqe = next_sqe(IORING_OP_READ, fd, user_data);
+  sqe->addr = reinterpret_cast<std::uint64_t>(buffer);
+  sqe->len = static_cast<std::uint32_t>(length);
+  sqe->off = offset;
+}
+
+void IoUring::read_fixed(int fd, void* buffer, std::size_t length, std::uint64_t offset, unsigned buffer_index,
+                         std::uint64_t user_data)
+{
+  struct io_uring_sqe* sqe = next_sqe(IORING_OP_READ_FIXED, fd, user_data);
+  sqe->addr = reinterpret_cast<std::uint64_t>(buffer);
+  sqe->len = static_cast<std::uint32_t>(length);
+  sqe->off = offset;
+  sqe->buf_index = static_cast<std::uint16_t>(buffer_index);
+}
+
+void IoUring::close(int fd, std::uint64_t user_data)
+{
+  next_sqe(IORING_OP_CLOSE, fd, user_data);
+}
+
+bool IoUring::submit(unsigned wait)
+{
+  store_release(sqTail_, tail_);
+  while (true)
+  {
+    const unsigned pending = tail_ - load_acquire(sqHead_);
+    if (pending == 0 && wait == 0)
+    {
+      return true;
+    }
+    const int res = io_uring_enter(fd_, pending, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0);
+    if (res < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (res < 0)
+    {
+      return false;
+    }
+    // Everything was consumed, or the wait was satisfied.
+    if (static_cast<unsigned>(res) == pending)
+    {
+      return true;
+    }
+  }
+}
+
+bool IoUring::pop(Completion& out)
+{
+  const unsigned head = *cqHead_;
+  if (head == load_acquire(cqTail_))
+  {
+    return false;
+  }
+  const struct io_uring_cqe& cqe = cqes_[head & cqMask_];
+  out.user_data = cqe.user_data;
+  out.res = cqe.res;
+  store_release(cqHead_, head + 1);
+  return true;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <sha_from_tar/index_sidecar.h>
+
+#include <algorithm>
+#include <iostream>
+#include <system_error>
+
+namespace
+{
+  constexpr char indexMagic[8] = {'V', 'M', 'S', 'T', 'I', 'D', 'X', '1'};
+  constexpr std::size_t indexBufferSize = 1024 * 1024;
+  // u64 header offset, u64 data offset, u64 size, u32 name length.
+  constexpr std::size_t recordNameOffset = 28;
+
+  std::uint64_t fnv1a(std::string_view data)
+  {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (char c : data)
+    {
+      hash ^= static_cast<std::uint8_t>(c);
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  void put_le(std::string& out, std::uint64_t value, int bytes)
+  {
+    for (int i = 0; i < bytes; ++i)
+    {
+      out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+  }
+}  // namespace
+
+TarIndexSidecar::TarIndexSidecar(std::vector<DigestAlgorithm> algorithms)
+    : algorithms_(std::move(algorithms)), digestBytes_(digest_size(algorithms_))
+{
+}
+
+TarIndexSidecar::~TarIndexSidecar()
+{
+  if (!partPath_.empty() && !closed_)
+  {
+    out_.close();
+    std::error_code ec;
+    std::filesystem::remove(partPath_, ec);
+  }
+}
+
+bool TarIndexSidecar::open(const std::filesystem::path& logPath, const std::string& stem, std::uint64_t archiveSize,
+                           std::int64_t archiveMtimeNs)
+{
+  path_ = logPath / (stem + ".tarindex");
+  partPath_ = path_;
+  partPath_ += ".part";
+  out_.open(partPath_, std::ios::binary | std::ios::trunc);
+  if (!out_)
+  {
+    std::cerr << "Error! Cannot open " << partPath_ << " for writing" << std::endl;
+    return false;
+  }
+  buffer_.reserve(indexBufferSize);
+  buffer_.append(indexMagic, sizeof(indexMagic));
+  put_le(buffer_, archiveSize, 8);
+  put_le(buffer_, static_cast<std::uint64_t>(archiveMtimeNs), 8);
+  put_le(buffer_, algorithms_.size(), 4);
+  for (auto algorithm : algorithms_)
+  {
+    const std::string_view name = digest_name(algorithm);
+    put_le(buffer_, name.size(), 4);
+    buffer_ += name;
+  }
+  written_ = buffer_.size();
+  return true;
+}
+
+bool TarIndexSidecar::add(std::size_t index, std::string_view name, std::uint64_t headerOffset,
+                          std::uint64_t dataOffset, std::uint64_t size, const std::uint8_t* digests)
+{
+  std::string record;
+  record.reserve(recordNameOffset + name.size() + digestBytes_);
+  put_le(record, headerOffset, 8);
+  put_le(record, dataOffset, 8);
+  put_le(record, size, 8);
+  put_le(record, name.size(), 4);
+  record.append(name).append(reinterpret_cast<const char*>(digests), digestBytes_);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (failed_)
+  {
+    return false;
+  }
+  if (index != nextIndex_)
+  {
+    waiting_.emplace(index, std::move(record));
+    return true;
+  }
+  write_record(record);
+  ++nextIndex_;
+  for (auto it = waiting_.begin(); it != waiting_.end() && it->first == nextIndex_; it = waiting_.erase(it))
+  {
+    write_record(it->second);
+    ++nextIndex_;
+  }
+  return flush(false);
+}
+
+void TarIndexSidecar::write_record(const std::string& record)
+{
+  const std::size_t nameLength = record.size() - recordNameOffset - digestBytes_;
+  table_.emplace_back(fnv1a(std::string_view{record}.substr(recordNameOffset, nameLength)), written_);
+  buffer_ += record;
+  written_ += record.size();
+}
+
+bool TarIndexSidecar::flush(bool force)
+{
+  if (buffer_.size() < indexBufferSize && !force)
+  {
+    return true;
+  }
+  out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+  buffer_.clear();
+  if (!out_ && !failed_)
+  {
+    std::cerr << "Error! Unable to write " << partPath_ << std::endl;
+    failed_ = true;
+  }
+  return !failed_;
+}
+
+bool TarIndexSidecar::close()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& entry : waiting_)
+  {
+    write_record(entry.second);
+  }
+  waiting_.clear();
+
+  const std::uint64_t tableOffset = written_;
+  std::sort(table_.begin(), table_.end());
+  for (const auto& [hash, offset] : table_)
+  {
+    put_le(buffer_, hash, 8);
+    put_le(buffer_, offset, 8);
+    flush(false);
+  }
+  put_le(buffer_, tableOffset, 8);
+  put_le(buffer_, table_.size(), 8);
+  put_le(buffer_, flags_, 4);
+  buffer_.append(indexMagic, sizeof(indexMagic));
+  flush(true);
+  out_.close();
+  if (!out_ && !failed_)
+  {
+    std::cerr << "Error! Unable to write " << partPath_ << std::endl;
+    failed_ = true;
+  }
+  if (failed_)
+  {
+    return false;
+  }
+  std::error_code ec;
+  std::filesystem::rename(partPath_, path_, ec);
+  if (ec)
+  {
+    std::cerr << "Error! Cannot rename " << partPath_ << ": " << ec.message() << std::endl;
+    return false;
+  }
+  closed_ = true;
+  return true;
+}
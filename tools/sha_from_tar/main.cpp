@@ -8,10 +8,12 @@
 #include <cstdlib>
 #include <filesystem>
 #include <iostream>
+#include <optional>
 #include <vector>
 
 #include <sha_from_tar/options.h>
 #include <sha_from_tar/process.h>
+#include <vms_common/scheduler.h>
 
 namespace fs = std::filesystem;
 
@@ -39,24 +41,39 @@ int main(int argc, char* argv[]) {
       if (!entry.is_regular_file()) {
         continue;
       }
-      if (entry.path().extension() == ".tar") {
+      if (is_tar_archive(entry.path())) {
         tarFiles.push_back(entry.path());
       }
     }
   }
 
   if (tarFiles.empty()) {
-    std::cout << "No .tar archives found in " << options.searchDir << '\n';
+    std::cout << "No tar archives found in " << options.searchDir << '\n';
     return EXIT_SUCCESS;
   }
 
   std::filesystem::path logPath = options.logPath.has_value() 
       ? options.logPath.value() : options.searchDir;
 
-  TarProcessor processor;
-  bool ok = true;
-  for (const auto& tarPath : tarFiles) {
-    ok &= processor.process(tarPath, logPath, options.sortEntries);
+  // Several archives in flight would overwrite each other's progress bar.
+  if (options.parallelItems > 1 && tarFiles.size() > 1) {
+    options.showProgress = false;
+  }
+
+  std::optional<StatsReport> stats;
+  if (options.statsPath) {
+    stats.emplace("sha_from_tar");
+  }
+
+  TarProcessor processor(options, stats ? &*stats : nullptr);
+  ItemScheduler scheduler(options.parallelItems, options.perDevice);
+  bool ok = scheduler.run(tarFiles, [&processor, &logPath](const fs::path& tarPath) {
+    return processor.process(tarPath, logPath);
+  });
+
+  // Written even after a failure: that is when it is most useful.
+  if (stats && !stats->write(*options.statsPath)) {
+    ok = false;
   }
 
   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
@@ -6,6 +6,8 @@
  */
 
 #include <sha_from_tar/options.h>
+#include <vms_common/cli.h>
+#include <vms_common/digest.h>
 
 #include <filesystem>
 #include <iostream>
@@ -18,12 +20,32 @@ void OptionsParser::print_usage(std::ostream& os) const {
   os << "sha-from-tar — by Manuel Virgilio" << std::endl;
   os << "Compute SHA-256 for files inside tar archives without extracting them." << std::endl;
   os << "Usage:" << std::endl;
-  os << "  sha_from_tar [-f <archive> | -C <dir>] [-O <dir>] [-s] [-h]" << std::endl;
+  os << "  sha_from_tar [-f <archive> | -C <dir>] [-O <dir>] [-s] [--sort-memory <MiB>] [-j <n>] [-P <n>] [--per-device <n>]" << std::endl;
+  os << "               [--decompress-threads <n>] [--algo <list>] [--combined] [--verify <manifest> [--fail-fast]] [--stats <file>] [--resume] [--index] [-h]" << std::endl;
   os << "Options:" << std::endl;
-  os << "  -f <archive>  Scan a single .tar archive" << std::endl;
-  os << "  -C <dir>      Search for .tar archives in <dir> (default: current directory)" << std::endl;
-  os << "  -O <dir>      Directory where .sha256 logs are written (default: search dir)" << std::endl;
+  os << "  -f <archive>  Scan a single tar archive, compressed or not" << std::endl;
+  os << "  -C <dir>      Search for .tar, .tar.gz, .tar.zst, .tar.xz and .tar.bz2 archives in <dir>" << std::endl;
+  os << "                (default: current directory)" << std::endl;
+  os << "  -O <dir>      Directory where the .<algo> logs are written (default: search dir)" << std::endl;
   os << "  -s            Sort entries alphabetically in each log" << std::endl;
+  os << "  --sort-memory <MiB>  Memory for the entries sorted with -s, or without it for those completed" << std::endl;
+  os << "                ahead of earlier ones, before they are spilled to disk in runs (default: 256)" << std::endl;
+  os << "  -j <n>        Hash with <n> threads fed by the decompressor thread (0: one per CPU, default: 1)" << std::endl;
+  os << "  --decompress-threads <n>  Decompress .tar.gz, .tar.zst and .tar.xz archives on <n> threads" << std::endl;
+  os << "                (0: one per CPU, default: as many as -j; 1: a single libarchive thread)" << std::endl;
+  os << "  -P <n>        Process up to <n> archives at once (0: one per CPU, default: 1)" << std::endl;
+  os << "  --per-device <n>  Process at most <n> archives at once on the same device (default: 1)" << std::endl;
+  os << "  --algo <list> Comma separated digest algorithms, computed in a single pass, one log each named after" << std::endl;
+  os << "                the algorithm: " << available_digests() << " (default: sha256)" << std::endl;
+  os << "  --combined    Write a single <name>.digests log in BSD tag format instead of one log per algorithm" << std::endl;
+  os << "  --verify <manifest>  Check the entries against <manifest> instead of writing a log;" << std::endl;
+  os << "                if <manifest> is a directory, <manifest>/<name>.<algo> is used for each archive" << std::endl;
+  os << "  --fail-fast   With --verify, stop at the first missing, extra or mismatching entry" << std::endl;
+  os << "  --stats <file> Write timings, counters, read sizes and the slowest files of each archive to <file> as JSON" << std::endl;
+  os << "  --resume      Continue an interrupted run: the entries it journaled in <name>.journal, beside the logs," << std::endl;
+  os << "                are skipped rather than hashed again, as long as the archive did not change" << std::endl;
+  os << "  --index       Also write <name>.tarindex beside the logs: a binary index of the offsets, size and" << std::endl;
+  os << "                digests of every entry, for lookups that seek straight to an entry" << std::endl;
   os << "  -h, --help    Show this help message" << std::endl;
 }
 
@@ -72,9 +94,155 @@ bool OptionsParser::parse(int argc, char* argv[], Options& out) const {
       continue;
     }
 
+    if (arg == "--sort-memory")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --sort-memory requires a number" << std::endl;
+        return false;
+      }
+      if (!parse_unsigned(arg, argv[++i], out.sortMemoryMiB))
+      {
+        return false;
+      }
+      if (out.sortMemoryMiB == 0)
+      {
+        std::cerr << "Error: --sort-memory must be greater than 0" << std::endl;
+        return false;
+      }
+      continue;
+    }
+    if (arg == "-j")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: -j requires a number" << std::endl;
+        return false;
+      }
+      if (!parse_thread_count(arg, argv[++i], out.jobs))
+      {
+        return false;
+      }
+      continue;
+    }
+    if (arg == "--decompress-threads")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --decompress-threads requires a number" << std::endl;
+        return false;
+      }
+      if (!parse_thread_count(arg, argv[++i], out.decompressThreads))
+      {
+        return false;
+      }
+      continue;
+    }
+    if (arg == "-P")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: -P requires a number" << std::endl;
+        return false;
+      }
+      if (!parse_thread_count(arg, argv[++i], out.parallelItems))
+      {
+        return false;
+      }
+      continue;
+    }
+    if (arg == "--per-device")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --per-device requires a number" << std::endl;
+        return false;
+      }
+      if (!parse_thread_count(arg, argv[++i], out.perDevice))
+      {
+        return false;
+      }
+      continue;
+    }
+    if (arg == "--algo")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --algo requires a list of names" << std::endl;
+        return false;
+      }
+      if (!parse_digest_algorithms(arg, argv[++i], out.algorithms))
+      {
+        return false;
+      }
+      continue;
+    }
+
+    if (arg == "--combined")
+    {
+      out.combinedLog = true;
+      continue;
+    }
+
+    if (arg == "--verify")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --verify requires a path" << std::endl;
+        return false;
+      }
+      out.verifyManifest = fs::path{argv[++i]};
+      continue;
+    }
+    if (arg == "--fail-fast")
+    {
+      out.failFast = true;
+      continue;
+    }
+
+    if (arg == "--stats")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --stats requires a path" << std::endl;
+        return false;
+      }
+      out.statsPath = fs::path{argv[++i]};
+      continue;
+    }
+
+    if (arg == "--resume")
+    {
+      out.resume = true;
+      continue;
+    }
+
+    if (arg == "--index")
+    {
+      out.writeIndex = true;
+      continue;
+    }
+
     std::cerr << "Unknown parameter: " << arg << std::endl;
     return false;
   }
 
+  if (out.resume && out.verifyManifest)
+  {
+    std::cerr << "Error: --resume cannot be combined with --verify" << std::endl;
+    return false;
+  }
+
+  if (out.writeIndex && out.verifyManifest)
+  {
+    std::cerr << "Error: --index cannot be combined with --verify" << std::endl;
+    return false;
+  }
+
+  if (out.algorithms.empty())
+  {
+    out.algorithms.push_back(DigestAlgorithm::sha256);
+  }
+
   return true;
 }
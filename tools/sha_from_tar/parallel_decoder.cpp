@@ -0,0 +1,676 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <sha_from_tar/parallel_decoder.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef VMS_TOOLS_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef VMS_TOOLS_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef VMS_TOOLS_HAVE_LZMA
+#include <lzma.h>
+#endif
+
+namespace
+{
+  constexpr std::size_t blockSize = 1024 * 1024;
+  // Compressed bytes per unit, at least: a unit ends with the member or
+  // frame crossing this.
+  constexpr std::uint64_t unitSize = 4 * 1024 * 1024;
+  // Decoded bytes a unit may hold ahead of the reader.
+  constexpr std::size_t unitBufferLimit = 16 * 1024 * 1024;
+
+  // CM deflate, no reserved flag and a plausible XFL and OS: false
+  // positives inside compressed data are rare, and only cost a unit.
+  bool gzip_header_at(const std::uint8_t* data, std::uint64_t size, std::uint64_t pos)
+  {
+    if (size - pos < 18)
+    {
+      return false;
+    }
+    const std::uint8_t* p = data + pos;
+    return p[0] == 0x1f && p[1] == 0x8b && p[2] == 8 && (p[3] & 0xe0) == 0 && (p[8] == 0 || p[8] == 2 || p[8] == 4)
+           && (p[9] <= 13 || p[9] == 255);
+  }
+
+  // First likely gzip header at or after `from`, `size` when there is none.
+  std::uint64_t next_gzip_header(const std::uint8_t* data, std::uint64_t size, std::uint64_t from)
+  {
+    while (from < size)
+    {
+      const void* found = std::memchr(data + from, 0x1f, static_cast<std::size_t>(size - from));
+      if (!found)
+      {
+        break;
+      }
+      from = static_cast<std::uint64_t>(static_cast<const std::uint8_t*>(found) - data);
+      if (gzip_header_at(data, size, from))
+      {
+        return from;
+      }
+      ++from;
+    }
+    return size;
+  }
+
+  [[maybe_unused]] bool has_magic(const std::uint8_t* data, std::uint64_t size, const std::uint8_t* magic,
+                                  std::size_t length)
+  {
+    return size >= length && std::memcmp(data, magic, length) == 0;
+  }
+}  // namespace
+
+std::unique_ptr<ParallelDecoder> ParallelDecoder::open(const std::filesystem::path& path, unsigned threads)
+{
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return nullptr;
+  }
+  struct stat st{};
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+  {
+    ::close(fd);
+    return nullptr;
+  }
+  const auto size = static_cast<std::uint64_t>(st.st_size);
+  void* addr = mmap(nullptr, static_cast<std::size_t>(size), PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED)
+  {
+    return nullptr;
+  }
+  auto guard = std::make_unique<MappedRangeGuard>(addr, static_cast<std::size_t>(size));
+  if (!guard->registered())
+  {
+    munmap(addr, static_cast<std::size_t>(size));
+    return nullptr;
+  }
+  const auto* data = static_cast<const std::uint8_t*>(addr);
+
+  std::optional<Format> format;
+#ifdef VMS_TOOLS_HAVE_ZLIB
+  if (gzip_header_at(data, size, 0))
+  {
+    format = Format::gzip;
+  }
+#endif
+#ifdef VMS_TOOLS_HAVE_ZSTD
+  static constexpr std::uint8_t zstdMagic[] = {0x28, 0xb5, 0x2f, 0xfd};
+  if (has_magic(data, size, zstdMagic, sizeof(zstdMagic)))
+  {
+    format = Format::zstd;
+  }
+#endif
+#ifdef VMS_TOOLS_HAVE_LZMA
+  static constexpr std::uint8_t xzMagic[] = {0xfd, 0x37, 0x7a, 0x58, 0x5a, 0x00};
+  if (has_magic(data, size, xzMagic, sizeof(xzMagic)))
+  {
+    format = Format::xz;
+  }
+#endif
+  if (!format || guard->truncated())
+  {
+    guard.reset();
+    munmap(addr, static_cast<std::size_t>(size));
+    return nullptr;
+  }
+  return std::unique_ptr<ParallelDecoder>(
+      new ParallelDecoder(*format, data, size, threads, path.string(), std::move(guard)));
+}
+
+ParallelDecoder::ParallelDecoder(Format format, const std::uint8_t* data, std::uint64_t size, unsigned threads,
+                                 std::string name, std::unique_ptr<MappedRangeGuard> guard)
+    : format_(format), data_(data), size_(size), threads_(std::max(1u, threads)), name_(std::move(name)),
+      guard_(std::move(guard))
+{
+  // liblzma runs its own threads on the single xz unit.
+  const unsigned workers = format_ == Format::xz ? 1 : threads_;
+  workers_.reserve(workers);
+  for (unsigned i = 0; i < workers; ++i)
+  {
+    workers_.emplace_back([this] { worker(); });
+  }
+}
+
+ParallelDecoder::~ParallelDecoder()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    for (auto& unit : units_)
+    {
+      unit.cancelled = true;
+    }
+    for (auto& unit : dropped_)
+    {
+      unit.cancelled = true;
+    }
+  }
+  changed_.notify_all();
+  for (auto& worker : workers_)
+  {
+    worker.join();
+  }
+  guard_.reset();
+  munmap(const_cast<std::uint8_t*>(data_), static_cast<std::size_t>(size_));
+}
+
+ssize_t ParallelDecoder::read(const void** data)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (current_.capacity() > 0)
+  {
+    spare_.push_back(std::move(current_));
+    current_ = Block();
+  }
+  while (true)
+  {
+    // Whatever was decoded after the archive shrank is zeros.
+    if (guard_->truncated())
+    {
+      std::cerr << "Error decompressing " << name_ << ": archive truncated while reading" << std::endl;
+      return -1;
+    }
+    fill_window();
+    if (units_.empty())
+    {
+      done_.store(size_, std::memory_order_relaxed);
+      return 0;
+    }
+
+    Unit& head = units_.front();
+    if (!head.output.empty())
+    {
+      Output& output = head.output.front();
+      current_ = std::move(output.block);
+      done_.store(output.position, std::memory_order_relaxed);
+      head.output.pop_front();
+      head.buffered -= current_.size();
+      changed_.notify_all();
+      *data = current_.data();
+      return static_cast<ssize_t>(current_.size());
+    }
+
+    if (head.finished)
+    {
+      if (head.failed)
+      {
+        std::cerr << "Error decompressing " << name_ << " at offset " << head.start << ": " << head.error
+                  << std::endl;
+        return -1;
+      }
+      // Units planned inside what the head decoded started on a false
+      // header; a range nobody decodes yet gets a unit of its own.
+      const std::uint64_t end = head.stopped;
+      units_.pop_front();
+      while (!units_.empty() && units_.front().start < end)
+      {
+        drop_front();
+      }
+      if (units_.empty())
+      {
+        planned_ = end;
+      }
+      else if (units_.front().start > end)
+      {
+        units_.emplace_front(end, units_.front().start);
+        changed_.notify_all();
+      }
+      continue;
+    }
+
+    if (!head.started && running_ == workers_.size())
+    {
+      preempt();
+    }
+    changed_.wait(lock);
+  }
+}
+
+std::uint64_t ParallelDecoder::plan(std::uint64_t start) const
+{
+  switch (format_)
+  {
+  case Format::gzip:
+    return next_gzip_header(data_, size_, std::min(size_, start + unitSize));
+  case Format::zstd:
+  {
+#ifdef VMS_TOOLS_HAVE_ZSTD
+    std::uint64_t pos = start;
+    while (pos < size_ && pos - start < unitSize)
+    {
+      const std::size_t frame = ZSTD_findFrameCompressedSize(data_ + pos, static_cast<std::size_t>(size_ - pos));
+      if (ZSTD_isError(frame))
+      {
+        return size_;  // reported by the unit decoding it
+      }
+      pos += frame;
+    }
+    return pos;
+#else
+    return size_;
+#endif
+  }
+  case Format::xz:
+    return size_;
+  }
+  return size_;
+}
+
+void ParallelDecoder::fill_window()
+{
+  const std::size_t window = format_ == Format::xz ? 1 : std::size_t{threads_} * 2;
+  bool added = false;
+  while (units_.size() < window && planned_ < size_)
+  {
+    const std::uint64_t end = plan(planned_);
+    units_.emplace_back(planned_, end);
+    planned_ = end;
+    added = true;
+  }
+  if (added)
+  {
+    changed_.notify_all();
+  }
+}
+
+// The head waits for a worker while all of them decode units further
+// ahead: the furthest one is stopped and decoded again later.
+void ParallelDecoder::preempt()
+{
+  for (const auto& unit : units_)
+  {
+    if (unit.restart)
+    {
+      return;  // one is already on its way back
+    }
+  }
+  for (auto it = units_.rbegin(); it != units_.rend(); ++it)
+  {
+    if (it->started && !it->finished && !it->cancelled)
+    {
+      it->cancelled = true;
+      it->restart = true;
+      changed_.notify_all();
+      return;
+    }
+  }
+}
+
+void ParallelDecoder::drop_front()
+{
+  Unit& unit = units_.front();
+  recycle(unit);
+  if (unit.started && !unit.finished)
+  {
+    unit.cancelled = true;
+    unit.restart = false;
+    dropped_.splice(dropped_.end(), units_, units_.begin());
+    changed_.notify_all();
+    return;
+  }
+  units_.pop_front();
+}
+
+void ParallelDecoder::recycle(Unit& unit)
+{
+  for (auto& output : unit.output)
+  {
+    spare_.push_back(std::move(output.block));
+  }
+  unit.output.clear();
+  unit.buffered = 0;
+}
+
+ParallelDecoder::Block ParallelDecoder::take_block()
+{
+  if (spare_.empty())
+  {
+    return Block();
+  }
+  Block block = std::move(spare_.back());
+  spare_.pop_back();
+  return block;
+}
+
+void ParallelDecoder::worker()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true)
+  {
+    Unit* unit = nullptr;
+    changed_.wait(lock, [&] {
+      if (stopping_)
+      {
+        return true;
+      }
+      for (auto& candidate : units_)
+      {
+        if (!candidate.started)
+        {
+          unit = &candidate;
+          return true;
+        }
+      }
+      return false;
+    });
+    if (stopping_)
+    {
+      return;
+    }
+
+    unit->started = true;
+    ++running_;
+    lock.unlock();
+    const bool ok = decode(*unit);
+    lock.lock();
+    --running_;
+
+    if (!unit->cancelled)
+    {
+      unit->finished = true;
+      unit->failed = !ok;
+    }
+    else if (unit->restart)
+    {
+      recycle(*unit);
+      unit->started = false;
+      unit->restart = false;
+      unit->cancelled = false;
+      unit->error.clear();
+    }
+    else
+    {
+      dropped_.remove_if([unit](const Unit& candidate) { return &candidate == unit; });
+    }
+    changed_.notify_all();
+  }
+}
+
+bool ParallelDecoder::emit(Unit& unit, Block& block, std::size_t filled, std::uint64_t position)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [&] { return unit.cancelled || unit.buffered < unitBufferLimit; });
+  if (unit.cancelled)
+  {
+    return false;
+  }
+  block.resize(filled);
+  unit.buffered += filled;
+  unit.output.push_back(Output{std::move(block), position});
+  block = take_block();
+  lock.unlock();
+  changed_.notify_all();
+  block.resize(blockSize);
+  return true;
+}
+
+ParallelDecoder::Block ParallelDecoder::first_block()
+{
+  Block block;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    block = take_block();
+  }
+  block.resize(blockSize);
+  return block;
+}
+
+bool ParallelDecoder::decode(Unit& unit)
+{
+  switch (format_)
+  {
+  case Format::gzip:
+    return decode_gzip(unit);
+  case Format::zstd:
+    return decode_zstd(unit);
+  case Format::xz:
+    return decode_xz(unit);
+  }
+  return false;
+}
+
+bool ParallelDecoder::decode_gzip([[maybe_unused]] Unit& unit)
+{
+#ifdef VMS_TOOLS_HAVE_ZLIB
+  // Only gap units start elsewhere than on a header: after the last
+  // member, on trailing bytes that are ignored as libarchive does.
+  if (!gzip_header_at(data_, size_, unit.start))
+  {
+    unit.stopped = size_;
+    return true;
+  }
+
+  z_stream zs{};
+  if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK)
+  {
+    unit.error = "cannot initialise zlib";
+    return false;
+  }
+  constexpr std::uint64_t inputChunk = 1u << 30;
+  Block block = first_block();
+  std::size_t filled = 0;
+  // End of the input handed to zlib so far.
+  std::uint64_t pos = unit.start;
+  bool ok = true;
+  while (ok)
+  {
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END)
+    {
+      if (unit.cancelled)
+      {
+        ok = false;
+        break;
+      }
+      if (zs.avail_in == 0)
+      {
+        if (pos == size_)
+        {
+          unit.error = "unexpected end of gzip data";
+          ok = false;
+          break;
+        }
+        const std::uint64_t chunk = std::min(size_ - pos, inputChunk);
+        zs.next_in = const_cast<Bytef*>(data_ + pos);
+        zs.avail_in = static_cast<uInt>(chunk);
+        pos += chunk;
+      }
+      zs.next_out = block.data() + filled;
+      zs.avail_out = static_cast<uInt>(blockSize - filled);
+      ret = inflate(&zs, Z_NO_FLUSH);
+      const bool progressed = blockSize - zs.avail_out > filled;
+      filled = blockSize - zs.avail_out;
+      if ((ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+          || (ret == Z_BUF_ERROR && zs.avail_in > 0 && !progressed))
+      {
+        unit.error = zs.msg ? zs.msg : "corrupt gzip data";
+        ok = false;
+        break;
+      }
+      if (filled == blockSize)
+      {
+        if (!emit(unit, block, filled, pos - zs.avail_in))
+        {
+          ok = false;
+          break;
+        }
+        filled = 0;
+      }
+    }
+    if (!ok)
+    {
+      break;
+    }
+
+    // Member done: go on with the next one until past the planned end.
+    const std::uint64_t memberEnd = pos - zs.avail_in;
+    if (memberEnd >= unit.end || memberEnd == size_)
+    {
+      unit.stopped = memberEnd;
+      break;
+    }
+    if (!gzip_header_at(data_, size_, memberEnd))
+    {
+      unit.stopped = size_;
+      break;
+    }
+    inflateReset(&zs);
+  }
+  inflateEnd(&zs);
+  if (ok && filled > 0)
+  {
+    ok = emit(unit, block, filled, unit.stopped);
+  }
+  return ok;
+#else
+  return false;
+#endif
+}
+
+bool ParallelDecoder::decode_zstd([[maybe_unused]] Unit& unit)
+{
+#ifdef VMS_TOOLS_HAVE_ZSTD
+  ZSTD_DCtx* dctx = ZSTD_createDCtx();
+  if (!dctx)
+  {
+    unit.error = "cannot allocate a zstd context";
+    return false;
+  }
+  ZSTD_inBuffer in{data_ + unit.start, static_cast<std::size_t>(unit.end - unit.start), 0};
+  Block block = first_block();
+  std::size_t filled = 0;
+  bool ok = true;
+  while (true)
+  {
+    if (unit.cancelled)
+    {
+      ok = false;
+      break;
+    }
+    ZSTD_outBuffer out{block.data() + filled, blockSize - filled, 0};
+    const std::size_t ret = ZSTD_decompressStream(dctx, &out, &in);
+    if (ZSTD_isError(ret))
+    {
+      unit.error = ZSTD_getErrorName(ret);
+      ok = false;
+      break;
+    }
+    filled += out.pos;
+    if (filled == blockSize)
+    {
+      if (!emit(unit, block, filled, unit.start + in.pos))
+      {
+        ok = false;
+        break;
+      }
+      filled = 0;
+    }
+    // 0: the last frame is decoded and flushed. Otherwise, with all the
+    // input taken and room left for output, the frame is cut short.
+    if (in.pos == in.size && ret == 0)
+    {
+      break;
+    }
+    if (in.pos == in.size && out.pos < out.size)
+    {
+      unit.error = "unexpected end of zstd data";
+      ok = false;
+      break;
+    }
+  }
+  ZSTD_freeDCtx(dctx);
+  unit.stopped = unit.end;
+  if (ok && filled > 0)
+  {
+    ok = emit(unit, block, filled, unit.stopped);
+  }
+  return ok;
+#else
+  return false;
+#endif
+}
+
+bool ParallelDecoder::decode_xz([[maybe_unused]] Unit& unit)
+{
+#ifdef VMS_TOOLS_HAVE_LZMA
+  lzma_stream strm = LZMA_STREAM_INIT;
+  lzma_mt mt{};
+  mt.flags = LZMA_CONCATENATED;
+  mt.threads = threads_;
+  // Blocks too large for this are decoded on a single thread.
+  mt.memlimit_threading = std::max<std::uint64_t>(lzma_physmem() / 4, 64 * 1024 * 1024);
+  mt.memlimit_stop = UINT64_MAX;
+  if (lzma_stream_decoder_mt(&strm, &mt) != LZMA_OK)
+  {
+    unit.error = "cannot initialise liblzma";
+    return false;
+  }
+  strm.next_in = data_;
+  strm.avail_in = static_cast<std::size_t>(size_);
+  Block block = first_block();
+  std::size_t filled = 0;
+  bool ok = true;
+  while (true)
+  {
+    if (unit.cancelled)
+    {
+      ok = false;
+      break;
+    }
+    strm.next_out = block.data() + filled;
+    strm.avail_out = blockSize - filled;
+    const lzma_ret ret = lzma_code(&strm, LZMA_FINISH);
+    filled = blockSize - strm.avail_out;
+    if (ret == LZMA_STREAM_END)
+    {
+      break;
+    }
+    if (ret != LZMA_OK)
+    {
+      unit.error = ret == LZMA_DATA_ERROR || ret == LZMA_BUF_ERROR ? "corrupt or truncated xz data"
+                   : ret == LZMA_MEM_ERROR                         ? "out of memory"
+                                                                   : "liblzma error";
+      ok = false;
+      break;
+    }
+    if (filled == blockSize)
+    {
+      if (!emit(unit, block, filled, strm.total_in))
+      {
+        ok = false;
+        break;
+      }
+      filled = 0;
+    }
+  }
+  lzma_end(&strm);
+  unit.stopped = size_;
+  if (ok && filled > 0)
+  {
+    ok = emit(unit, block, filled, unit.stopped);
+  }
+  return ok;
+#else
+  return false;
+#endif
+}
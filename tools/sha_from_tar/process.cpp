@@ -9,31 +9,260 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cerrno>
 #include <cstdint>
+#include <cstring>
 #include <filesystem>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <fstream>
 #include <sys/stat.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include <archive.h>
 #include <archive_entry.h>
-#include <openssl/evp.h>
-#include <openssl/sha.h>
+
+#include <sha_from_tar/index_sidecar.h>
+#include <sha_from_tar/parallel_decoder.h>
+#include <sha_from_tar/tar_index.h>
+#include <vms_common/buffer_ring.h>
+#include <vms_common/digest.h>
+#include <vms_common/digest_log.h>
+#include <vms_common/entry_arena.h>
+#include <vms_common/journal.h>
+#include <vms_common/manifest.h>
+#include <vms_common/mapped_range.h>
+#include <vms_common/progress.h>
+#include <vms_common/run_stats.h>
+#include <vms_common/sha256_mb.h>
 
 namespace
 {
-  struct HashedEntry
+  // 1 MiB buffers, a few per hasher: enough to absorb the jitter between the
+  // decompressor and the hashers without holding large amounts of data.
+  constexpr std::size_t ringBufferSize = 1024 * 1024;
+  constexpr std::size_t ringBuffersPerHasher = 4;
+
+  // Granularity of the digest updates (and progress reports) on mapped entries.
+  constexpr std::size_t mappedChunkSize = 4 * 1024 * 1024;
+
+  // Where an entry read through libarchive sits in the tar stream.
+  struct EntryPlace
   {
-    std::string name;
-    std::string hash;
-    std::uint64_t size = 0;
+    std::uint64_t headerOffset;
+    std::uint64_t dataOffset;
+    std::uint64_t size;
+  };
+
+  struct HasherState
+  {
+    std::optional<std::size_t> failed;
+    const char* what = "";
+  };
+
+  // Journal of the entries completed by the run, keyed by their position
+  // among the regular files of the archive, and those --resume takes from
+  // the journal of an interrupted one.
+  class EntryJournal
+  {
+  public:
+    EntryJournal(std::filesystem::path path, std::string identity, std::size_t digestBytes)
+        : journal_(std::move(path), std::move(identity), digestBytes)
+    {
+    }
+
+    void load()
+    {
+      journal_.load([this](const Journal::Record& record)
+      {
+        std::uint64_t index = 0;
+        if (record.key.size() == sizeof(index))
+        {
+          std::memcpy(&index, record.key.data(), sizeof(index));
+          done_.insert_or_assign(static_cast<std::size_t>(index), record);
+        }
+      });
+    }
+
+    bool open() { return journal_.open(); }
+    void remove() { journal_.remove(); }
+
+    // Digests of entry `index` when the interrupted run completed it,
+    // nullptr otherwise.
+    const std::uint8_t* find(std::size_t index, std::string_view name) const
+    {
+      auto it = done_.find(index);
+      return it != done_.end() && it->second.name == name ? it->second.digests : nullptr;
+    }
+
+    // May be called from any thread.
+    bool add(std::size_t index, std::string_view name, const std::uint8_t* digests)
+    {
+      const std::uint64_t key = index;
+      return journal_.add(name, {reinterpret_cast<const char*>(&key), sizeof(key)}, digests);
+    }
+
+    // Entries taken with find(), counted by the thread listing them.
+    std::size_t resumed = 0;
+
+  private:
+    Journal journal_;
+    std::unordered_map<std::size_t, Journal::Record> done_;
   };
 
+  // Called by the hashing threads for every completed entry, with the raw
+  // digests of Options::algorithms one after the other (only valid during
+  // the call); returning false stops the processing of the archive.
+  using EntryCallback = std::function<bool(std::size_t index, const std::uint8_t* digests)>;
+
+  // With a single hasher the other CPUs would sit idle: the algorithms of
+  // each entry are spread over threads instead.
+  bool spread_algorithms(const Options& options)
+  {
+    return options.jobs <= 1 && std::thread::hardware_concurrency() > 1;
+  }
+
+  // Number of small entries hashed together by the multi-buffer SHA-256, 0
+  // unless sha256 is the only algorithm and a SIMD backend is available.
+  std::size_t small_batch_size(const std::vector<DigestAlgorithm>& algorithms)
+  {
+    const bool sha256_only = algorithms.size() == 1 && algorithms[0] == DigestAlgorithm::sha256;
+    const std::size_t lanes = sha256_only ? Sha256MultiBuffer::lanes() : 1;
+    return lanes > 1 ? lanes * 4 : 0;
+  }
+
+  // Hasher stage: digests the blocks routed to `consumer`, one entry at a
+  // time. The context is reinitialised for every entry, not reallocated.
+  // Entries that fit in a single small block are staged and hashed in
+  // batches with the multi-buffer SHA-256 instead.
+  void run_hasher(BufferRing& ring, std::size_t consumer, const Options& options, HasherState& state,
+                  const EntryCallback& completed, RunStats* stats)
+  {
+    MultiDigest digest(options.algorithms, spread_algorithms(options));
+    std::vector<std::uint8_t> result(digest_size(options.algorithms));
+
+    constexpr std::size_t slot = Sha256MultiBuffer::small_message_limit;
+    const std::size_t batch = small_batch_size(options.algorithms);
+    std::vector<std::uint8_t> staged(batch * slot);
+    std::vector<const std::uint8_t*> stagedData;
+    std::vector<std::size_t> stagedSizes;
+    std::vector<std::size_t> stagedTags;
+    std::vector<Sha256MultiBuffer::Digest> digests(batch);
+
+    auto flush = [&]()
+    {
+      StatTimer digest_timer(stats, StatPhase::digest);
+      Sha256MultiBuffer::hash(stagedData.data(), stagedSizes.data(), stagedData.size(), digests.data());
+      digest_timer.stop();
+      if (stats)
+      {
+        stats->add_count(StatCounter::multi_buffer_files, stagedData.size());
+      }
+      bool more = true;
+      for (std::size_t i = 0; i < stagedTags.size() && more; ++i)
+      {
+        more = completed(stagedTags[i], digests[i].data());
+      }
+      stagedData.clear();
+      stagedSizes.clear();
+      stagedTags.clear();
+      return more;
+    };
+
+    bool started = false;
+    BufferRing::Block block;
+    while (ring.pop(consumer, block))
+    {
+      if (!started && block.last && block.length <= slot && batch > 0)
+      {
+        std::uint8_t* dst = staged.data() + stagedTags.size() * slot;
+        if (block.length > 0)
+        {
+          std::memcpy(dst, ring.data(block.buffer), block.length);
+        }
+        ring.release(block.buffer);
+        stagedData.push_back(dst);
+        stagedSizes.push_back(block.length);
+        stagedTags.push_back(block.tag);
+        if (stagedTags.size() == batch && !flush())
+        {
+          ring.abort();
+          return;
+        }
+        continue;
+      }
+
+      if (!started)
+      {
+        if (!digest.valid())
+        {
+          state.what = "allocating";
+        }
+        else if (!digest.init())
+        {
+          state.what = "initializing";
+        }
+        else
+        {
+          started = true;
+        }
+      }
+      StatTimer digest_timer(stats, StatPhase::digest);
+      if (started && block.length > 0 && !digest.update(ring.data(block.buffer), block.length))
+      {
+        state.what = "updating";
+        started = false;
+      }
+      digest_timer.stop();
+      ring.release(block.buffer);
+
+      if (!started)
+      {
+        state.failed = block.tag;
+        ring.abort();
+        return;
+      }
+
+      if (block.last)
+      {
+        StatTimer final_timer(stats, StatPhase::digest);
+        if (!digest.final(result.data()))
+        {
+          state.what = "finalizing";
+          state.failed = block.tag;
+          ring.abort();
+          return;
+        }
+        final_timer.stop();
+        started = false;
+        if (!completed(block.tag, result.data()))
+        {
+          ring.abort();
+          return;
+        }
+      }
+    }
+
+    if (!stagedTags.empty() && !ring.aborted() && !flush())
+    {
+      ring.abort();
+    }
+  }
+
   off_t get_file_size(const std::filesystem::path& filePath)
   {
     struct stat st;
@@ -44,189 +273,810 @@ namespace
     return st.st_size;
   }
 
-  void print_progress(double progress)
+  void print_progress(std::ostream& os, double progress)
   {
     constexpr int bar_width = 50;
 
     int pos = static_cast<int>(bar_width * progress / 100.0);
 
-    std::cerr << "\r[";
+    os << "\r[";
     for (int i = 0; i < bar_width; ++i)
     {
       if (i < pos)
-        std::cerr << '=';
+        os << '=';
       else if (i == pos)
-        std::cerr << '>';
+        os << '>';
       else
-        std::cerr << ' ';
+        os << ' ';
     }
-    std::cerr << "] ";
+    os << "] ";
 
-    std::cerr << std::fixed << std::setprecision(1) << std::setw(5) << progress << "%" << std::flush;
+    os << std::fixed << std::setprecision(1) << std::setw(5) << progress << "%";
   }
-}  // namespace
 
-bool TarProcessor::process(const std::filesystem::path& tarPath, const std::filesystem::path& logPath,
-                           bool sortEntries) const
-{
-  std::filesystem::path logFileName = tarPath.stem().string() + ".sha256";  
-  std::filesystem::path logFilePath = logPath / logFileName;
-  
-  archive* ar = archive_read_new();
-  if (!ar)
+  // Percentage of `total` reached by `done`, which the hashing or the
+  // decompressing threads bump; drawn by a renderer thread.
+  class ByteProgress
   {
-    std::cerr << "Unable to allocate libarchive reader\n";
-    return false;
-  }
+  public:
+    ByteProgress(std::uint64_t total, bool enabled)
+        : total_(total), renderer_(enabled, [this](std::ostream& os) { draw(os); })
+    {
+      renderer_.start();
+    }
+
+    void add(std::uint64_t n) { done_.fetch_add(n, std::memory_order_relaxed); }
+    void set(std::uint64_t done) { done_.store(done, std::memory_order_relaxed); }
 
-  archive_read_support_filter_all(ar);
-  archive_read_support_format_tar(ar);
+    // Draws 100% and stops the renderer.
+    void finish()
+    {
+      done_.store(total_, std::memory_order_relaxed);
+      renderer_.stop();
+    }
+
+  private:
+    void draw(std::ostream& os)
+    {
+      double percent = total_ > 0
+          ? 100.0 * static_cast<double>(done_.load(std::memory_order_relaxed)) / static_cast<double>(total_)
+          : 100.0;
+      print_progress(os, std::min(percent, 100.0));
+    }
 
-  std::cout << "Processing file: " << tarPath << std::endl;
+    std::uint64_t total_;
+    std::atomic<std::uint64_t> done_{0};
+    ProgressRenderer renderer_;
+  };
 
-  if (archive_read_open_filename(ar, tarPath.c_str(), 10240) != ARCHIVE_OK)
+  struct MappedFile
   {
-    std::cerr << "Unable to open file " << tarPath << ": " << archive_error_string(ar) << std::endl;
-    archive_read_free(ar);
-    return false;
-  }
+    int fd = -1;
+    void* addr = MAP_FAILED;
+    std::uint64_t size = 0;
 
-  off_t file_size = get_file_size(tarPath);
+    ~MappedFile()
+    {
+      if (addr != MAP_FAILED)
+      {
+        munmap(addr, static_cast<std::size_t>(size));
+      }
+      if (fd >= 0)
+      {
+        close(fd);
+      }
+    }
 
-  std::vector<HashedEntry> entries;
-  archive_entry* entry = nullptr;
-  bool ok = true;
-  la_int64_t last_bytes_read = 0;
-  int log_sched = 0;
+    const std::uint8_t* data() const { return static_cast<const std::uint8_t*>(addr); }
+  };
 
-  while (true)
+  // Fast path for uncompressed archives: the archive is mapped once, the
+  // entry offsets are listed with the native header parser and the entries
+  // are hashed in parallel straight from the mapping, largest first.
+  // `handled` is false when the archive has to go through libarchive.
+  bool hash_plain_tar(const Options& options, const std::filesystem::path& tarPath, DigestLogWriter* writer,
+                      EntryJournal* journal, TarIndexSidecar* tarIndex, bool& handled, ManifestVerifier* verifier,
+                      RunStats* stats)
   {
-    int headerRes = archive_read_next_header(ar, &entry);
-    if (headerRes == ARCHIVE_EOF)
+    handled = false;
+    StatTimer scan_timer(stats, StatPhase::scan);
+
+    MappedFile file;
+    file.fd = open(tarPath.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (file.fd < 0 || fstat(file.fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+    {
+      return true;
+    }
+    file.size = static_cast<std::uint64_t>(st.st_size);
+    file.addr = mmap(nullptr, static_cast<std::size_t>(file.size), PROT_READ, MAP_SHARED, file.fd, 0);
+    if (file.addr == MAP_FAILED)
+    {
+      return true;
+    }
+    // Released before the mapping. A digest read across the truncation is
+    // never logged: the archive fails instead.
+    MappedRangeGuard guard(file.addr, static_cast<std::size_t>(file.size));
+    if (!guard.registered())
+    {
+      return true;
+    }
+    std::atomic<bool> reported{false};
+    auto truncated = [&]()
+    {
+      if (!guard.truncated())
+      {
+        return false;
+      }
+      if (!reported.exchange(true))
+      {
+        std::cerr << "Archive truncated while hashing: " << tarPath << std::endl;
+      }
+      return true;
+    };
+
+    std::vector<TarMember> members;
+    const bool indexed = index_tar(file.data(), file.size, members);
+    if (truncated())
+    {
+      handled = true;
+      return false;
+    }
+    if (!indexed)
+    {
+      return true;
+    }
+    handled = true;
+    scan_timer.stop();
+
+    if (verifier)
+    {
+      for (const auto& m : members)
+      {
+        verifier->expect(m.name);
+      }
+      verifier->report_missing();
+      if (verifier->should_stop())
+      {
+        return true;
+      }
+    }
+
+    // Members the interrupted run completed are logged as journaled.
+    std::vector<std::size_t> order;
+    order.reserve(members.size());
+    std::uint64_t bytes_total = 0;
+    for (std::size_t i = 0; i < members.size(); ++i)
+    {
+      const std::uint8_t* journaled = journal ? journal->find(i, members[i].name) : nullptr;
+      if (journaled)
+      {
+        ++journal->resumed;
+        const TarMember& m = members[i];
+        if ((writer && !writer->add(i, m.name, journaled))
+            || (tarIndex && !tarIndex->add(i, m.name, m.headerOffset, m.dataOffset, m.size, journaled)))
+        {
+          return false;
+        }
+        continue;
+      }
+      order.push_back(i);
+      bytes_total += members[i].size;
+    }
+
+    std::stable_sort(order.begin(), order.end(),
+                     [&members](std::size_t a, std::size_t b) { return members[a].size > members[b].size; });
+
+    // Small members sit at the tail of `order` and are hashed in batches
+    // with the multi-buffer SHA-256, straight from the mapping.
+    const std::size_t small_batch = small_batch_size(options.algorithms);
+    const std::size_t small_begin = small_batch > 0
+        ? static_cast<std::size_t>(std::partition_point(order.begin(), order.end(),
+              [&members](std::size_t i) { return members[i].size > Sha256MultiBuffer::small_message_limit; })
+              - order.begin())
+        : order.size();
+
+    std::atomic<std::size_t> next{0};
+    std::atomic<std::size_t> next_small{small_begin};
+    std::atomic<bool> failed{false};
+    std::atomic<bool> stop{false};
+    ByteProgress progress(bytes_total, options.showProgress);
+
+    auto completed = [&](std::size_t idx, const std::uint8_t* digests)
+    {
+      const TarMember& m = members[idx];
+      if (truncated())
+      {
+        failed = true;
+        return;
+      }
+      if (verifier && !verifier->check(m.name, digests) && verifier->should_stop())
+      {
+        stop = true;
+      }
+      if (writer && !writer->add(idx, m.name, digests))
+      {
+        failed = true;
+      }
+      if (journal && !journal->add(idx, m.name, digests))
+      {
+        failed = true;
+      }
+      if (tarIndex && !tarIndex->add(idx, m.name, m.headerOffset, m.dataOffset, m.size, digests))
+      {
+        failed = true;
+      }
+    };
+
+    auto worker = [&]()
+    {
+      MultiDigest digest(options.algorithms, spread_algorithms(options));
+      std::vector<std::uint8_t> result(digest_size(options.algorithms));
+      while (!failed.load(std::memory_order_relaxed) && !stop.load(std::memory_order_relaxed))
+      {
+        std::size_t slot = next.fetch_add(1);
+        if (slot >= small_begin)
+        {
+          break;
+        }
+        const TarMember& m = members[order[slot]];
+        const auto started = stats ? RunStats::Clock::now() : RunStats::Clock::time_point{};
+        StatTimer digest_timer(stats, StatPhase::digest);
+        if (!digest.valid() || !digest.init())
+        {
+          std::cerr << "Unable to initialize digest for " << m.name << std::endl;
+          failed = true;
+          break;
+        }
+
+        const std::uint8_t* p = file.data() + m.dataOffset;
+        if (m.size > 0)
+        {
+          madvise(const_cast<std::uint8_t*>(file.data()) + (m.dataOffset & ~std::uint64_t{4095}),
+                  static_cast<std::size_t>(m.size + (m.dataOffset & 4095)), MADV_SEQUENTIAL);
+        }
+        std::uint64_t left = m.size;
+        while (left > 0)
+        {
+          std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(left, mappedChunkSize));
+          if (stats)
+          {
+            stats->add_read(n);
+          }
+          if (!digest.update(p, n))
+          {
+            std::cerr << "Error updating digest for " << m.name << std::endl;
+            failed = true;
+            break;
+          }
+          p += n;
+          left -= n;
+          progress.add(n);
+        }
+        if (failed)
+        {
+          break;
+        }
+
+        if (!digest.final(result.data()))
+        {
+          std::cerr << "Error finalizing digest for " << m.name << std::endl;
+          failed = true;
+          break;
+        }
+        digest_timer.stop();
+        if (stats)
+        {
+          stats->add_file(m.name, m.size, RunStats::Clock::now() - started);
+        }
+        completed(order[slot], result.data());
+      }
+
+      std::vector<const std::uint8_t*> data;
+      std::vector<std::size_t> sizes;
+      std::vector<Sha256MultiBuffer::Digest> digests(small_batch);
+      while (!failed.load(std::memory_order_relaxed) && !stop.load(std::memory_order_relaxed))
+      {
+        std::size_t first = next_small.fetch_add(small_batch);
+        if (first >= order.size())
+        {
+          break;
+        }
+        std::size_t count = std::min(small_batch, order.size() - first);
+        data.clear();
+        sizes.clear();
+        std::uint64_t bytes = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+          const TarMember& m = members[order[first + i]];
+          data.push_back(file.data() + m.dataOffset);
+          sizes.push_back(static_cast<std::size_t>(m.size));
+          bytes += m.size;
+        }
+        StatTimer digest_timer(stats, StatPhase::digest);
+        Sha256MultiBuffer::hash(data.data(), sizes.data(), count, digests.data());
+        digest_timer.stop();
+        progress.add(bytes);
+        // Hashed together: counted, but not ranked among the slowest.
+        if (stats)
+        {
+          stats->add_count(StatCounter::multi_buffer_files, count);
+          for (std::size_t i = 0; i < count; ++i)
+          {
+            const TarMember& m = members[order[first + i]];
+            stats->add_read(m.size);
+            stats->add_file(m.name, m.size, RunStats::Clock::duration::zero());
+          }
+        }
+        for (std::size_t i = 0; i < count; ++i)
+        {
+          completed(order[first + i], digests[i].data());
+        }
+      }
+    };
+
+    StatTimer hash_timer(stats, StatPhase::hash);
+    std::size_t jobs = std::clamp<std::size_t>(options.jobs, 1, std::max<std::size_t>(order.size(), 1));
+    std::vector<std::thread> workers;
+    workers.reserve(jobs - 1);
+    for (std::size_t i = 1; i < jobs; ++i)
     {
-      break;
+      workers.emplace_back(worker);
     }
-    if (headerRes != ARCHIVE_OK)
+    worker();
+    for (auto& t : workers)
     {
-      std::cerr << "Error reading header from " << tarPath << ": " << archive_error_string(ar) << std::endl;
-      ok = false;
-      break;
+      t.join();
     }
+    hash_timer.stop();
 
-    const char* nameC = archive_entry_pathname(entry);
-    std::string name = nameC ? nameC : "";
+    progress.finish();
+    return !failed;
+  }
+
+  la_ssize_t read_decoded(archive* ar, void* client, const void** buffer)
+  {
+    const ssize_t n = static_cast<ParallelDecoder*>(client)->read(buffer);
+    if (n < 0)
+    {
+      archive_set_error(ar, EIO, "decompression failed");
+    }
+    return n;
+  }
+
+  bool hash_with_libarchive(const Options& options, const std::filesystem::path& tarPath,
+                            DigestLogWriter* writer, EntryJournal* journal, TarIndexSidecar* tarIndex,
+                            ManifestVerifier* verifier, RunStats* stats)
+  {
+    archive* ar = archive_read_new();
+    if (!ar)
+    {
+      std::cerr << "Unable to allocate libarchive reader\n";
+      return false;
+    }
 
-    if (archive_entry_filetype(entry) != AE_IFREG)
+    // gzip, zstd and xz are decompressed by ParallelDecoder when built in,
+    // libarchive only parses the tar stream it hands out.
+    const unsigned decompressThreads =
+      options.decompressThreads ? options.decompressThreads : std::max(1u, options.jobs);
+    std::unique_ptr<ParallelDecoder> decoder;
+    if (decompressThreads > 1)
+    {
+      decoder = ParallelDecoder::open(tarPath, decompressThreads);
+    }
+    if (!decoder)
     {
-      continue;  // ignore directories and other types
+      archive_read_support_filter_all(ar);
     }
+    archive_read_support_format_tar(ar);
 
-    std::uint64_t size = static_cast<std::uint64_t>(archive_entry_size(entry));
+    const int openRes = decoder ? archive_read_open(ar, decoder.get(), nullptr, read_decoded, nullptr)
+                                : archive_read_open_filename(ar, tarPath.c_str(), 10240);
+    if (openRes != ARCHIVE_OK)
+    {
+      std::cerr << "Unable to open file " << tarPath << ": " << archive_error_string(ar) << std::endl;
+      archive_read_free(ar);
+      return false;
+    }
 
-    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> mdctx(EVP_MD_CTX_new(),
-                                                                  &EVP_MD_CTX_free);
-    if (!mdctx)
+    off_t file_size = get_file_size(tarPath);
+    auto compressed_read = [&]()
+      {
+        return decoder ? decoder->compressed_done() : static_cast<std::uint64_t>(archive_filter_bytes(ar, -1));
+      };
+    if (tarIndex)
     {
-      std::cerr << "Unable to allocate SHA256 context for " << name << std::endl;
-      ok = false;
-      break;
+      tarIndex->set_compressed(decoder || archive_filter_code(ar, 0) != ARCHIVE_FILTER_NONE);
     }
-    if (EVP_DigestInit_ex(mdctx.get(), EVP_sha256(), nullptr) != 1)
+
+    // Pipeline: this thread decompresses and copies the entry data into the
+    // ring, the hasher threads digest it. Entry i is always routed to hasher
+    // i % hashers, which therefore sees the blocks of its entries in order.
+    const std::size_t hashers = std::max(1u, options.jobs);
+    BufferRing ring(hashers * ringBuffersPerHasher + ringBuffersPerHasher, ringBufferSize, hashers);
+    std::vector<HasherState> states(hashers);
+
+    // names grows on this thread while the hashers look them up; the bytes
+    // of a name never move, only the lookup needs the lock. The places of
+    // the entries, kept for the index, are shared the same way.
+    EntryArena names;
+    std::vector<EntryPlace> places;
+    std::mutex names_mutex;
+    EntryCallback completed = [&](std::size_t index, const std::uint8_t* digests)
+    {
+      std::string_view name;
+      EntryPlace place{0, 0, 0};
+      {
+        std::lock_guard<std::mutex> lock(names_mutex);
+        name = names.name(index);
+        if (tarIndex)
+        {
+          place = places[index];
+        }
+      }
+      if (verifier && !verifier->check(name, digests) && verifier->should_stop())
+      {
+        return false;
+      }
+      return (!writer || writer->add(index, name, digests)) && (!journal || journal->add(index, name, digests))
+             && (!tarIndex || tarIndex->add(index, name, place.headerOffset, place.dataOffset, place.size, digests));
+    };
+
+    std::vector<std::thread> hasherThreads;
+    hasherThreads.reserve(hashers);
+    for (std::size_t i = 0; i < hashers; ++i)
     {
-      std::cerr << "Unable to initialize SHA256 for " << name << std::endl;
-      ok = false;
-      break;
+      hasherThreads.emplace_back(run_hasher, std::ref(ring), i, std::cref(options), std::ref(states[i]),
+                                 std::cref(completed), stats);
     }
+    // The hashing stage runs as long as the decompressor feeds it.
+    StatTimer hash_timer(stats, StatPhase::hash);
+
+    archive_entry* entry = nullptr;
+    bool ok = true;
+    // Compressed bytes consumed, against the size of the archive.
+    ByteProgress progress(file_size > 0 ? static_cast<std::uint64_t>(file_size) : 0, options.showProgress);
 
-    while (true)
+    while (ok)
     {
-      const void* buff = nullptr;
-      size_t sizeBlock = 0;
-      la_int64_t offset = 0;
-      int dataRes = archive_read_data_block(ar, &buff, &sizeBlock, &offset);
-      if (dataRes == ARCHIVE_EOF)
+      const auto started = stats ? RunStats::Clock::now() : RunStats::Clock::time_point{};
+      StatTimer header_timer(stats, StatPhase::decompress);
+      int headerRes = archive_read_next_header(ar, &entry);
+      header_timer.stop();
+      if (headerRes == ARCHIVE_EOF)
       {
         break;
       }
-      if (dataRes != ARCHIVE_OK)
+      if (headerRes != ARCHIVE_OK)
       {
-        std::cerr << "Error reading data for " << name << ": " << archive_error_string(ar) << std::endl;
+        std::cerr << "Error reading header from " << tarPath << ": " << archive_error_string(ar) << std::endl;
         ok = false;
         break;
       }
-      la_int64_t current_bytes = archive_filter_bytes(ar, 0);
 
-      if ( log_sched == 0 )
+      const char* nameC = archive_entry_pathname(entry);
+      std::string_view name = nameC ? nameC : "";
+
+      if (archive_entry_filetype(entry) != AE_IFREG)
+      {
+        continue;  // ignore directories and other types
+      }
+
+      std::uint64_t size = static_cast<std::uint64_t>(archive_entry_size(entry));
+      if (verifier && !verifier->expect(name) && verifier->should_stop())
+      {
+        break;
+      }
+      const std::size_t index = names.size();
+      const std::size_t hasher = index % hashers;
       {
-        if (current_bytes != last_bytes_read) {
-            double progress = (double)current_bytes / (double)file_size * 100.0;
-            print_progress(progress);
-            last_bytes_read = current_bytes;
+        std::lock_guard<std::mutex> lock(names_mutex);
+        names.add(name);
+        if (tarIndex)
+        {
+          // Positions in the tar stream: the header consumed, the data not.
+          places.push_back(EntryPlace{static_cast<std::uint64_t>(archive_read_header_position(ar)),
+                                      static_cast<std::uint64_t>(archive_filter_bytes(ar, 0)), size});
         }
-        log_sched++;
       }
-      else
+
+      // Completed by the interrupted run: the data is skipped, decompressed
+      // but neither copied nor hashed.
+      const std::uint8_t* journaled = journal ? journal->find(index, name) : nullptr;
+      if (journaled)
+      {
+        StatTimer skip_timer(stats, StatPhase::decompress);
+        const int skipRes = archive_read_data_skip(ar);
+        skip_timer.stop();
+        if (skipRes != ARCHIVE_OK)
+        {
+          std::cerr << "Error reading data for " << name << ": " << archive_error_string(ar) << std::endl;
+          ok = false;
+          break;
+        }
+        progress.set(compressed_read());
+        ++journal->resumed;
+        if ((writer && !writer->add(index, name, journaled))
+            || (tarIndex
+                && !tarIndex->add(index, name, places.back().headerOffset, places.back().dataOffset, size,
+                                  journaled)))
+        {
+          ok = false;
+          break;
+        }
+        continue;
+      }
+
+      std::size_t buffer = BufferRing::no_buffer;
+      std::size_t filled = 0;
+      while (true)
+      {
+        const void* buff = nullptr;
+        size_t sizeBlock = 0;
+        la_int64_t offset = 0;
+        StatTimer data_timer(stats, StatPhase::decompress);
+        int dataRes = archive_read_data_block(ar, &buff, &sizeBlock, &offset);
+        data_timer.stop();
+        if (dataRes == ARCHIVE_EOF)
+        {
+          break;
+        }
+        if (dataRes != ARCHIVE_OK)
+        {
+          std::cerr << "Error reading data for " << name << ": " << archive_error_string(ar) << std::endl;
+          ok = false;
+          break;
+        }
+        if (stats)
+        {
+          stats->add_read(sizeBlock);
+        }
+        progress.set(compressed_read());
+
+        // libarchive reuses its block on the next call, so the data is copied
+        // into the ring, coalescing small blocks into full buffers.
+        const auto* src = static_cast<const std::uint8_t*>(buff);
+        while (sizeBlock > 0)
+        {
+          if (buffer == BufferRing::no_buffer)
+          {
+            buffer = ring.acquire();
+            filled = 0;
+            if (buffer == BufferRing::no_buffer)
+            {
+              ok = false;  // a hasher gave up
+              break;
+            }
+          }
+          std::size_t n = std::min(sizeBlock, ring.buffer_size() - filled);
+          std::memcpy(ring.data(buffer) + filled, src, n);
+          filled += n;
+          src += n;
+          sizeBlock -= n;
+          if (filled == ring.buffer_size())
+          {
+            ring.publish(hasher, BufferRing::Block{index, buffer, filled, false});
+            buffer = BufferRing::no_buffer;
+          }
+        }
+        if (!ok)
+        {
+          break;
+        }
+      }
+
+      if (!ok)
       {
-        log_sched = (log_sched+1) % 10000;
+        ring.release(buffer);
+        break;
       }
 
-      if (sizeBlock > 0)
+      ring.publish(hasher, BufferRing::Block{index, buffer, buffer == BufferRing::no_buffer ? 0 : filled, true});
+      // Time to extract the entry; its digest runs concurrently in a hasher.
+      if (stats)
       {
-        EVP_DigestUpdate(mdctx.get(), buff, sizeBlock);
+        stats->add_file(name, size, RunStats::Clock::now() - started);
       }
     }
 
-    if (!ok)
+    if (ok)
     {
-      break;
+      ring.close();
     }
+    else
+    {
+      ring.abort();
+    }
+    for (auto& t : hasherThreads)
+    {
+      t.join();
+    }
+    hash_timer.stop();
 
-    std::array<unsigned char, EVP_MAX_MD_SIZE> hash{};
-    unsigned int hashLen = 0;
-    if (EVP_DigestFinal_ex(mdctx.get(), hash.data(), &hashLen) != 1)
+    for (auto& state : states)
     {
-      std::cerr << "Error finalizing SHA256 for " << name << std::endl;
-      ok = false;
-      break;
+      if (state.failed)
+      {
+        std::cerr << "Error " << state.what << " digest for " << names.name(*state.failed) << std::endl;
+        ok = false;
+      }
     }
 
-    std::ostringstream hex;
-    hex << std::hex << std::setfill('0');
-    for (unsigned int i = 0; i < hashLen; ++i)
+    progress.finish();
+    archive_read_close(ar);
+    archive_read_free(ar);
+
+    if (verifier && verifier->should_stop())
     {
-      unsigned char b = hash[i];
-      hex << std::setw(2) << static_cast<int>(b);
+      return true;  // not an I/O error: reported by the verifier
     }
+    if (ok && verifier)
+    {
+      verifier->report_missing();
+    }
+    return ok;
+  }
+
+  constexpr std::string_view archiveExtensions[] = {
+    ".tar", ".tar.gz", ".tgz", ".tar.zst", ".tzst", ".tar.xz", ".txz", ".tar.bz2", ".tbz2",
+  };
 
-    entries.push_back(HashedEntry{std::move(name), hex.str(), size});
+  // Length of the archive extension ending `name`, 0 when there is none.
+  std::size_t archive_extension(std::string_view name)
+  {
+    for (std::string_view ext : archiveExtensions)
+    {
+      if (name.size() > ext.size() && name.substr(name.size() - ext.size()) == ext)
+      {
+        return ext.size();
+      }
+    }
+    return 0;
   }
+}  // namespace
+
+bool is_tar_archive(const std::filesystem::path& path)
+{
+  return archive_extension(path.filename().string()) > 0;
+}
 
-  print_progress(100.f);
-  archive_read_close(ar);
-  archive_read_free(ar);
+std::string archive_stem(const std::filesystem::path& path)
+{
+  const std::string name = path.filename().string();
+  const std::size_t ext = archive_extension(name);
+  return ext > 0 ? name.substr(0, name.size() - ext) : path.stem().string();
+}
+
+TarProcessor::TarProcessor(const Options& options, StatsReport* stats)
+    : options_(options), stats_(stats)
+{
+}
 
-  if (!ok)
+bool TarProcessor::process(const std::filesystem::path& tarPath, const std::filesystem::path& logPath) const
+{
+  const std::vector<DigestAlgorithm>& algorithms = options_.algorithms;
+  const std::string stem = archive_stem(tarPath);
+  RunStats* stats = stats_ ? &stats_->add_item(tarPath.string()) : nullptr;
+  StatsFinisher stats_finisher(stats);
+
+  if (options_.showProgress)
   {
-    return false;
+    std::cout << "Processing file: " << tarPath << std::endl;
   }
 
-  if (sortEntries)
+  StatTimer load_timer(stats, StatPhase::load);
+  std::optional<ManifestVerifier> verifier;
+  if (options_.verifyManifest)
   {
-    std::sort(entries.begin(), entries.end(),
-              [](const HashedEntry& a, const HashedEntry& b) { return a.name < b.name; });
+    const std::filesystem::path& manifest = *options_.verifyManifest;
+    std::vector<std::filesystem::path> manifests;
+    if (std::filesystem::is_directory(manifest))
+    {
+      for (const auto& name : DigestLogWriter::file_names(algorithms, false, stem))
+      {
+        manifests.push_back(manifest / name);
+      }
+    }
+    else if (algorithms.size() == 1)
+    {
+      manifests.push_back(manifest);
+    }
+    else
+    {
+      std::cerr << "Error! --verify with several algorithms needs a directory of manifests" << std::endl;
+      return false;
+    }
+    verifier.emplace(algorithms, options_.failFast);
+    if (!verifier->load(manifests))
+    {
+      return false;
+    }
   }
+  load_timer.stop();
+  ManifestVerifier* checker = verifier ? &*verifier : nullptr;
 
-  std::ofstream log(logFilePath);
-  std::cout << std::endl << "Log file: " << logFilePath << std::endl;
-  if (!log)
+  // The log is streamed while hashing, entries go to the writer as they
+  // complete.
+  std::optional<DigestLogWriter> writer;
+  if (!verifier)
+  {
+    writer.emplace(algorithms, options_.combinedLog, options_.sortEntries,
+                   std::size_t{options_.sortMemoryMiB} * 1024 * 1024);
+    if (!writer->open(logPath, stem))
+    {
+      return false;
+    }
+  }
+  DigestLogWriter* log = writer ? &*writer : nullptr;
+
+  // Completed entries are journaled while the logs are written; --resume
+  // skips those an interrupted run journaled, provided the archive is the
+  // same.
+  std::optional<EntryJournal> journal;
+  if (!verifier)
+  {
+    struct stat st{};
+    stat(tarPath.c_str(), &st);
+    std::string identity = "sha_from_tar";
+    for (auto algorithm : algorithms)
+    {
+      identity += ' ';
+      identity += digest_name(algorithm);
+    }
+    identity += ' ';
+    identity += std::to_string(st.st_size);
+    identity += ' ';
+    identity += std::to_string(std::int64_t{st.st_mtim.tv_sec} * 1000000000 + st.st_mtim.tv_nsec);
+    journal.emplace(logPath / (stem + ".journal"), std::move(identity), digest_size(algorithms));
+    if (options_.resume)
+    {
+      journal->load();
+    }
+    if (!journal->open())
+    {
+      return false;
+    }
+  }
+  EntryJournal* journaling = journal ? &*journal : nullptr;
+
+  std::optional<TarIndexSidecar> sidecar;
+  if (options_.writeIndex)
+  {
+    struct stat st{};
+    stat(tarPath.c_str(), &st);
+    sidecar.emplace(algorithms);
+    if (!sidecar->open(logPath, stem, static_cast<std::uint64_t>(st.st_size),
+                       std::int64_t{st.st_mtim.tv_sec} * 1000000000 + st.st_mtim.tv_nsec))
+    {
+      return false;
+    }
+  }
+  TarIndexSidecar* tarIndex = sidecar ? &*sidecar : nullptr;
+
+  bool handled = false;
+  if (!hash_plain_tar(options_, tarPath, log, journaling, tarIndex, handled, checker, stats))
   {
-    std::cerr << "Error! Cannot open " << logFilePath << " for writing" << std::endl;
     return false;
   }
-  for (const auto& e : entries)
+  if (!handled && !hash_with_libarchive(options_, tarPath, log, journaling, tarIndex, checker, stats))
   {
-    log << e.hash << "  " << e.name << std::endl;
+    return false;
+  }
+  if (stats && journal)
+  {
+    stats->add_count(StatCounter::resumed_entries, journal->resumed);
+  }
+
+  if (verifier)
+  {
+    if (options_.showProgress)
+    {
+      std::cout << std::endl;
+    }
+    return verifier->finish();
   }
 
-  return true;
+  // Sorted logs are merged from their runs here.
+  StatTimer write_timer(stats, options_.sortEntries ? StatPhase::sort : StatPhase::write);
+  bool closed = writer->close() && (!sidecar || sidecar->close());
+  if (closed)
+  {
+    journal->remove();
+  }
+  std::ostringstream done_line;
+  done_line << (options_.showProgress ? "\n" : "");
+  if (options_.resume && options_.showProgress)
+  {
+    done_line << journal->resumed << " entries taken from the journal of the interrupted run\n";
+  }
+  for (const auto& path : writer->paths())
+  {
+    done_line << "Log file: " << path << "\n";
+  }
+  if (sidecar)
+  {
+    done_line << "Index file: " << sidecar->path() << "\n";
+  }
+  std::cout << done_line.str() << std::flush;
+  return closed;
 }
@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <sha_from_tar/tar_index.h>
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+namespace
+{
+  constexpr std::uint64_t blockSize = 512;
+
+  // ustar header layout (POSIX.1-1988), GNU uses the same offsets.
+  constexpr std::size_t nameOff = 0, nameLen = 100;
+  constexpr std::size_t sizeOff = 124, sizeLen = 12;
+  constexpr std::size_t chksumOff = 148, chksumLen = 8;
+  constexpr std::size_t typeOff = 156;
+  constexpr std::size_t magicOff = 257;
+  constexpr std::size_t prefixOff = 345, prefixLen = 155;
+
+  std::string_view field(const std::uint8_t* header, std::size_t off, std::size_t len)
+  {
+    const char* p = reinterpret_cast<const char*>(header + off);
+    return std::string_view{p, strnlen(p, len)};
+  }
+
+  // Octal, optionally padded with spaces/NULs, or GNU base-256 when the
+  // high bit of the first byte is set.
+  std::optional<std::uint64_t> parse_number(const std::uint8_t* header, std::size_t off, std::size_t len)
+  {
+    const std::uint8_t* p = header + off;
+    if (p[0] & 0x80)
+    {
+      if (p[0] & 0x40)
+      {
+        return std::nullopt;  // negative
+      }
+      std::uint64_t value = p[0] & 0x3f;
+      for (std::size_t i = 1; i < len; ++i)
+      {
+        if (value > (UINT64_MAX >> 8))
+        {
+          return std::nullopt;
+        }
+        value = (value << 8) | p[i];
+      }
+      return value;
+    }
+
+    std::size_t i = 0;
+    while (i < len && p[i] == ' ')
+    {
+      ++i;
+    }
+    std::uint64_t value = 0;
+    bool digits = false;
+    for (; i < len && p[i] >= '0' && p[i] <= '7'; ++i)
+    {
+      if (value > (UINT64_MAX >> 3))
+      {
+        return std::nullopt;
+      }
+      value = (value << 3) | static_cast<std::uint64_t>(p[i] - '0');
+      digits = true;
+    }
+    for (; i < len; ++i)
+    {
+      if (p[i] != ' ' && p[i] != '\0')
+      {
+        return std::nullopt;
+      }
+    }
+    if (!digits)
+    {
+      return std::uint64_t{0};
+    }
+    return value;
+  }
+
+  bool is_zero_block(const std::uint8_t* header)
+  {
+    return std::all_of(header, header + blockSize, [](std::uint8_t b) { return b == 0; });
+  }
+
+  // Both the unsigned and the (historical) signed sums are accepted.
+  bool checksum_ok(const std::uint8_t* header)
+  {
+    auto stored = parse_number(header, chksumOff, chksumLen);
+    if (!stored)
+    {
+      return false;
+    }
+    std::uint64_t usum = 0;
+    std::int64_t ssum = 0;
+    for (std::size_t i = 0; i < blockSize; ++i)
+    {
+      std::uint8_t b = (i >= chksumOff && i < chksumOff + chksumLen) ? ' ' : header[i];
+      usum += b;
+      ssum += static_cast<signed char>(b);
+    }
+    return *stored == usum || static_cast<std::int64_t>(*stored) == ssum;
+  }
+
+  std::uint64_t padded(std::uint64_t size)
+  {
+    return (size + blockSize - 1) / blockSize * blockSize;
+  }
+
+  struct PaxAttributes
+  {
+    std::optional<std::string> path;
+    std::optional<std::uint64_t> size;
+  };
+
+  // Records are "<len> <key>=<value>\n", <len> counting the whole record.
+  bool parse_pax(std::string_view data, PaxAttributes& attrs)
+  {
+    while (!data.empty())
+    {
+      if (data.front() == '\0')
+      {
+        break;
+      }
+      std::size_t space = data.find(' ');
+      if (space == std::string_view::npos || space == 0)
+      {
+        return false;
+      }
+      std::uint64_t len = 0;
+      for (char c : data.substr(0, space))
+      {
+        if (c < '0' || c > '9')
+        {
+          return false;
+        }
+        len = len * 10 + static_cast<std::uint64_t>(c - '0');
+        if (len > data.size())
+        {
+          return false;
+        }
+      }
+      if (len <= space + 1 || data[len - 1] != '\n')
+      {
+        return false;
+      }
+      std::string_view record = data.substr(space + 1, len - space - 2);
+      data.remove_prefix(len);
+
+      std::size_t eq = record.find('=');
+      if (eq == std::string_view::npos)
+      {
+        return false;
+      }
+      std::string_view key = record.substr(0, eq);
+      std::string_view value = record.substr(eq + 1);
+
+      if (key == "path")
+      {
+        attrs.path = std::string{value};
+      }
+      else if (key == "size")
+      {
+        std::uint64_t size = 0;
+        for (char c : value)
+        {
+          if (c < '0' || c > '9')
+          {
+            return false;
+          }
+          size = size * 10 + static_cast<std::uint64_t>(c - '0');
+        }
+        attrs.size = size;
+      }
+      else if (key.substr(0, 11) == "GNU.sparse.")
+      {
+        return false;  // sparse layout, left to libarchive
+      }
+    }
+    return true;
+  }
+}  // namespace
+
+bool index_tar(const std::uint8_t* data, std::uint64_t size, std::vector<TarMember>& members)
+{
+  members.clear();
+  if (size < blockSize)
+  {
+    return false;
+  }
+
+  std::uint64_t pos = 0;
+  // Offset of the first header of the pending entry, extension headers included.
+  std::uint64_t entryStart = 0;
+  bool pending = false;
+  PaxAttributes pax;
+  std::optional<std::string> gnuLongName;
+  bool sawHeader = false;
+
+  while (true)
+  {
+    if (pos + blockSize > size)
+    {
+      // Truncated archive or missing end-of-archive marker: only tolerated
+      // when nothing is pending, as libarchive does.
+      return sawHeader && !pending;
+    }
+
+    const std::uint8_t* header = data + pos;
+    if (is_zero_block(header))
+    {
+      return sawHeader && !pending;
+    }
+    if (!checksum_ok(header))
+    {
+      return false;
+    }
+
+    std::string_view magic{reinterpret_cast<const char*>(header + magicOff), 8};
+    const bool posix = magic.substr(0, 6) == std::string_view{"ustar\0", 6};
+    const bool gnu = magic == std::string_view{"ustar  \0", 8};
+    if (!posix && !gnu)
+    {
+      return false;  // v7 and other pre-POSIX variants
+    }
+    sawHeader = true;
+
+    auto entrySize = parse_number(header, sizeOff, sizeLen);
+    if (!entrySize)
+    {
+      return false;
+    }
+    const char type = static_cast<char>(header[typeOff]);
+    const std::uint64_t dataOffset = pos + blockSize;
+    if (!pending)
+    {
+      entryStart = pos;
+      pending = true;
+    }
+
+    auto payload = [&]() -> std::optional<std::string_view>
+    {
+      if (*entrySize > size - dataOffset)
+      {
+        return std::nullopt;
+      }
+      return std::string_view{reinterpret_cast<const char*>(data + dataOffset),
+                              static_cast<std::size_t>(*entrySize)};
+    };
+
+    switch (type)
+    {
+      case 'x':
+      {
+        auto text = payload();
+        if (!text || !parse_pax(*text, pax))
+        {
+          return false;
+        }
+        pos = dataOffset + padded(*entrySize);
+        continue;
+      }
+      case 'g':
+      {
+        // Global attributes are not applied to entries by libarchive either.
+        PaxAttributes ignored;
+        auto text = payload();
+        if (!text || !parse_pax(*text, ignored))
+        {
+          return false;
+        }
+        pos = dataOffset + padded(*entrySize);
+        pending = false;
+        continue;
+      }
+      case 'L':
+      {
+        auto text = payload();
+        if (!text)
+        {
+          return false;
+        }
+        gnuLongName = std::string{text->substr(0, strnlen(text->data(), text->size()))};
+        pos = dataOffset + padded(*entrySize);
+        continue;
+      }
+      case 'K':
+        pos = dataOffset + padded(*entrySize);
+        continue;
+      case '0': case '\0': case '7':
+      case '1': case '2': case '3': case '4': case '5': case '6': case 'D':
+        break;
+      default:
+        return false;  // sparse, multi-volume, vendor specific
+    }
+
+    std::uint64_t memberSize = pax.size.value_or(*entrySize);
+
+    std::string name;
+    if (pax.path)
+    {
+      name = *pax.path;
+    }
+    else if (gnuLongName)
+    {
+      name = *gnuLongName;
+    }
+    else
+    {
+      std::string_view prefix = posix ? field(header, prefixOff, prefixLen) : std::string_view{};
+      if (!prefix.empty())
+      {
+        name.append(prefix).append("/");
+      }
+      name.append(field(header, nameOff, nameLen));
+    }
+
+    // Hard links, symlinks, devices, directories and fifos carry no data of
+    // their own; a "regular" entry whose name ends in '/' is an old-style
+    // directory.
+    const bool hasData = type == '0' || type == '\0' || type == '7' || type == 'D';
+    if (!hasData && memberSize != 0)
+    {
+      return false;
+    }
+    const std::uint64_t dataSize = memberSize;
+    bool regular = (type == '0' || type == '\0' || type == '7') && !(name.size() > 0 && name.back() == '/');
+
+    if (dataSize > size - dataOffset)
+    {
+      return false;
+    }
+
+    if (regular)
+    {
+      members.push_back(TarMember{std::move(name), entryStart, dataOffset, memberSize});
+    }
+
+    pos = dataOffset + padded(dataSize);
+    pending = false;
+    pax = PaxAttributes{};
+    gnuLongName.reset();
+  }
+}
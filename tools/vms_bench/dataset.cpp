@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_bench/dataset.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+namespace
+{
+  constexpr unsigned filesPerDir = 100;
+  constexpr std::size_t ioChunk = 1024 * 1024;
+  // 2020-01-01T00:00:00Z, stored for every archive entry.
+  constexpr time_t fixedMtime = 1577836800;
+
+  // splitmix64: tiny, fast and fully specified, unlike the std distributions
+  // whose output differs between standard libraries.
+  class SplitMix64
+  {
+  public:
+    explicit SplitMix64(std::uint64_t seed)
+        : state_(seed)
+    {
+    }
+
+    std::uint64_t next()
+    {
+      std::uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, bound), bound > 0; the modulo bias is irrelevant here.
+    std::uint64_t below(std::uint64_t bound) { return next() % bound; }
+
+  private:
+    std::uint64_t state_;
+  };
+
+  std::uint64_t pick_size(const std::vector<SizeBucket>& distribution, unsigned totalWeight, SplitMix64& rng)
+  {
+    std::uint64_t ticket = rng.below(totalWeight);
+    std::uint64_t low = 0;
+    for (const auto& bucket : distribution)
+    {
+      if (ticket < bucket.weight)
+      {
+        return low + 1 + rng.below(bucket.maxSize - low);
+      }
+      ticket -= bucket.weight;
+      low = bucket.maxSize;
+    }
+    return low;
+  }
+
+  std::string numbered(char prefix, unsigned n, int width)
+  {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%c%0*u", prefix, width, n);
+    return buffer;
+  }
+
+  bool write_file(const std::filesystem::path& path, std::uint64_t size, std::uint64_t seed)
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+      std::cerr << "Error! Cannot create " << path << std::endl;
+      return false;
+    }
+    SplitMix64 rng(seed);
+    std::vector<std::uint64_t> block(ioChunk / sizeof(std::uint64_t));
+    for (std::uint64_t left = size; left > 0;)
+    {
+      for (auto& word : block)
+      {
+        word = rng.next();
+      }
+      auto n = static_cast<std::size_t>(std::min<std::uint64_t>(left, ioChunk));
+      out.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(n));
+      left -= n;
+    }
+    out.close();
+    if (!out)
+    {
+      std::cerr << "Error! Unable to write " << path << std::endl;
+      return false;
+    }
+    return true;
+  }
+}  // namespace
+
+bool generate_dataset(const Options& options, const std::filesystem::path& root, Dataset& out)
+{
+  unsigned totalWeight = 0;
+  for (const auto& bucket : options.distribution)
+  {
+    totalWeight += bucket.weight;
+  }
+
+  out.root = root;
+  out.files.clear();
+  out.bytes = 0;
+
+  const std::filesystem::path tree = root / "tree";
+  std::error_code ec;
+  std::filesystem::remove_all(tree, ec);
+
+  SplitMix64 sizes(options.seed);
+  for (unsigned i = 0; i < options.files; ++i)
+  {
+    const std::string dir = numbered('d', i / filesPerDir, 3);
+    if (i % filesPerDir == 0)
+    {
+      std::filesystem::create_directories(tree / dir, ec);
+      if (ec)
+      {
+        std::cerr << "Error! Cannot create " << tree / dir << ": " << ec.message() << std::endl;
+        return false;
+      }
+    }
+
+    DatasetFile file;
+    file.name = "tree/" + dir + "/" + numbered('f', i, 6);
+    file.size = pick_size(options.distribution, totalWeight, sizes);
+    // Contents are seeded per file so they don't depend on the other sizes.
+    if (!write_file(root / file.name, file.size, (std::uint64_t{options.seed} << 32) ^ i))
+    {
+      return false;
+    }
+    out.bytes += file.size;
+    out.files.push_back(std::move(file));
+  }
+  return true;
+}
+
+bool write_archive(const Dataset& dataset, const std::filesystem::path& archive, bool gzip)
+{
+  std::unique_ptr<struct archive, decltype(&archive_write_free)> a(archive_write_new(), &archive_write_free);
+  std::unique_ptr<struct archive_entry, decltype(&archive_entry_free)> entry(archive_entry_new(),
+                                                                             &archive_entry_free);
+  if (!a || !entry)
+  {
+    std::cerr << "Error! Unable to allocate the archive writer" << std::endl;
+    return false;
+  }
+
+  archive_write_set_format_pax_restricted(a.get());
+  if (gzip)
+  {
+    archive_write_add_filter_gzip(a.get());
+    // No timestamp in the gzip header either.
+    archive_write_set_options(a.get(), "gzip:!timestamp");
+  }
+  if (archive_write_open_filename(a.get(), archive.string().c_str()) != ARCHIVE_OK)
+  {
+    std::cerr << "Error! Cannot create " << archive << ": " << archive_error_string(a.get()) << std::endl;
+    return false;
+  }
+
+  std::vector<char> buffer(ioChunk);
+  for (const auto& file : dataset.files)
+  {
+    archive_entry_clear(entry.get());
+    archive_entry_set_pathname(entry.get(), file.name.c_str());
+    archive_entry_set_size(entry.get(), static_cast<la_int64_t>(file.size));
+    archive_entry_set_filetype(entry.get(), AE_IFREG);
+    archive_entry_set_perm(entry.get(), 0644);
+    archive_entry_set_mtime(entry.get(), fixedMtime, 0);
+    if (archive_write_header(a.get(), entry.get()) != ARCHIVE_OK)
+    {
+      std::cerr << "Error! " << archive << ": " << archive_error_string(a.get()) << std::endl;
+      return false;
+    }
+
+    std::ifstream in(dataset.root / file.name, std::ios::binary);
+    std::uint64_t left = file.size;
+    while (in && left > 0)
+    {
+      auto n = static_cast<std::size_t>(std::min<std::uint64_t>(left, buffer.size()));
+      in.read(buffer.data(), static_cast<std::streamsize>(n));
+      if (static_cast<std::size_t>(in.gcount()) != n
+          || archive_write_data(a.get(), buffer.data(), n) != static_cast<la_ssize_t>(n))
+      {
+        break;
+      }
+      left -= n;
+    }
+    if (left != 0)
+    {
+      std::cerr << "Error! Unable to add " << file.name << " to " << archive << std::endl;
+      return false;
+    }
+  }
+
+  if (archive_write_close(a.get()) != ARCHIVE_OK)
+  {
+    std::cerr << "Error! Unable to write " << archive << ": " << archive_error_string(a.get()) << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_bench/digest_bench.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+
+#include <vms_common/sha256_mb.h>
+
+namespace
+{
+  constexpr std::size_t chunkSize = 4 * 1024 * 1024;
+
+  struct SmallMessages
+  {
+    std::vector<std::uint8_t> arena;
+    std::vector<const std::uint8_t*> data;
+    std::vector<std::size_t> sizes;
+    std::uint64_t bytes = 0;
+  };
+
+  std::vector<std::uint8_t> random_bytes(std::size_t size, std::mt19937_64& rng)
+  {
+    std::vector<std::uint8_t> buffer(size);
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+      std::uint64_t v = rng();
+      std::copy_n(reinterpret_cast<const std::uint8_t*>(&v), 8, buffer.data() + i);
+    }
+    for (; i < size; ++i)
+    {
+      buffer[i] = static_cast<std::uint8_t>(rng());
+    }
+    return buffer;
+  }
+
+  SmallMessages make_small_messages(std::size_t count, std::mt19937_64& rng)
+  {
+    SmallMessages m;
+    std::uniform_int_distribution<std::size_t> size(0, Sha256MultiBuffer::small_message_limit);
+    m.sizes.resize(count);
+    for (auto& s : m.sizes)
+    {
+      s = size(rng);
+      m.bytes += s;
+    }
+    m.arena = random_bytes(static_cast<std::size_t>(m.bytes), rng);
+    const std::uint8_t* p = m.arena.data();
+    for (std::size_t s : m.sizes)
+    {
+      m.data.push_back(p);
+      p += s;
+    }
+    return m;
+  }
+
+  // Runs `round` options.rounds times and keeps the fastest.
+  bool time_rounds(const Options& options, const std::function<bool()>& round, double& seconds)
+  {
+    seconds = std::numeric_limits<double>::max();
+    for (unsigned r = 0; r < options.rounds; ++r)
+    {
+      auto start = std::chrono::steady_clock::now();
+      if (!round())
+      {
+        return false;
+      }
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      seconds = std::min(seconds, elapsed.count());
+    }
+    return true;
+  }
+
+  bool hash_message(DigestContext& ctx, const std::uint8_t* data, std::size_t size, std::size_t chunk)
+  {
+    DigestBytes digest;
+    if (!ctx.init())
+    {
+      return false;
+    }
+    for (std::size_t off = 0; off < size; off += chunk)
+    {
+      if (!ctx.update(data + off, std::min(chunk, size - off)))
+      {
+        return false;
+      }
+    }
+    return ctx.final(digest.data());
+  }
+}  // namespace
+
+bool run_digest_bench(const Options& options, std::vector<BenchResult>& results)
+{
+  std::vector<DigestAlgorithm> algorithms = options.algorithms;
+  if (algorithms.empty())
+  {
+    for (auto a : {DigestAlgorithm::md5, DigestAlgorithm::sha1, DigestAlgorithm::sha256, DigestAlgorithm::sha512,
+                   DigestAlgorithm::blake3, DigestAlgorithm::xxh3_128})
+    {
+      if (digest_available(a))
+      {
+        algorithms.push_back(a);
+      }
+    }
+  }
+
+  std::mt19937_64 rng(42);
+  const std::vector<std::uint8_t> large = random_bytes(std::size_t{options.bufferMiB} * 1024 * 1024, rng);
+  const SmallMessages small = make_small_messages(options.smallMessages, rng);
+
+  for (auto algorithm : algorithms)
+  {
+    std::unique_ptr<DigestContext> ctx = DigestContext::create(algorithm);
+    if (!ctx)
+    {
+      std::cerr << "Error! Unable to allocate " << digest_name(algorithm) << " context" << std::endl;
+      return false;
+    }
+
+    BenchResult bulk{digest_name(algorithm), large.size(), 1, 0.0};
+    auto hash_large = [&]() { return hash_message(*ctx, large.data(), large.size(), chunkSize); };
+    if (!time_rounds(options, hash_large, bulk.seconds))
+    {
+      std::cerr << "Error! " << digest_name(algorithm) << " failed" << std::endl;
+      return false;
+    }
+    results.push_back(bulk);
+
+    BenchResult each{std::string{digest_name(algorithm)} + " small", small.bytes, small.sizes.size(), 0.0};
+    auto hash_small = [&]()
+    {
+      for (std::size_t i = 0; i < small.sizes.size(); ++i)
+      {
+        if (!hash_message(*ctx, small.data[i], small.sizes[i], chunkSize))
+        {
+          return false;
+        }
+      }
+      return true;
+    };
+    if (!time_rounds(options, hash_small, each.seconds))
+    {
+      std::cerr << "Error! " << digest_name(algorithm) << " failed" << std::endl;
+      return false;
+    }
+    results.push_back(each);
+
+    // The batches the tools hand to the multi-buffer SHA-256.
+    if (algorithm == DigestAlgorithm::sha256 && Sha256MultiBuffer::lanes() > 1)
+    {
+      const std::size_t batch = Sha256MultiBuffer::lanes() * 4;
+      std::vector<Sha256MultiBuffer::Digest> digests(batch);
+      BenchResult multi{std::string{"sha256 small, "} + Sha256MultiBuffer::backend() + " multi-buffer",
+                        small.bytes, small.sizes.size(), 0.0};
+      auto hash_batches = [&]()
+      {
+        for (std::size_t i = 0; i < small.sizes.size(); i += batch)
+        {
+          std::size_t n = std::min(batch, small.sizes.size() - i);
+          Sha256MultiBuffer::hash(small.data.data() + i, small.sizes.data() + i, n, digests.data());
+        }
+        return true;
+      };
+      time_rounds(options, hash_batches, multi.seconds);
+      results.push_back(multi);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <vms_bench/dataset.h>
+#include <vms_bench/digest_bench.h>
+#include <vms_bench/options.h>
+#include <vms_bench/tool_bench.h>
+#include <vms_common/json.h>
+
+namespace
+{
+  struct Stage
+  {
+    std::string name;
+    double seconds = 0.0;
+  };
+
+  struct Report
+  {
+    std::vector<Stage> stages;
+    std::vector<BenchResult> digests;
+    Dataset dataset;
+    std::uint64_t tarBytes = 0;
+    std::uint64_t tarGzBytes = 0;
+    std::vector<ToolRun> runs;
+    // Unset when fewer than two tool runs succeeded.
+    int logsMatch = -1;
+  };
+
+  bool timed(Report& report, std::string name, const std::function<bool()>& stage)
+  {
+    auto start = std::chrono::steady_clock::now();
+    bool ok = stage();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    report.stages.push_back({std::move(name), elapsed.count()});
+    return ok;
+  }
+
+  double per_second(double amount, double seconds)
+  {
+    return amount / (seconds > 0.0 ? seconds : 1e-9);
+  }
+
+  std::vector<DigestAlgorithm> tool_algorithms(const Options& options)
+  {
+    if (options.algorithms.empty())
+    {
+      return {DigestAlgorithm::sha256};
+    }
+    return options.algorithms;
+  }
+
+  ToolRun make_run(const Options& options, const std::string& suite, const std::filesystem::path& logDir)
+  {
+    ToolRun run;
+    run.suite = suite;
+    run.logDir = logDir;
+    run.command.push_back((options.toolsDir / (suite.compare(0, 3, "dir") == 0 ? "sha_from_dir" : "sha_from_tar")).string());
+    run.command.insert(run.command.end(), {"-j", std::to_string(options.jobs), "-O", logDir.string()});
+    if (!options.algorithms.empty())
+    {
+      std::string list;
+      for (auto algorithm : options.algorithms)
+      {
+        if (!list.empty())
+        {
+          list += ',';
+        }
+        list += digest_name(algorithm);
+      }
+      run.command.insert(run.command.end(), {"--algo", list});
+    }
+    return run;
+  }
+
+  bool run_tools(const Options& options, Report& report)
+  {
+    const std::filesystem::path& work = options.workDir;
+    std::error_code ec;
+    std::filesystem::create_directories(work, ec);
+    if (ec)
+    {
+      std::cerr << "Error! Cannot create " << work << ": " << ec.message() << std::endl;
+      return false;
+    }
+
+    if (!timed(report, "generate", [&]() { return generate_dataset(options, work, report.dataset); }))
+    {
+      return false;
+    }
+
+    const std::filesystem::path tar = work / "tree.tar";
+    const std::filesystem::path tarGz = work / "tree.tar.gz";
+    if (options.benchTar
+        && !timed(report, "archive_tar", [&]() { return write_archive(report.dataset, tar, false); }))
+    {
+      return false;
+    }
+    if (options.benchTarGz
+        && !timed(report, "archive_targz", [&]() { return write_archive(report.dataset, tarGz, true); }))
+    {
+      return false;
+    }
+    report.tarBytes = options.benchTar ? std::filesystem::file_size(tar, ec) : 0;
+    report.tarGzBytes = options.benchTarGz ? std::filesystem::file_size(tarGz, ec) : 0;
+
+    std::vector<std::filesystem::path> treeFiles;
+    for (const auto& file : report.dataset.files)
+    {
+      treeFiles.push_back(report.dataset.root / file.name);
+    }
+
+    std::vector<ToolRun> runs;
+    if (options.benchDir)
+    {
+      const std::vector<std::string> modes = options.readModes.empty() ? std::vector<std::string>{""}
+                                                                        : options.readModes;
+      for (const auto& mode : modes)
+      {
+        const std::string suite = mode.empty() ? std::string{"dir"} : "dir:" + mode;
+        runs.push_back(make_run(options, suite, work / "logs" / (mode.empty() ? suite : "dir_" + mode)));
+        if (!mode.empty())
+        {
+          runs.back().command.insert(runs.back().command.end(), {"--read-mode", mode});
+        }
+        runs.back().command.insert(runs.back().command.end(), {"-d", (work / "tree").string()});
+        runs.back().inputs = treeFiles;
+      }
+    }
+    if (options.benchTar)
+    {
+      runs.push_back(make_run(options, "tar", work / "logs" / "tar"));
+      runs.back().command.insert(runs.back().command.end(), {"-f", tar.string()});
+      runs.back().inputs = {tar};
+    }
+    if (options.benchTarGz)
+    {
+      runs.push_back(make_run(options, "targz", work / "logs" / "targz"));
+      runs.back().command.insert(runs.back().command.end(), {"-f", tarGz.string()});
+      runs.back().inputs = {tarGz};
+    }
+
+    for (auto& run : runs)
+    {
+      std::filesystem::remove_all(run.logDir, ec);
+      std::filesystem::create_directories(run.logDir, ec);
+      if (options.cold)
+      {
+        drop_cached(run.inputs);
+      }
+      if (!timed(report, "run_" + run.suite, [&]() { return run_tool(run); }))
+      {
+        return false;
+      }
+      std::uint64_t cached = 0;
+      std::uint64_t total = 0;
+      cached_bytes(run.inputs, cached, total);
+      run.cachedPercent = total > 0 ? 100.0 * static_cast<double>(cached) / static_cast<double>(total) : 0.0;
+      if (run.exitStatus != 0)
+      {
+        std::cerr << "Warning! " << run.command[0] << " exited with status " << run.exitStatus << std::endl;
+      }
+      report.runs.push_back(run);
+    }
+
+    // Every successful run must have produced the same digests.
+    std::string suffix{"."};
+    suffix += digest_name(tool_algorithms(options).front());
+    std::vector<std::string> reference;
+    std::size_t compared = 0;
+    bool match = true;
+    for (const auto& run : report.runs)
+    {
+      if (run.exitStatus != 0)
+      {
+        continue;
+      }
+      std::filesystem::path log;
+      for (const auto& entry : std::filesystem::directory_iterator(run.logDir, ec))
+      {
+        if (entry.path().extension() == suffix)
+        {
+          log = entry.path();
+        }
+      }
+      std::vector<std::string> lines;
+      if (log.empty() || !read_sorted_log(log, lines))
+      {
+        match = false;
+        continue;
+      }
+      if (compared++ == 0)
+      {
+        reference = std::move(lines);
+      }
+      else if (lines != reference)
+      {
+        match = false;
+      }
+    }
+    if (compared > 1)
+    {
+      report.logsMatch = match ? 1 : 0;
+    }
+    return true;
+  }
+
+  std::uint64_t self_peak_rss_kib()
+  {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<std::uint64_t>(std::max(0L, usage.ru_maxrss));
+  }
+
+  void write_json(std::ostream& os, const Options& options, const Report& report)
+  {
+    JsonWriter json(os);
+    json.begin_object();
+    json.field("tool", "vms_bench");
+
+    json.key("config").begin_object();
+    json.field("files", options.files);
+    json.field("dist", options.distName);
+    json.field("seed", options.seed);
+    json.field("jobs", options.jobs);
+    json.field("cold", options.cold);
+    json.field("buffer_mib", options.bufferMiB);
+    json.field("rounds", options.rounds);
+    json.field("small_messages", options.smallMessages);
+    json.key("algorithms").begin_array();
+    for (auto algorithm : tool_algorithms(options))
+    {
+      json.value(digest_name(algorithm));
+    }
+    json.end_array();
+    json.end_object();
+
+    json.key("stages").begin_array();
+    for (const auto& stage : report.stages)
+    {
+      json.begin_object().field("name", stage.name).field("seconds", stage.seconds).end_object();
+    }
+    json.end_array();
+
+    json.key("digests").begin_array();
+    for (const auto& r : report.digests)
+    {
+      json.begin_object();
+      json.field("name", r.name);
+      json.field("bytes", r.bytes);
+      json.field("messages", r.messages);
+      json.field("seconds", r.seconds);
+      json.field("mb_per_s", per_second(static_cast<double>(r.bytes) / 1e6, r.seconds));
+      json.field("messages_per_s", per_second(static_cast<double>(r.messages), r.seconds));
+      json.end_object();
+    }
+    json.end_array();
+
+    if (!report.runs.empty())
+    {
+      json.key("dataset").begin_object();
+      json.field("files", std::uint64_t{report.dataset.files.size()});
+      json.field("bytes", report.dataset.bytes);
+      json.field("tar_bytes", report.tarBytes);
+      json.field("targz_bytes", report.tarGzBytes);
+      json.end_object();
+    }
+
+    json.key("runs").begin_array();
+    for (const auto& run : report.runs)
+    {
+      json.begin_object();
+      json.field("suite", run.suite);
+      json.key("command").begin_array();
+      for (const auto& arg : run.command)
+      {
+        json.value(arg);
+      }
+      json.end_array();
+      json.field("exit_status", run.exitStatus);
+      json.field("seconds", run.seconds);
+      json.field("user_seconds", run.userSeconds);
+      json.field("system_seconds", run.systemSeconds);
+      json.field("peak_rss_kib", run.peakRssKiB);
+      json.field("cached_after_pct", run.cachedPercent);
+      json.field("mb_per_s", per_second(static_cast<double>(report.dataset.bytes) / 1e6, run.seconds));
+      json.field("files_per_s", per_second(static_cast<double>(report.dataset.files.size()), run.seconds));
+      json.end_object();
+    }
+    json.end_array();
+
+    if (report.logsMatch >= 0)
+    {
+      json.field("logs_match", report.logsMatch == 1);
+    }
+    json.field("peak_rss_kib", self_peak_rss_kib());
+    json.end_object();
+  }
+
+  void print_table(std::ostream& os, const Report& report)
+  {
+    os << std::fixed << std::setprecision(1);
+    if (!report.digests.empty())
+    {
+      os << std::left << std::setw(36) << "digest" << std::right << std::setw(12) << "MB/s"
+         << std::setw(14) << "messages/s" << std::endl;
+      for (const auto& r : report.digests)
+      {
+        os << std::left << std::setw(36) << r.name << std::right
+           << std::setw(12) << per_second(static_cast<double>(r.bytes) / 1e6, r.seconds)
+           << std::setw(14) << per_second(static_cast<double>(r.messages), r.seconds) << std::endl;
+      }
+    }
+    if (!report.runs.empty())
+    {
+      os << std::left << std::setw(36) << "run" << std::right << std::setw(12) << "MB/s"
+         << std::setw(14) << "files/s" << std::setw(14) << "peak RSS KiB" << std::setw(10) << "cached %"
+         << std::endl;
+      for (const auto& run : report.runs)
+      {
+        os << std::left << std::setw(36) << run.suite << std::right
+           << std::setw(12) << per_second(static_cast<double>(report.dataset.bytes) / 1e6, run.seconds)
+           << std::setw(14) << per_second(static_cast<double>(report.dataset.files.size()), run.seconds)
+           << std::setw(14) << run.peakRssKiB << std::setw(10) << run.cachedPercent << std::endl;
+      }
+    }
+  }
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  OptionsParser parser;
+  if (!parser.parse(argc, argv, options))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // The tools run first: they are forked from this process, whose resident
+  // set is part of their peak RSS and is still small at that point.
+  Report report;
+  if (options.benchDir || options.benchTar || options.benchTarGz)
+  {
+    bool ok = run_tools(options, report);
+    if (!options.keep)
+    {
+      std::error_code ec;
+      std::filesystem::remove_all(options.workDir, ec);
+    }
+    if (!ok)
+    {
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (options.benchDigests
+      && !timed(report, "digests", [&]() { return run_digest_bench(options, report.digests); }))
+  {
+    return EXIT_FAILURE;
+  }
+
+  if (options.jsonPath.empty())
+  {
+    write_json(std::cout, options, report);
+  }
+  else
+  {
+    std::ofstream out(options.jsonPath);
+    write_json(out, options, report);
+    out.close();
+    if (!out)
+    {
+      std::cerr << "Error! Unable to write " << options.jsonPath << std::endl;
+      return EXIT_FAILURE;
+    }
+    print_table(std::cout, report);
+    std::cout << "Report: " << options.jsonPath.string() << std::endl;
+  }
+
+  bool failed = report.logsMatch == 0;
+  for (const auto& run : report.runs)
+  {
+    failed = failed || run.exitStatus != 0;
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_bench/options.h>
+#include <vms_common/cli.h>
+
+#include <charconv>
+#include <iostream>
+#include <string_view>
+
+namespace
+{
+  // "4096", "4K", "16M", "1G" (binary multiples).
+  bool parse_size(std::string_view text, std::uint64_t& out)
+  {
+    std::uint64_t value = 0;
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (text.empty() || ec != std::errc{})
+    {
+      return false;
+    }
+    std::string_view suffix{ptr, static_cast<std::size_t>(text.data() + text.size() - ptr)};
+    unsigned shift = 0;
+    if (suffix == "K" || suffix == "k")
+    {
+      shift = 10;
+    }
+    else if (suffix == "M" || suffix == "m")
+    {
+      shift = 20;
+    }
+    else if (suffix == "G" || suffix == "g")
+    {
+      shift = 30;
+    }
+    else if (!suffix.empty())
+    {
+      return false;
+    }
+    out = value << shift;
+    return (out >> shift) == value;
+  }
+
+  bool parse_distribution(std::string_view value, std::vector<SizeBucket>& out)
+  {
+    out.clear();
+    if (value == "small")
+    {
+      out = {{4096, 1}};
+      return true;
+    }
+    if (value == "mixed")
+    {
+      out = {{4096, 70}, {1024 * 1024, 25}, {16 * 1024 * 1024, 5}};
+      return true;
+    }
+    if (value == "large")
+    {
+      out = {{64 * 1024 * 1024, 1}};
+      return true;
+    }
+
+    // <max>:<weight>,... with increasing maxima.
+    std::size_t pos = 0;
+    while (pos <= value.size())
+    {
+      std::size_t end = value.find(',', pos);
+      if (end == std::string_view::npos)
+      {
+        end = value.size();
+      }
+      std::string_view item = value.substr(pos, end - pos);
+      std::size_t colon = item.find(':');
+      SizeBucket bucket;
+      if (colon == std::string_view::npos || !parse_size(item.substr(0, colon), bucket.maxSize)
+          || !parse_unsigned("--dist", item.substr(colon + 1), bucket.weight))
+      {
+        std::cerr << "Error: invalid bucket for --dist: " << item << std::endl;
+        return false;
+      }
+      if (!out.empty() && bucket.maxSize <= out.back().maxSize)
+      {
+        std::cerr << "Error: --dist buckets must have increasing sizes" << std::endl;
+        return false;
+      }
+      out.push_back(bucket);
+      pos = end + 1;
+    }
+
+    unsigned total = 0;
+    for (const auto& b : out)
+    {
+      total += b.weight;
+    }
+    if (total == 0)
+    {
+      std::cerr << "Error: --dist needs at least one bucket with a weight" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool parse_read_modes(std::string_view value, std::vector<std::string>& out)
+  {
+    out.clear();
+    std::size_t pos = 0;
+    while (pos <= value.size())
+    {
+      std::size_t end = value.find(',', pos);
+      if (end == std::string_view::npos)
+      {
+        end = value.size();
+      }
+      std::string_view name = value.substr(pos, end - pos);
+      if (name != "buffered" && name != "fadvise" && name != "mmap" && name != "direct")
+      {
+        std::cerr << "Error: unknown mode for --read-modes: " << name << std::endl;
+        return false;
+      }
+      out.emplace_back(name);
+      pos = end + 1;
+    }
+    return true;
+  }
+
+  bool parse_suites(std::string_view value, Options& out)
+  {
+    out.benchDigests = out.benchDir = out.benchTar = out.benchTarGz = false;
+    std::size_t pos = 0;
+    while (pos <= value.size())
+    {
+      std::size_t end = value.find(',', pos);
+      if (end == std::string_view::npos)
+      {
+        end = value.size();
+      }
+      std::string_view name = value.substr(pos, end - pos);
+      if (name == "digests")
+      {
+        out.benchDigests = true;
+      }
+      else if (name == "dir")
+      {
+        out.benchDir = true;
+      }
+      else if (name == "tar")
+      {
+        out.benchTar = true;
+      }
+      else if (name == "targz")
+      {
+        out.benchTarGz = true;
+      }
+      else
+      {
+        std::cerr << "Error: unknown suite for --suite: " << name << std::endl;
+        return false;
+      }
+      pos = end + 1;
+    }
+    return true;
+  }
+}  // namespace
+
+void OptionsParser::print_usage(std::ostream& os) const
+{
+  os << "vms-bench — by Manuel Virgilio" << std::endl;
+  os << "Measure the digest algorithms and the vms tools on a reproducible synthetic dataset." << std::endl;
+  os << "Usage:" << std::endl;
+  os << "  vms_bench [--suite <list>] [-m <MiB>] [-r <n>] [-n <n>] [--algo <list>]" << std::endl;
+  os << "            [--files <n>] [--dist <spec>] [--seed <n>] [--workdir <dir>] [--keep]" << std::endl;
+  os << "            [-j <n>] [--read-modes <list>] [--cold] [--tools <dir>] [--json <file>] [-h]" << std::endl;
+  os << "Options:" << std::endl;
+  os << "  --suite <list> Comma separated suites: digests, dir, tar, targz (default: all)" << std::endl;
+  os << "  -m <MiB>      Size of the in-memory buffer hashed by each round (default: 256)" << std::endl;
+  os << "  -r <n>        Rounds per algorithm, the fastest one is reported (default: 3)" << std::endl;
+  os << "  -n <n>        Number of random small messages (up to 4 KiB) per round (default: 100000)" << std::endl;
+  os << "  --algo <list> Only measure the comma separated algorithms: " << available_digests() << " (default: all);" << std::endl;
+  os << "                also passed to the tools (default there: sha256)" << std::endl;
+  os << "  --files <n>   Number of files in the synthetic tree (default: 2000)" << std::endl;
+  os << "  --dist <spec> File sizes: small (up to 4K), mixed (70% up to 4K, 25% up to 1M, 5% up to 16M)," << std::endl;
+  os << "                large (up to 64M) or <max>:<weight>,... e.g. 4K:9,1M:1 (default: mixed)" << std::endl;
+  os << "  --seed <n>    Seed of the dataset generator, same seed same bytes (default: 1)" << std::endl;
+  os << "  --workdir <dir> Where the dataset and the logs are created (default: <tmp>/vms_bench)" << std::endl;
+  os << "  --keep        Keep the work directory instead of removing it at the end" << std::endl;
+  os << "  -j <n>        Passed to the tools (0: one per CPU, default: 1)" << std::endl;
+  os << "  --read-modes <list> Run the dir suite once per sha_from_dir --read-mode: buffered, fadvise, mmap, direct" << std::endl;
+  os << "  --cold        Evict the dataset and archives from the page cache before each tool run" << std::endl;
+  os << "  --tools <dir> Directory holding sha_from_dir and sha_from_tar (default: beside vms_bench)" << std::endl;
+  os << "  --json <file> Write the JSON report to <file> (default: stdout)" << std::endl;
+  os << "  -h, --help    Show this help message" << std::endl;
+}
+
+bool OptionsParser::parse(int argc, char* argv[], Options& out) const
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string_view arg{argv[i]};
+
+    if (arg == "-h" || arg == "--help")
+    {
+      print_usage(std::cout);
+      return false;
+    }
+
+    if (arg == "-m" || arg == "-r" || arg == "-n" || arg == "--files")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: " << arg << " requires a number" << std::endl;
+        return false;
+      }
+      unsigned& value = arg == "-m" ? out.bufferMiB
+                        : arg == "-r" ? out.rounds
+                        : arg == "-n" ? out.smallMessages
+                                      : out.files;
+      if (!parse_unsigned(arg, argv[++i], value))
+      {
+        return false;
+      }
+      if (value == 0)
+      {
+        std::cerr << "Error: " << arg << " must be greater than 0" << std::endl;
+        return false;
+      }
+      continue;
+    }
+
+    if (arg == "--seed")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --seed requires a number" << std::endl;
+        return false;
+      }
+      if (!parse_unsigned(arg, argv[++i], out.seed))
+      {
+        return false;
+      }
+      continue;
+    }
+
+    if (arg == "-j")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: -j requires a number" << std::endl;
+        return false;
+      }
+      if (!parse_unsigned(arg, argv[++i], out.jobs))
+      {
+        return false;
+      }
+      continue;
+    }
+
+    if (arg == "--read-modes")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --read-modes requires a list of modes" << std::endl;
+        return false;
+      }
+      if (!parse_read_modes(argv[++i], out.readModes))
+      {
+        return false;
+      }
+      continue;
+    }
+
+    if (arg == "--algo")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --algo requires a list of names" << std::endl;
+        return false;
+      }
+      if (!parse_digest_algorithms(arg, argv[++i], out.algorithms))
+      {
+        return false;
+      }
+      continue;
+    }
+
+    if (arg == "--suite")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --suite requires a list of names" << std::endl;
+        return false;
+      }
+      if (!parse_suites(argv[++i], out))
+      {
+        return false;
+      }
+      continue;
+    }
+
+    if (arg == "--dist")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: --dist requires a distribution" << std::endl;
+        return false;
+      }
+      out.distName = argv[++i];
+      continue;
+    }
+
+    if (arg == "--workdir" || arg == "--tools" || arg == "--json")
+    {
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Error: " << arg << " requires a path" << std::endl;
+        return false;
+      }
+      std::filesystem::path& value = arg == "--workdir" ? out.workDir
+                                     : arg == "--tools" ? out.toolsDir
+                                                        : out.jsonPath;
+      value = argv[++i];
+      continue;
+    }
+
+    if (arg == "--keep")
+    {
+      out.keep = true;
+      continue;
+    }
+
+    if (arg == "--cold")
+    {
+      out.cold = true;
+      continue;
+    }
+
+    std::cerr << "Unknown parameter: " << arg << std::endl;
+    return false;
+  }
+
+  if (!parse_distribution(out.distName, out.distribution))
+  {
+    return false;
+  }
+  if (out.workDir.empty())
+  {
+    std::error_code ec;
+    out.workDir = std::filesystem::temp_directory_path(ec) / "vms_bench";
+  }
+  if (out.toolsDir.empty())
+  {
+    std::error_code ec;
+    out.toolsDir = std::filesystem::read_symlink("/proc/self/exe", ec).parent_path();
+  }
+  return true;
+}
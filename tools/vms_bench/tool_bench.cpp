@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2025 Manuel Virgilio
+ *
+ * Licensed under the MIT License.
+ * See the LICENSE file in the project root for full license information.
+ */
+
+#include <vms_bench/tool_bench.h>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+  double to_seconds(const timeval& tv)
+  {
+    return static_cast<double>(tv.tv_sec) + static_cast<double>(tv.tv_usec) / 1e6;
+  }
+}  // namespace
+
+bool run_tool(ToolRun& run)
+{
+  std::vector<char*> argv;
+  for (auto& arg : run.command)
+  {
+    argv.push_back(arg.data());
+  }
+  argv.push_back(nullptr);
+
+  // fork rather than posix_spawn: glibc spawns with vfork, and the exec then
+  // charges our own peak RSS to the child's ru_maxrss.
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid < 0)
+  {
+    std::cerr << "Error! Cannot run " << run.command[0] << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  if (pid == 0)
+  {
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0)
+    {
+      dup2(null, STDOUT_FILENO);
+      dup2(null, STDERR_FILENO);
+    }
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+
+  int status = 0;
+  rusage usage{};
+  while (wait4(pid, &status, 0, &usage) < 0)
+  {
+    if (errno != EINTR)
+    {
+      std::cerr << "Error! Lost track of " << run.command[0] << ": " << std::strerror(errno) << std::endl;
+      return false;
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  run.exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  run.seconds = elapsed.count();
+  run.userSeconds = to_seconds(usage.ru_utime);
+  run.systemSeconds = to_seconds(usage.ru_stime);
+  // Linux reports ru_maxrss in KiB.
+  run.peakRssKiB = static_cast<std::uint64_t>(std::max(0L, usage.ru_maxrss));
+  return true;
+}
+
+void drop_cached(const std::vector<std::filesystem::path>& files)
+{
+  for (const auto& file : files)
+  {
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      continue;
+    }
+    // Dirty pages cannot be dropped: the dataset was just written.
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+void cached_bytes(const std::vector<std::filesystem::path>& files, std::uint64_t& cached, std::uint64_t& total)
+{
+  const auto page = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+  cached = total = 0;
+  std::vector<unsigned char> resident;
+  for (const auto& file : files)
+  {
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      continue;
+    }
+    struct stat st;
+    const std::uint64_t size = fstat(fd, &st) == 0 ? static_cast<std::uint64_t>(st.st_size) : 0;
+    // Mapping a file does not bring it into the cache; mincore() tells
+    // which of its pages already are.
+    void* data = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    total += size;
+    if (data == MAP_FAILED)
+    {
+      continue;
+    }
+    resident.resize((size + page - 1) / page);
+    if (mincore(data, size, resident.data()) == 0)
+    {
+      for (std::size_t i = 0; i < resident.size(); ++i)
+      {
+        if (resident[i] & 1)
+        {
+          cached += std::min(page, size - i * page);
+        }
+      }
+    }
+    munmap(data, size);
+  }
+}
+
+bool read_sorted_log(const std::filesystem::path& log, std::vector<std::string>& lines)
+{
+  std::ifstream in(log);
+  if (!in)
+  {
+    std::cerr << "Error! Cannot open " << log << std::endl;
+    return false;
+  }
+  lines.clear();
+  for (std::string line; std::getline(in, line);)
+  {
+    lines.push_back(std::move(line));
+  }
+  std::sort(lines.begin(), lines.end());
+  return true;
+}